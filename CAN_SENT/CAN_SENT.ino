@@ -1,5 +1,7 @@
 #include "../lib/ESP_CAN.h"
 #include "../lib/ESP_CAN.cpp"
+#include "../lib/ESP_CAN_Decoder.cpp"
+#include "../lib/ESP_CAN_BitTiming.cpp"
 
 // Define the pins for CAN communication
 const int CAN_RX_PIN = 5;  // Not used for sending, but required by library
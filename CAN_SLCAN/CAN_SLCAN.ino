@@ -0,0 +1,27 @@
+#include "../lib/ESP_CAN.h"
+#include "../lib/ESP_CAN.cpp"
+#include "../lib/ESP_CAN_Decoder.cpp"
+#include "../lib/ESP_CAN_BitTiming.cpp"
+#include "../lib/ESP_CAN_SLCAN.h"
+#include "../lib/ESP_CAN_SLCAN.cpp"
+
+// Define the pins for CAN communication
+const int CAN_RX_PIN = 5;
+const int CAN_TX_PIN = 4;
+
+// Initialize our CAN library and the serial bridge on top of it
+ESP_CAN can(CAN_RX_PIN, CAN_TX_PIN);
+ESP_CAN_SLCAN slcan(can, Serial);
+
+void setup() {
+  // The host selects the CAN bitrate with "Sn" and opens the bus with "O".
+  // Use a fast UART so the serial link keeps up with the bus. The default
+  // TX buffer (128 bytes) holds a quarter of a full binary batch; with room
+  // for two, one batch is written while the next fills.
+  Serial.setTxBufferSize(CAN_BATCH_MAX_ENCODED * 2);
+  Serial.begin(921600);
+}
+
+void loop() {
+  slcan.poll();
+}
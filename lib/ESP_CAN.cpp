@@ -10,34 +10,218 @@ ESP_CAN::ESP_CAN(int rxPin, int txPin) {
   tec = 0;
   rec = 0;
   state = CAN_STATE_ERROR_ACTIVE;
-  _rxState = RX_STATE_IDLE;
+  _injectHead = 0;
+  _injectCount = 0;
+  _ackState = ACK_IDLE;
+  _idleBits = 0;
+  _txState = CAN_TX_IDLE;
+  _ownFrame = false;
+  _txStartCycles = 0;
+  _rxStartCycles = 0;
+  _listenOnly = false;
+  _waveCache = NULL;
+  _txConfigured = false;
+  _loopback = CAN_LOOPBACK_OFF;
+  _loopLevel = HIGH;
+  votesCorrected = 0;
+  maxSampleLateness = 0;
+  errors = CAN_ErrorCounts();
+  txRetries = 0;
+  deadlineMisses = 0;
+  _txPolicy = can_tx_single_shot();
+  _txAttempts = 0;
+  remoteResponses = 0;
+  _txBits = &_txWave;
+  _responseCount = 0;
+  _responsesPending = 0;
+  _responding = -1;
+  _stateCallback = NULL;
+  _stateCallbackArg = NULL;
+  _autoRecover = true;
+  _recovering = false;
+  _recoverySequences = 0;
+  _timing = CAN_BitTiming();
+  setTripleSampling(false);
 }
 
-void ESP_CAN::begin(long baudrate) {
-  pinMode(_txPin, OUTPUT);
+void ESP_CAN::begin(long baudrate, float samplePoint) {
+  CAN_BitTiming timing;
+  if (!can_solve_bit_timing(ESP.getCpuFreqMHz() * 1000000, baudrate, samplePoint, timing)) {
+    // No quanta split hits the rate exactly enough; fall back to a plain
+    // 10-quanta bit at the nearest rate the clock allows.
+    timing.brp = ESP.getCpuFreqMHz() * 1000000 / (baudrate * 10);
+    if (timing.brp < 1) timing.brp = 1;
+    timing.propSeg = 4;
+    timing.phaseSeg1 = 3;
+    timing.phaseSeg2 = 2;
+    timing.sjw = 2;
+  }
+  begin(timing);
+}
+
+void ESP_CAN::begin(const CAN_BitTiming &timing) {
+  configureTx();
   pinMode(_rxPin, INPUT_PULLUP);
+
+  _timing = timing;
+  _bitTicks = timing.brp * timing.quantaPerBit();
+  _samplePointTicks = timing.brp * (1 + timing.propSeg + timing.phaseSeg1);
+  _sjwTicks = timing.brp * timing.sjw;
+  setTripleSampling(_tripleSampling, _voteSpacingTq);
+
+  _decoder.reset();
+  _ackState = ACK_IDLE;
+  _idleBits = 0;
+  _txState = CAN_TX_IDLE;
+  _responsesPending = 0;
+  _responding = -1;
+  _ownFrame = false;
+  resyncReceiver();
+}
+
+void ESP_CAN::setTripleSampling(bool enable, uint8_t spacingTq) {
+  _tripleSampling = enable;
+  _voteSpacingTq = spacingTq < 1 ? 1 : spacingTq;
+  // The two early reads must fit between SYNC_SEG and the sample point. The
+  // requested spacing is kept, so begin() can apply it to the new timing.
+  uint8_t maxSpacing = (_timing.propSeg + _timing.phaseSeg1) / 2;
+  _voteSpacingTicks = _timing.brp * (_voteSpacingTq < maxSpacing ? _voteSpacingTq : maxSpacing);
+  _votesHigh = 0;
+  _votesTaken = 0;
+}
+
+// Going silent lets go of the bus at once; leaving listen-only configures
+// the TX pin, which may not have been set up by begin().
+void ESP_CAN::setListenOnly(bool enable) {
+  if (enable == _listenOnly) return;
+  _listenOnly = enable;
+  if (enable) {
+    // Let go of the bus: release a pending ACK and abort a pending frame
+    if (_txConfigured || _loopback == CAN_LOOPBACK_INTERNAL) writeTx(HIGH);
+    abortTransmission();
+  } else {
+    configureTx();
+    _idleBits = 0; // Not tracked while silent
+  }
+}
+
+void ESP_CAN::setLoopback(CAN_Loopback_Mode mode) {
+  if (_txConfigured) digitalWrite(_txPin, HIGH);
+  _loopLevel = HIGH;
+  _loopback = mode;
+  if (_timing.brp) configureTx(); // begin() has run: leaving INTERNAL needs the pin
+  abortTransmission();
+  _decoder.reset();
+  resyncReceiver();
+}
+
+// Sets the TX pin up as a recessive output, but only in modes that drive
+// it: listen-only and internal loopback leave it alone.
+void ESP_CAN::configureTx() {
+  if (_listenOnly || _loopback == CAN_LOOPBACK_INTERNAL) return;
+  pinMode(_txPin, OUTPUT);
   digitalWrite(_txPin, HIGH);
-  _bitTimeUs = 1000000 / baudrate;
-  _lastSampleTime = micros();
+  _txConfigured = true;
+}
+
+// Restarts the receive bit grid at the current instant.
+void ESP_CAN::resyncReceiver() {
+  _bitStart = ticks();
+  _lastPoll = _bitStart;
+  _sampled = false;
+  _votesHigh = 0;
+  _votesTaken = 0;
+  _rxLevel = readRx();
+  _lastSample = HIGH;
+}
+
+// Combines the sample-point read with the two earlier reads of this bit.
+// Reads that were missed because no poll fell between two vote instants
+// take the sample-point level.
+bool ESP_CAN::vote(bool level) {
+  if (!_tripleSampling) return level;
+  while (_votesTaken < 2) {
+    _votesHigh += level;
+    _votesTaken++;
+  }
+  uint8_t high = _votesHigh + level;
+  _votesHigh = 0;
+  _votesTaken = 0;
+  if (high == 1 || high == 2) votesCorrected++;
+  return high >= 2;
 }
 
 // --- ERROR HANDLING ---
 
+void ESP_CAN::onStateChange(CAN_StateCallback callback, void *arg) {
+  _stateCallback = callback;
+  _stateCallbackArg = arg;
+}
+
+void ESP_CAN::setAutoRecover(bool enable) {
+  _autoRecover = enable;
+  if (enable) recover();
+}
+
+bool ESP_CAN::recover() {
+  if (state != CAN_STATE_BUS_OFF) return false;
+  if (!_recovering) {
+    _recovering = true;
+    _recoverySequences = 0;
+    _recessiveSince = ticks();
+  }
+  return true;
+}
+
+void ESP_CAN::setState(CAN_State newState) {
+  if (newState == state) return;
+  CAN_State previous = state;
+  state = newState;
+  if (state == CAN_STATE_BUS_OFF) {
+    // Bus-off: stop driving the bus entirely, then count idle sequences
+    writeTx(HIGH);
+    abortTransmission();
+    _recovering = false;
+    _recoverySequences = 0;
+    if (_autoRecover) recover();
+  }
+  if (_stateCallback) _stateCallback(previous, state, _stateCallbackArg);
+}
+
+// Only the TEC can take the node bus-off; a high REC makes it error passive.
 void ESP_CAN::updateState() {
-  if (tec > 255 || rec > 255) {
-    state = CAN_STATE_BUS_OFF;
+  if (state == CAN_STATE_BUS_OFF) return; // Left only through recovery
+  if (tec > 255) {
+    setState(CAN_STATE_BUS_OFF);
   } else if (tec > 127 || rec > 127) {
-    state = CAN_STATE_ERROR_PASSIVE;
+    setState(CAN_STATE_ERROR_PASSIVE);
   } else {
-    state = CAN_STATE_ERROR_ACTIVE;
+    setState(CAN_STATE_ERROR_ACTIVE);
+  }
+}
+
+// Sorts decoder errors, error frames and overload frames into `errors`.
+void ESP_CAN::countEvent(CAN_Decode_Event event) {
+  if (event == CAN_DECODE_ERROR_FRAME) {
+    errors.errorFrames++;
+  } else if (event == CAN_DECODE_OVERLOAD_FRAME) {
+    errors.overloadFrames++;
+  } else if (event == CAN_DECODE_ERROR) {
+    switch (_decoder.lastError()) {
+      case CAN_DECODE_ERROR_STUFF: errors.stuff++; break;
+      case CAN_DECODE_ERROR_CRC: errors.crc++; break;
+      case CAN_DECODE_ERROR_FORM: errors.form++; break;
+      default: break;
+    }
   }
 }
 
 void ESP_CAN::handleError(bool isTxError, bool isRxError) {
-  if (isTxError && state != CAN_STATE_BUS_OFF) {
+  if (state == CAN_STATE_BUS_OFF) return;
+  if (isTxError) {
     tec += 8;
   }
-  if (isRxError && state != CAN_STATE_BUS_OFF) {
+  if (isRxError && rec < 0xFFFF) {
     rec++;
   }
   updateState();
@@ -47,185 +231,500 @@ void ESP_CAN::handleSuccess(bool isTxSuccess, bool isRxSuccess) {
   if (isTxSuccess && tec > 0) {
     tec--;
   }
-  if (isRxSuccess && rec > 0) {
-    rec--;
+  if (isRxSuccess) {
+    // An error-passive receiver drops back to a value between 119 and 127
+    if (rec > 127) rec = 119;
+    else if (rec > 0) rec--;
   }
   updateState();
 }
 
-// --- SENDER LOGIC ---
+// Bus-off recovery: the node may rejoin after 128 occurrences of 11
+// consecutive recessive bits. Any dominant level restarts the current
+// sequence. Runs from readFrame() so it never blocks.
+void ESP_CAN::pollRecovery(uint32_t now, bool level) {
+  if (!_recovering) return;
+  if (level == LOW) {
+    _recessiveSince = now;
+    return;
+  }
+  uint32_t sequenceTicks = 11 * _bitTicks;
+  while (now - _recessiveSince >= sequenceTicks) {
+    _recessiveSince += sequenceTicks;
+    if (++_recoverySequences < 128) continue;
+
+    _recovering = false;
+    tec = 0;
+    rec = 0;
+    // The bus was just idle for 11 bits, so the next dominant edge is SOF
+    _decoder.resetToIdle();
+    resyncReceiver();
+    setState(CAN_STATE_ERROR_ACTIVE);
+    return;
+  }
+}
 
-bool ESP_CAN::sendBit(bool bit, bool checkArbitration) {
-  if (state == CAN_STATE_BUS_OFF) return false;
+// --- SENDER LOGIC ---
 
-  digitalWrite(_txPin, bit ? HIGH : LOW);
-  delayMicroseconds(_bitTimeUs);
+void ESP_CAN::waitUntil(uint32_t deadline) {
+  while ((int32_t)(ticks() - deadline) < 0) {
+  }
+}
 
-  // Arbitration check: if we send recessive (1) but read dominant (0), we lost.
-  if (checkArbitration && bit == HIGH && digitalRead(_rxPin) == LOW) {
-    return false; // Arbitration lost
+// Drives one bit for a full bit time and returns the bus level seen at the
+// sample point. `bitStart` is advanced to the start of the next bit.
+bool ESP_CAN::transmitBit(bool bit, uint32_t &bitStart) {
+  writeTx(bit);
+  if (_tripleSampling) {
+    for (int k = 2; k > 0; k--) {
+      waitUntil(bitStart + _samplePointTicks - k * _voteSpacingTicks);
+      _votesHigh += readRx();
+      _votesTaken++;
+    }
   }
-  return true; // Bit sent successfully
+  waitUntil(bitStart + _samplePointTicks);
+  bool busLevel = vote(readRx());
+  bitStart += _bitTicks;
+  waitUntil(bitStart);
+  return busLevel;
 }
 
 bool ESP_CAN::sendFrame(CAN_Frame &frame) {
-  if (state == CAN_STATE_BUS_OFF) return false;
-
-  bool bitSequence[128];
-  int bitIndex = 0;
+  if (state == CAN_STATE_BUS_OFF || _listenOnly) return false;
+  if (_waveCache) return transmitWaveform(_waveCache->encode(frame), frame);
+  return transmitWaveform(can_encode_waveform(frame), frame);
+}
 
-  // Construct bit sequence for CRC
-  for (int i = 10; i >= 0; i--) bitSequence[bitIndex++] = (frame.id >> i) & 0x01;
-  bitSequence[bitIndex++] = 0; // RTR
-  bitSequence[bitIndex++] = 0; // IDE
-  bitSequence[bitIndex++] = 0; // r0
-  uint8_t dlc = frame.dlc > 8 ? 8 : frame.dlc;
-  for (int i = 3; i >= 0; i--) bitSequence[bitIndex++] = (dlc >> i) & 0x01;
-  for (int i = 0; i < dlc; i++) {
-    for (int j = 7; j >= 0; j--) bitSequence[bitIndex++] = (frame.data[i] >> j) & 0x01;
-  }
-  uint16_t crc = calculateCRC(bitSequence, bitIndex);
+bool ESP_CAN::sendPrecomputed(const CAN_PrecomputedFrame &frame) {
+  if (state == CAN_STATE_BUS_OFF || _listenOnly) return false;
+  return transmitWaveform(frame.waveform, frame.frame);
+}
 
+// Blocking transmit of an encoded frame; `frame` is only used for loopback.
+bool ESP_CAN::transmitWaveform(const CAN_Waveform &wave, const CAN_Frame &frame) {
   // --- Transmit Frame ---
-  if (!sendBit(LOW, false)) { handleError(true, false); return false; } // SOF
-
-  int consecutiveBits = 0;
-  bool lastBit = LOW;
-
-  // Send main frame with bit stuffing and arbitration
-  for (int i = 0; i < bitIndex; i++) {
-    if (bitSequence[i] == lastBit) consecutiveBits++; else consecutiveBits = 1;
-    lastBit = bitSequence[i];
-    if (!sendBit(bitSequence[i], true)) { handleError(true, false); return false; } // ARBITRATION LOST
-    if (consecutiveBits == 5) {
-      if (!sendBit(!lastBit, true)) { handleError(true, false); return false; }
-      consecutiveBits = 0;
-      lastBit = !lastBit;
-    }
-  }
-
-  // Send CRC with bit stuffing
-  for (int i = 14; i >= 0; i--) {
-    bool bit = (crc >> i) & 0x01;
-    if (bit == lastBit) consecutiveBits++; else consecutiveBits = 1;
-    lastBit = bit;
-    if (!sendBit(bit, false)) { handleError(true, false); return false; }
-    if (consecutiveBits == 5) {
-      if (!sendBit(!lastBit, false)) { handleError(true, false); return false; }
-      consecutiveBits = 0;
-      lastBit = !lastBit;
+  // Own SOF is the hard synchronization point; every later bit edge and
+  // sample instant is scheduled from it on the cycle counter.
+  uint32_t bitStart = ticks();
+  uint32_t sof = bitStart;
+
+  // Send SOF, ID, control, data and CRC, stuff bits included. Arbitration
+  // covers the identifier and RTR bit: sending recessive but reading
+  // dominant means a higher-priority node is transmitting. Any other
+  // mismatch is a bit error.
+  for (int i = 0; i < wave.length; i++) {
+    bool bit = wave.bit(i);
+    bool busLevel = transmitBit(bit, bitStart);
+    if (busLevel == bit) continue;
+    writeTx(HIGH);
+    resyncReceiver();
+    if (i < wave.arbitrationEnd && bit == HIGH) {
+      // Arbitration loss is not an error and leaves the TEC unchanged. The
+      // winner sent the same bits so far, so the decoder takes them and
+      // receives the rest of its frame; the bus is not idle until it ends.
+      _decoder.resetToIdle();
+      for (int k = 0; k < i; k++) _decoder.feed(wave.bit(k));
+      _decoder.feed(LOW);
+      _lastSample = LOW;
+      _rxStartCycles = sof;
+      return false; // ARBITRATION LOST
     }
+    errors.bit++;
+    handleError(true, false);
+    _decoder.reset();
+    return false;
   }
 
   // CRC Delimiter
-  if (!sendBit(HIGH, false)) { handleError(true, false); return false; }
-
-  // ACK Slot
-  pinMode(_txPin, INPUT);
-  delayMicroseconds(_bitTimeUs);
-  bool ackReceived = (digitalRead(_rxPin) == LOW);
-  pinMode(_txPin, OUTPUT);
-  digitalWrite(_txPin, HIGH);
-
-  if (!ackReceived) { handleError(true, false); return false; }
+  transmitBit(HIGH, bitStart);
+
+  // ACK Slot: stay recessive and look for a receiver's dominant ACK. In
+  // loopback we are our own receiver.
+  bool ackReceived = (transmitBit(_loopback == CAN_LOOPBACK_OFF, bitStart) == LOW);
+  if (!ackReceived) {
+    errors.ack++;
+    // An error-passive transmitter alone on the bus would otherwise count
+    // itself into bus-off, so its ACK errors leave the TEC unchanged.
+    if (state != CAN_STATE_ERROR_PASSIVE) handleError(true, false);
+    // No retransmission before 11 recessive bits, as after an error frame
+    _decoder.reset();
+    resyncReceiver();
+    return false;
+  }
 
   // ACK Delimiter & EOF
-  sendBit(HIGH, false);
-  for (int i = 0; i < 7; i++) sendBit(HIGH, false);
+  for (int i = 0; i < 8; i++) transmitBit(HIGH, bitStart);
+
+  // Error-passive transmitters suspend for 8 bits after intermission
+  // before they may start another frame.
+  if (state == CAN_STATE_ERROR_PASSIVE) {
+    for (int i = 0; i < 3 + 8; i++) transmitBit(HIGH, bitStart);
+  }
 
   handleSuccess(true, false);
+  // The intermission has passed when error passive, otherwise it follows;
+  // busIdle() stays false until it has.
+  if (state == CAN_STATE_ERROR_PASSIVE) _decoder.resetToIdle();
+  else _decoder.resetToIntermission();
+  resyncReceiver();
+  if (_loopback != CAN_LOOPBACK_OFF) injectFrame(frame);
   return true;
 }
 
 // --- RECEIVER LOGIC (Non-Blocking) ---
 
+bool ESP_CAN::injectFrame(const CAN_Frame &frame) {
+  if (_injectCount == INJECT_QUEUE_SIZE) return false;
+  _injectQueue[(_injectHead + _injectCount) % INJECT_QUEUE_SIZE] = frame;
+  _injectCount++;
+  return true;
+}
+
 CAN_Read_Status ESP_CAN::readFrame(CAN_Frame &frame) {
-  if (state == CAN_STATE_BUS_OFF) return CAN_READ_NO_MSG;
+  return pollLevel(ticks(), readRx(), frame);
+}
+
+CAN_Read_Status ESP_CAN::pollLevel(uint32_t now, bool level, CAN_Frame &frame) {
+  CAN_Read_Status status = stepReceiver(now, level, frame);
+  // Injected frames bypass the bus and the error counters. They come out
+  // on polls without a bus result, so the bus is still sampled every poll.
+  if (status == CAN_READ_NO_MSG && _injectCount > 0) {
+    frame = _injectQueue[_injectHead];
+    _injectHead = (_injectHead + 1) % INJECT_QUEUE_SIZE;
+    _injectCount--;
+    return CAN_READ_MSG_OK;
+  }
+  return status;
+}
 
-  // Non-blocking bit sampling
-  if (micros() - _lastSampleTime < _bitTimeUs) {
+CAN_Read_Status ESP_CAN::stepReceiver(uint32_t now, bool level, CAN_Frame &frame) {
+  if (state == CAN_STATE_BUS_OFF) {
+    pollRecovery(now, level);
     return CAN_READ_NO_MSG;
   }
-  _lastSampleTime += _bitTimeUs;
-  bool currentBit = digitalRead(_rxPin);
-
-  // State Machine for receiving a frame
-  switch (_rxState) {
-    case RX_STATE_IDLE:
-      if (currentBit == LOW) { // Potential SOF
-        _rxState = RX_STATE_SOF;
-        _rxBitCount = 0;
-        _consecutiveBits = 1;
-        _lastBit = LOW;
-      }
-      break;
 
-    case RX_STATE_SOF:
-      // We are now in the frame, after SOF
-      _rxState = RX_STATE_FRAME;
-      // Fall through to process the first bit of the ID
+  // The bus is whatever we drive ourselves
+  if (_loopback == CAN_LOOPBACK_INTERNAL) level = _loopLevel;
 
-    case RX_STATE_FRAME:
-      if (currentBit == _lastBit) _consecutiveBits++; else _consecutiveBits = 1;
+  uint32_t phase = now - _bitStart;
 
-      if (_consecutiveBits == 5) {
-        // Next bit is a stuff bit, ignore it by not storing it
-        _consecutiveBits = 0; // Reset counter for the stuff bit itself
-        _lastBit = !currentBit; // Assume stuff bit is opposite
-        return CAN_READ_NO_MSG;
-      }
+  // An edge happened somewhere since the previous poll; take the midpoint so
+  // the polling interval does not bias the grid late.
+  bool edge = (_rxLevel == HIGH && level == LOW);
+  uint32_t edgeAt = _lastPoll + (now - _lastPoll) / 2;
+  _lastPoll = now;
+  _rxLevel = level;
 
-      _lastBit = currentBit;
-      _rxBuffer[_rxBitCount++] = currentBit;
-
-      // Check for EOF (7 consecutive recessive bits)
-      if (currentBit == HIGH && _consecutiveBits >= 7) {
-        _rxState = RX_STATE_IDLE; // Frame finished
-
-        // --- DECODE FRAME ---
-        int bitIndex = 0;
-        frame.id = 0;
-        for (int i = 0; i < 11; i++) frame.id = (frame.id << 1) | _rxBuffer[bitIndex++];
-        bitIndex += 3; // Skip RTR, IDE, r0
-        frame.dlc = 0;
-        for (int i = 0; i < 4; i++) frame.dlc = (frame.dlc << 1) | _rxBuffer[bitIndex++];
-        if (frame.dlc > 8) frame.dlc = 8;
-        for (int i = 0; i < frame.dlc; i++) {
-          frame.data[i] = 0;
-          for (int j = 0; j < 8; j++) frame.data[i] = (frame.data[i] << 1) | _rxBuffer[bitIndex++];
-        }
-        uint16_t received_crc = 0;
-        for (int i = 0; i < 15; i++) received_crc = (received_crc << 1) | _rxBuffer[bitIndex++];
-
-        // --- VALIDATE CRC and SEND ACK ---
-        uint16_t calculated_crc = calculateCRC(_rxBuffer, bitIndex - 15);
-        if (calculated_crc == received_crc) {
-          // Send ACK
-          delayMicroseconds(_bitTimeUs); // Wait for ACK slot
-          digitalWrite(_txPin, LOW);
-          delayMicroseconds(_bitTimeUs);
-          digitalWrite(_txPin, HIGH);
-          handleSuccess(false, true);
-          return CAN_READ_MSG_OK;
+  // Idle for longer than a bit without being polled: nothing was sampled, so
+  // realign the grid instead of replaying every missed bit.
+  if (!_decoder.inFrame() && phase >= 2 * _bitTicks) {
+    _bitStart = now - phase % _bitTicks;
+    phase = now - _bitStart;
+    _sampled = phase >= _samplePointTicks;
+  }
+
+  CAN_Read_Status status = CAN_READ_NO_MSG;
+  bool sampleBeforeEdge = _lastSample;
+
+  // Finish the current bit first if its sample point has passed. If the
+  // edge came after the sample point, the bit keeps the level before it.
+  if (!_sampled && phase >= _samplePointTicks) {
+    _sampled = true;
+    bool afterSample = edge && (int32_t)(edgeAt - _bitStart - _samplePointTicks) >= 0;
+    noteLateness(phase - _samplePointTicks);
+    status = processBit(vote(afterSample ? HIGH : level), frame);
+    if (afterSample) sampleBeforeEdge = _lastSample;
+  }
+  if (phase >= _bitTicks) {
+    _bitStart += _bitTicks;
+    _sampled = false;
+    if (!_listenOnly) onBitBoundary(now);
+  }
+
+  // Synchronization on recessive-to-dominant edges. Within a frame only an
+  // edge after a recessive sample counts, so a spike on a dominant bit does
+  // not move the grid.
+  if (edge && (!_decoder.inFrame() || sampleBeforeEdge == HIGH)) {
+    int32_t edgePhase = (int32_t)(edgeAt - _bitStart);
+    if (!_decoder.inFrame()) {
+      // Hard synchronization: the edge starts a bit (normally SOF)
+      _bitStart = edgeAt;
+      _rxStartCycles = edgeAt;
+      _sampled = false;
+      _votesHigh = 0;
+      _votesTaken = 0;
+    } else if (edgePhase < 0) {
+      // Edge early, still in PHASE_SEG2 of the previous bit: shorten it
+      uint32_t early = (uint32_t)-edgePhase;
+      _bitStart -= early < _sjwTicks ? early : _sjwTicks;
+    } else if ((uint32_t)edgePhase < _samplePointTicks) {
+      // Edge late: lengthen PHASE_SEG1 by at most SJW
+      uint32_t late = (uint32_t)edgePhase;
+      _bitStart += late < _sjwTicks ? late : _sjwTicks;
+    } else if ((uint32_t)edgePhase < _bitTicks) {
+      // Edge after the sample point, early for the next bit
+      uint32_t early = _bitTicks - (uint32_t)edgePhase;
+      _bitStart -= early < _sjwTicks ? early : _sjwTicks;
+    }
+  }
+
+  phase = now - _bitStart;
+  if (!_sampled && _tripleSampling) {
+    // Early reads at SP - 2 * spacing and SP - spacing
+    while (_votesTaken < 2 && phase + (2 - _votesTaken) * _voteSpacingTicks >= _samplePointTicks &&
+           phase < _samplePointTicks) {
+      _votesHigh += level;
+      _votesTaken++;
+    }
+  }
+  if (!_sampled && phase >= _samplePointTicks && phase < _bitTicks) {
+    _sampled = true;
+    noteLateness(phase - _samplePointTicks);
+    if (status == CAN_READ_NO_MSG) status = processBit(vote(level), frame);
+  }
+  return status;
+}
+
+// Drives the TX pin at a bit boundary. A dominant level we drive ourselves
+// must not count as a resynchronization edge, so the edge detector is told
+// the bus is already low.
+void ESP_CAN::driveBit(bool bit) {
+  writeTx(bit);
+  if (!bit) _rxLevel = LOW;
+}
+
+// Called once per bit, right after the grid moves to the next bit.
+void ESP_CAN::onBitBoundary(uint32_t now) {
+  // The ACK is driven for exactly the bit after the CRC delimiter
+  if (_ackState == ACK_PENDING) {
+    driveBit(LOW);
+    _ackState = ACK_DRIVING;
+  } else if (_ackState == ACK_DRIVING) {
+    driveBit(HIGH);
+    _ackState = ACK_IDLE;
+  }
+
+  if (transmitting()) {
+    if (_txIndex < _txBits->length) _txIndex++;
+    // Past the CRC everything we send is recessive, apart from a self-ACK
+    driveBit(_txIndex < _txBits->length ? _txBits->bit(_txIndex) : _ackState != ACK_DRIVING);
+  } else if (_decoder.isIdle() && _idleBits >= idleBitsBeforeSof()) {
+    beginNextTransmission(now);
+  }
+}
+
+// Starts whatever is due: remote-frame responses go ahead of a waiting
+// frame.
+void ESP_CAN::beginNextTransmission(uint32_t sof) {
+  if (_responsesPending) {
+    int8_t i = 0;
+    while (!(_responsesPending & (1 << i))) i++;
+    _responding = i;
+    beginTransmission(_responses[i]->waveform, sof);
+  } else if (_txState == CAN_TX_WAITING) {
+    // Stale data is dropped before it takes up bus time
+    if (can_tx_expired(_txPolicy)) {
+      _txState = CAN_TX_EXPIRED;
+      deadlineMisses++;
+      return;
+    }
+    _txAttempts++;
+    _txState = CAN_TX_SENDING;
+    beginTransmission(_txWave, sof);
+  }
+}
+
+void ESP_CAN::beginTransmission(const CAN_Waveform &wave, uint32_t now) {
+  _txBits = &wave;
+  _txIndex = 0;
+  _ownFrame = true;
+  _txStartCycles = now;
+  driveBit(wave.bit(0)); // SOF
+}
+
+bool ESP_CAN::startFrame(const CAN_Frame &frame, const CAN_TxPolicy &policy) {
+  if (state == CAN_STATE_BUS_OFF || _listenOnly) return false;
+  if (_txState == CAN_TX_WAITING || _txState == CAN_TX_SENDING) return false;
+  if (_waveCache) return startWaveform(_waveCache->encode(frame), policy);
+  return startWaveform(can_encode_waveform(frame), policy);
+}
+
+bool ESP_CAN::startPrecomputed(const CAN_PrecomputedFrame &frame, const CAN_TxPolicy &policy) {
+  if (state == CAN_STATE_BUS_OFF || _listenOnly) return false;
+  if (_txState == CAN_TX_WAITING || _txState == CAN_TX_SENDING) return false;
+  return startWaveform(frame.waveform, policy);
+}
+
+bool ESP_CAN::startWaveform(const CAN_Waveform &wave, const CAN_TxPolicy &policy) {
+  if (can_tx_expired(policy)) {
+    _txState = CAN_TX_EXPIRED;
+    deadlineMisses++;
+    return false;
+  }
+  _txWave = wave;
+  _txPolicy = policy;
+  _txAttempts = 0;
+  _txState = CAN_TX_WAITING;
+  return true;
+}
+
+bool ESP_CAN::setRemoteResponse(const CAN_PrecomputedFrame &response) {
+  if (can_is_remote(response.frame)) return false;
+  uint8_t i = 0;
+  while (i < _responseCount && (_responses[i]->frame.id & 0x7FF) != (response.frame.id & 0x7FF)) i++;
+  if (i == CAN_REMOTE_RESPONSES) return false;
+  _responses[i] = &response;
+  if (i == _responseCount) _responseCount++;
+  return true;
+}
+
+void ESP_CAN::clearRemoteResponses() {
+  _responseCount = 0;
+  _responsesPending = 0;
+}
+
+// Ends the current attempt. A failed one waits for the bus again if the
+// policy has attempts left; the deadline is checked when it would start.
+// A remote response only waits again after a lost arbitration.
+void ESP_CAN::endTransmission(CAN_Tx_State result) {
+  driveBit(HIGH);
+  if (_responding >= 0) {
+    if (result != CAN_TX_ARBITRATION_LOST) _responsesPending &= ~(1 << _responding);
+    if (result == CAN_TX_DONE) remoteResponses++;
+    _responding = -1;
+    return;
+  }
+  if (result != CAN_TX_DONE && (_txPolicy.attempts == 0 || _txAttempts < _txPolicy.attempts)) {
+    _txState = CAN_TX_WAITING;
+    txRetries++;
+    return;
+  }
+  _txState = result;
+}
+
+// Drops the frame handed to startFrame() and any due remote responses.
+void ESP_CAN::abortTransmission() {
+  _ackState = ACK_IDLE;
+  if (_txState == CAN_TX_WAITING || _txState == CAN_TX_SENDING) _txState = CAN_TX_ERROR;
+  _responsesPending = 0;
+  _responding = -1;
+  _ownFrame = false;
+}
+
+// The decoded frame, with CAN_RTR_FLAG if it is a remote frame.
+void ESP_CAN::takeFrame(CAN_Frame &frame) {
+  frame = _decoder.frame();
+  if (_decoder.isRemote()) frame.id |= CAN_RTR_FLAG;
+}
+
+// Feeds one sampled bit to the decoder and acts on the result.
+CAN_Read_Status ESP_CAN::processBit(bool bit, CAN_Frame &frame) {
+  if (_listenOnly) return processBitSilent(bit, frame);
+  _lastSample = bit;
+
+  // Own frame: the bus must carry what we drive. Reading dominant for a
+  // recessive arbitration bit means a higher-priority frame won; any other
+  // mismatch is a bit error.
+  if (transmitting() && _txIndex < _txBits->length && _txBits->bit(_txIndex) != bit) {
+    if (_txBits->bit(_txIndex) == HIGH && _txIndex < _txBits->arbitrationEnd) {
+      _ownFrame = false;
+      endTransmission(CAN_TX_ARBITRATION_LOST);
+    } else {
+      endTransmission(CAN_TX_ERROR);
+      errors.bit++;
+      handleError(true, false);
+    }
+  }
+
+  // Recessive bits before this one; the third intermission bit counts as
+  // the first idle bit for a start of frame.
+  bool maySend = _idleBits + 1 >= idleBitsBeforeSof();
+  CAN_Decode_Event event = _decoder.feed(bit);
+  countEvent(event);
+  if (!_decoder.inFrame() && bit) {
+    if (_idleBits < 255) _idleBits++;
+  } else {
+    _idleBits = 0;
+  }
+
+  switch (event) {
+    case CAN_DECODE_SOF:
+      // Another node started first. A node with a frame due takes that
+      // start of frame as its own and sends its identifier from the next
+      // bit on, so the frames meet in arbitration and the lower ID wins.
+      if (maySend && !transmitting()) beginNextTransmission(_rxStartCycles);
+      break;
+
+    case CAN_DECODE_ACK_SLOT:
+      // Nobody acknowledges their own frame, except in loopback
+      if (!_ownFrame || _loopback != CAN_LOOPBACK_OFF) _ackState = ACK_PENDING;
+      break;
+
+    case CAN_DECODE_FRAME_OK:
+      if (_ownFrame) {
+        _ownFrame = false;
+        if (!transmitting()) break;
+        if (_decoder.acknowledged()) {
+          endTransmission(CAN_TX_DONE);
+          handleSuccess(true, false);
+          if (_loopback != CAN_LOOPBACK_OFF) {
+            takeFrame(frame);
+            return CAN_READ_MSG_OK;
+          }
         } else {
-          handleError(false, true);
-          return CAN_READ_ERROR;
+          endTransmission(CAN_TX_ERROR);
+          errors.ack++;
+          // Same error-passive ACK exception as sendFrame()
+          if (state != CAN_STATE_ERROR_PASSIVE) handleError(true, false);
+        }
+        break;
+      }
+      handleSuccess(false, true);
+      // Extended frames are acknowledged but not reported
+      if (_decoder.isExtended()) break;
+      if (_decoder.isRemote()) {
+        for (uint8_t i = 0; i < _responseCount; i++) {
+          if ((_responses[i]->frame.id & 0x7FF) == _decoder.frame().id) _responsesPending |= 1 << i;
         }
       }
+      takeFrame(frame);
+      return CAN_READ_MSG_OK;
+
+    case CAN_DECODE_ERROR:
+      if (_ownFrame) {
+        // Counted against the TEC, not as a receive error
+        _ownFrame = false;
+        if (transmitting()) {
+          endTransmission(CAN_TX_ERROR);
+          handleError(true, false);
+        }
+        break;
+      }
+      handleError(false, true);
+      return CAN_READ_ERROR;
+
+    default:
       break;
   }
   return CAN_READ_NO_MSG;
 }
 
-// --- UTILITY ---
-uint16_t ESP_CAN::calculateCRC(const bool bits[], int len) {
-    uint16_t crc_reg = 0x0000;
-    for (int i = 0; i < len; i++) {
-        bool do_xor = ( (crc_reg & 0x4000) >> 14 ) ^ bits[i];
-        crc_reg <<= 1;
-        if (do_xor) {
-            crc_reg ^= 0x4599;
-        }
-    }
-    return crc_reg & 0x7FFF;
+// Listen-only counterpart of processBit(): decode and report, nothing else.
+CAN_Read_Status ESP_CAN::processBitSilent(bool bit, CAN_Frame &frame) {
+  _lastSample = bit;
+  CAN_Decode_Event event = _decoder.feed(bit);
+  countEvent(event);
+  switch (event) {
+    case CAN_DECODE_FRAME_OK:
+      if (_decoder.isExtended()) break;
+      takeFrame(frame);
+      return CAN_READ_MSG_OK;
+
+    case CAN_DECODE_ERROR:
+      return CAN_READ_ERROR;
+
+    default:
+      break;
+  }
+  return CAN_READ_NO_MSG;
 }
@@ -2,8 +2,9 @@
 * ESP_CAN.h - An enhanced bit-banging CAN library for the ESP32 family.
  *
  * This library is for educational and experimental purposes. It implements
- * CRC calculation and ACK checking but lacks full bus arbitration and
- * error state handling.
+ * CRC calculation, ACK checking, bus arbitration and the ISO 11898-1 error
+ * counters with error-passive and bus-off states. It does not send error
+ * or overload flags of its own.
  *
  * Author: Lukas Flad
  * Date: 2025
@@ -13,6 +14,11 @@
 #define ESP_CAN_H
 
 #include <Arduino.h>
+#include "ESP_CAN_Frame.h"
+#include "ESP_CAN_BitTiming.h"
+#include "ESP_CAN_Decoder.h"
+#include "ESP_CAN_Waveform.h"
+#include "ESP_CAN_WaveformCache.h"
 
 // Represents the operational state of the CAN node
 enum CAN_State {
@@ -21,6 +27,22 @@ enum CAN_State {
   CAN_STATE_BUS_OFF
 };
 
+// Errors by class, plus error and overload frames seen on the bus. Unlike
+// tec and rec these only count up; assign {} to clear them.
+struct CAN_ErrorCounts {
+  uint32_t bit;             // Own bit read back at the other level, outside arbitration
+  uint32_t stuff;           // Six equal bits, which includes error flags from other nodes
+  uint32_t crc;
+  uint32_t form;            // Dominant bit in a fixed recessive field
+  uint32_t ack;             // Own frame not acknowledged
+  uint32_t errorFrames;     // Error flags and delimiters, from any node
+  uint32_t overloadFrames;
+};
+
+// Called on every fault-confinement state change, e.g. entering bus-off or
+// completing recovery. Runs from sendFrame() or readFrame().
+typedef void (*CAN_StateCallback)(CAN_State previous, CAN_State current, void *arg);
+
 // Represents the result of a read operation
 enum CAN_Read_Status {
   CAN_READ_NO_MSG,
@@ -28,55 +50,277 @@ enum CAN_Read_Status {
   CAN_READ_ERROR
 };
 
-// Struct to hold CAN frame data
-struct CAN_Frame {
-  uint32_t id;      // 11-bit CAN Identifier
-  uint8_t dlc;      // Data Length Code (0-8)
-  uint8_t data[8];  // Data payload
+// Progress of a frame handed to startFrame()
+enum CAN_Tx_State {
+  CAN_TX_IDLE,              // Nothing started yet
+  CAN_TX_WAITING,           // Waiting for the bus to become idle
+  CAN_TX_SENDING,           // On the bus
+  CAN_TX_DONE,              // Sent and acknowledged
+  CAN_TX_ARBITRATION_LOST,  // A higher-priority frame won; it is received instead
+  CAN_TX_ERROR,             // Bit error, no ACK, or bus-off
+  CAN_TX_EXPIRED            // Deadline passed before the frame could start; never sent
+};
+
+// Retransmission policy of a frame handed to startFrame(). Every start on
+// the bus is an attempt, including those lost in arbitration. A frame still
+// waiting for the bus at its deadline is dropped without using bus time.
+struct CAN_TxPolicy {
+  uint8_t attempts;     // Most attempts, 0 for no limit
+  bool hasDeadline;
+  uint32_t deadlineUs;  // micros() after which the frame is stale
+};
+
+// No retransmission, the behaviour of a plain startFrame()
+inline CAN_TxPolicy can_tx_single_shot() {
+  CAN_TxPolicy policy = {1, false, 0};
+  return policy;
+}
+
+// The first attempt and up to `retries` more
+inline CAN_TxPolicy can_tx_retries(uint8_t retries) {
+  CAN_TxPolicy policy = {(uint8_t)(retries < 254 ? retries + 1 : 255), false, 0};
+  return policy;
+}
+
+// Retries until micros() passes deadlineUs, e.g. micros() + 2000
+inline CAN_TxPolicy can_tx_until(uint32_t deadlineUs) {
+  CAN_TxPolicy policy = {0, true, deadlineUs};
+  return policy;
+}
+
+inline bool can_tx_expired(const CAN_TxPolicy &policy) {
+  return policy.hasDeadline && (int32_t)(micros() - policy.deadlineUs) > 0;
+}
+
+#define CAN_REMOTE_RESPONSES 8  // Entries in the remote-frame response table, at most 8
+
+// Self-test modes set with setLoopback()
+enum CAN_Loopback_Mode {
+  CAN_LOOPBACK_OFF,
+  CAN_LOOPBACK_INTERNAL,  // TX feeds the receiver directly; the pins are not used
+  CAN_LOOPBACK_EXTERNAL   // TX and RX are wired together (or via a transceiver)
 };
 
 class ESP_CAN {
 public:
   // Publicly accessible error counters and state
-  uint8_t tec;      // Transmit Error Counter
-  uint8_t rec;      // Receive Error Counter
+  uint16_t tec;     // Transmit Error Counter, bus-off above 255
+  uint16_t rec;     // Receive Error Counter, error passive above 127
   CAN_State state;
+  uint32_t votesCorrected; // Bits where triple sampling outvoted a disagreeing read
+  uint32_t maxSampleLateness; // Worst delay from sample point to the sampling poll, in CPU cycles
+  CAN_ErrorCounts errors;
+  uint32_t txRetries;       // Automatic retransmissions under a CAN_TxPolicy
+  uint32_t deadlineMisses;  // Frames dropped as CAN_TX_EXPIRED
+  uint32_t remoteResponses; // Remote frames answered from the response table
 
   // Constructor
   ESP_CAN(int rxPin, int txPin);
 
-  // Initialization
-  void begin(long baudrate);
+  // Initialization. The baud rate form solves for time quanta with the
+  // given sample point; the CAN_BitTiming form uses explicit segments.
+  // Timing runs on the CPU cycle counter, so keep the CPU frequency fixed.
+  void begin(long baudrate, float samplePoint = 0.875);
+  void begin(const CAN_BitTiming &timing);
+  const CAN_BitTiming &bitTiming() const { return _timing; }
+
+  // Triple sampling: each bit is read at SP - 2 * spacing, SP - spacing and
+  // the sample point, and the majority wins, so a single spike cannot flip
+  // a bit. Meant for noisy low-speed buses; readFrame() must be polled at
+  // least once per spacing or the missed reads fall back to the SP read.
+  void setTripleSampling(bool enable, uint8_t spacingTq = 1);
+  bool tripleSampling() const { return _tripleSampling; }
+
+  // Listen-only (bus monitoring) mode: the TX pin is never driven, so no
+  // ACK, no transmission and no effect on the bus. The error counters are
+  // left alone and per-bit work is cut down to sampling and decoding.
+  // Enable it before begin() to leave the TX pin unconfigured altogether.
+  // sendFrame() and startFrame() return false while it is on.
+  void setListenOnly(bool enable);
+  bool listenOnly() const { return _listenOnly; }
+
+  // Loopback: the node acknowledges its own frames, and readFrame() returns
+  // every frame it sent, so one node can test itself without another node
+  // on the bus. INTERNAL also disconnects the pins. It runs the full encode,
+  // bit timing and decode path, so it works as a host benchmark too.
+  void setLoopback(CAN_Loopback_Mode mode);
+  CAN_Loopback_Mode loopback() const { return _loopback; }
 
   // Sending and Receiving (now non-blocking)
   bool sendFrame(CAN_Frame &frame);
   CAN_Read_Status readFrame(CAN_Frame &frame);
 
+  // readFrame() for a caller that reads the RX level itself: `level` must
+  // have been read at cycle count `now`. ESP_CAN_MultiBus uses this to share
+  // one GPIO register read between several buses.
+  CAN_Read_Status pollLevel(uint32_t now, bool level, CAN_Frame &frame);
+
+  // Non-blocking transmit driven by readFrame()/pollLevel(). The frame starts
+  // at a bit boundary once the bus has been idle for the intermission (plus
+  // the suspend time when error passive). Each bit is checked against the
+  // bus at the sample point, so the other polled buses keep running while
+  // it is sent. Returns false while a frame is waiting or being sent, when
+  // bus-off, or when the deadline has already passed. A lost arbitration or
+  // an error restarts the frame as `policy` allows; check txState() for the
+  // final outcome.
+  bool startFrame(const CAN_Frame &frame, const CAN_TxPolicy &policy = can_tx_single_shot());
+
+  // sendFrame()/startFrame() for a frame encoded ahead of time, usually at
+  // compile time (see ESP_CAN_Waveform.h): the stored bits are clocked out
+  // without building the bit sequence, CRC or stuffing.
+  bool sendPrecomputed(const CAN_PrecomputedFrame &frame);
+  bool startPrecomputed(const CAN_PrecomputedFrame &frame, const CAN_TxPolicy &policy = can_tx_single_shot());
+
+  // Lets sendFrame()/startFrame() reuse the encoding of frames they sent
+  // before (see ESP_CAN_WaveformCache.h). NULL turns caching off.
+  void setWaveformCache(CAN_WaveformCacheBase *cache) { _waveCache = cache; }
+  CAN_Tx_State txState() const { return _txState; }
+
+  // Remote frames carry CAN_RTR_FLAG in their ID, both when sent and when
+  // returned by readFrame(). setRemoteResponse() answers the remote frames
+  // for response.frame.id without the application: readFrame() sends the
+  // stored waveform at the first bit after the request's intermission,
+  // ahead of a frame waiting in startFrame(). A response that loses
+  // arbitration is retried; one that fails is dropped, as the requester
+  // can ask again. `response` is not copied, so it must stay valid, e.g. a
+  // constexpr can_precompute() result in flash. Registering an ID again
+  // replaces its response. Returns false if the table is full or
+  // `response` is itself a remote frame. With ESP_CAN_Engine, call before
+  // start().
+  bool setRemoteResponse(const CAN_PrecomputedFrame &response);
+  void clearRemoteResponses();
+  uint32_t txStartCycles() const { return _txStartCycles; }  // Cycle count of our last SOF
+
+  // Cycle count of the start of frame of the frame being received or last
+  // received, taken from the hard synchronization edge
+  uint32_t rxStartCycles() const { return _rxStartCycles; }
+
+  int rxPin() const { return _rxPin; }
+  int txPin() const { return _txPin; }
+
+  // True while a received frame is in progress.
+  bool receiving() const { return _decoder.inFrame(); }
+  // True once the bus has been idle for the intermission and no remote
+  // response is due; sendFrame() should only be started when this is true.
+  bool busIdle() const { return _decoder.isIdle() && _responsesPending == 0; }
+
+  // Fault confinement. In bus-off the node leaves the bus and readFrame()
+  // counts 128 occurrences of 11 recessive bits before it rejoins with both
+  // counters cleared. With auto-recover (the default) counting starts at once;
+  // otherwise it waits for recover(). Keep calling readFrame() while bus-off.
+  void onStateChange(CAN_StateCallback callback, void *arg = NULL);
+  void setAutoRecover(bool enable);
+  bool recover();  // Returns false if the node is not bus-off
+  uint8_t recoveryProgress() const { return _recoverySequences; }  // 0..128
+
+  // Queues a frame that the next readFrame() call returns as if it had been
+  // received from the bus. Returns false if the queue is full.
+  bool injectFrame(const CAN_Frame &frame);
+
 private:
   int _rxPin;
   int _txPin;
-  int _bitTimeUs;
-  unsigned long _lastSampleTime;
 
-  // Non-blocking read state machine variables
-  enum RxState { RX_STATE_IDLE, RX_STATE_SOF, RX_STATE_FRAME };
-  RxState _rxState;
-  bool _rxBuffer[128];
-  int _rxBitCount;
-  int _consecutiveBits;
-  bool _lastBit;
+  // Bit timing in CPU cycles, derived from _timing
+  CAN_BitTiming _timing;
+  uint32_t _bitTicks;
+  uint32_t _samplePointTicks;
+  uint32_t _sjwTicks;
 
-  // Low-level bit functions
-  bool sendBit(bool bit, bool checkArbitration);
-  bool readBit();
+  // Non-blocking receiver: bit grid and decoder
+  CAN_BitDecoder _decoder;
+  uint32_t _bitStart;    // Cycle count at which the current bit started
+  bool _sampled;         // Current bit already sampled
+  bool _rxLevel;         // Level seen by the previous poll, for edge detection
+  uint32_t _lastPoll;    // Cycle count of the previous poll
+  bool _lastSample;      // Level of the last sampled bit
+  uint32_t _rxStartCycles;
+  bool _listenOnly;
+  bool _txConfigured;    // TX pin set up as an output by configureTx()
+  CAN_Loopback_Mode _loopback;
+  bool _loopLevel;       // Bus level in internal loopback
+  enum AckState { ACK_IDLE, ACK_PENDING, ACK_DRIVING };
+  AckState _ackState;
+  uint8_t _idleBits;     // Recessive bits sampled since the bus became idle
+
+  // Non-blocking transmitter
+  volatile CAN_Tx_State _txState;
+  CAN_Waveform _txWave;
+  CAN_WaveformCacheBase *_waveCache;
+  CAN_TxPolicy _txPolicy;
+  uint8_t _txAttempts;   // Attempts started for the current frame
+  uint8_t _txIndex;      // Bit being driven
+  const CAN_Waveform *_txBits;  // Waveform on the bus: _txWave or a response
+  bool _ownFrame;        // The decoder is receiving our own frame
+  uint32_t _txStartCycles;
+
+  // Remote-frame response table. Bit i of _responsesPending: entry i was
+  // requested and is not sent yet.
+  const CAN_PrecomputedFrame *_responses[CAN_REMOTE_RESPONSES];
+  uint8_t _responseCount;
+  uint8_t _responsesPending;
+  int8_t _responding;    // Entry on the bus, or -1
 
-  // CRC-15-CAN Calculation
-  uint16_t calculateCRC(const bool bits[], int len);
+  // Triple sampling
+  bool _tripleSampling;
+  uint8_t _voteSpacingTq;
+  uint32_t _voteSpacingTicks;
+  uint8_t _votesHigh;    // Early reads of the current bit that were recessive
+  uint8_t _votesTaken;   // Early reads taken for the current bit (0..2)
+
+  // Fault confinement
+  CAN_StateCallback _stateCallback;
+  void *_stateCallbackArg;
+  bool _autoRecover;
+  bool _recovering;
+  uint8_t _recoverySequences;
+  uint32_t _recessiveSince;
+
+  // Frames queued by injectFrame()
+  static const int INJECT_QUEUE_SIZE = 8;
+  CAN_Frame _injectQueue[INJECT_QUEUE_SIZE];
+  uint8_t _injectHead;
+  uint8_t _injectCount;
+
+  // Low-level bit functions
+  static uint32_t ticks() { return ESP.getCycleCount(); }
+  void writeTx(bool level) {
+    if (_loopback == CAN_LOOPBACK_INTERNAL) _loopLevel = level;
+    else digitalWrite(_txPin, level);
+  }
+  bool readRx() const { return _loopback == CAN_LOOPBACK_INTERNAL ? _loopLevel : digitalRead(_rxPin); }
+  static void waitUntil(uint32_t deadline);
+  bool transmitBit(bool bit, uint32_t &bitStart);
+  bool transmitWaveform(const CAN_Waveform &wave, const CAN_Frame &frame);
+  bool startWaveform(const CAN_Waveform &wave, const CAN_TxPolicy &policy);
+  bool vote(bool level);
+  void noteLateness(uint32_t lateness) {
+    if (lateness > maxSampleLateness) maxSampleLateness = lateness;
+  }
+  CAN_Read_Status processBit(bool bit, CAN_Frame &frame);
+  CAN_Read_Status processBitSilent(bool bit, CAN_Frame &frame);
+  void driveBit(bool bit);
+  void onBitBoundary(uint32_t now);
+  bool transmitting() const { return _txState == CAN_TX_SENDING || _responding >= 0; }
+  void beginTransmission(const CAN_Waveform &wave, uint32_t now);
+  void beginNextTransmission(uint32_t sof);
+  // Recessive bits a frame waits for after EOF: the intermission, plus the
+  // suspend transmission time of an error-passive node
+  uint8_t idleBitsBeforeSof() const { return state == CAN_STATE_ERROR_PASSIVE ? 3 + 8 : 3; }
+  void endTransmission(CAN_Tx_State result);
+  void abortTransmission();
+  void takeFrame(CAN_Frame &frame);
+  void resyncReceiver();
+  void configureTx();
+  CAN_Read_Status stepReceiver(uint32_t now, bool level, CAN_Frame &frame);
 
   // Error handling
+  void countEvent(CAN_Decode_Event event);
   void handleError(bool isTxError, bool isRxError);
   void handleSuccess(bool isTxSuccess, bool isRxSuccess);
   void updateState();
+  void setState(CAN_State newState);
+  void pollRecovery(uint32_t now, bool level);
 };
 
 #endif // ESP_CAN_H
@@ -0,0 +1,89 @@
+/*
+ * ESP_CAN_AutoBaud.cpp - Implementation of edge-timing baud-rate detection.
+ */
+
+#include "ESP_CAN_AutoBaud.h"
+
+ESP_CAN_AutoBaud::ESP_CAN_AutoBaud(ESP_CAN &can, int rxPin) : _can(can) {
+  _rxPin = rxPin;
+  _baudrate = 0;
+  _edgeHead = 0;
+  _edgeTail = 0;
+  _analyzedHead = 0;
+  _count = 0;
+  framesValidated = 0;
+  estimatesRejected = 0;
+}
+
+void ESP_CAN_AutoBaud::begin() {
+  _baudrate = 0;
+  _edgeHead = 0;
+  _edgeTail = 0;
+  _analyzedHead = 0;
+  _count = 0;
+  pinMode(_rxPin, INPUT_PULLUP);
+  attachInterruptArg(digitalPinToInterrupt(_rxPin), onEdge, this, CHANGE);
+}
+
+void ESP_CAN_AutoBaud::end() {
+  detachInterrupt(digitalPinToInterrupt(_rxPin));
+}
+
+void IRAM_ATTR ESP_CAN_AutoBaud::onEdge(void *arg) {
+  ESP_CAN_AutoBaud *self = (ESP_CAN_AutoBaud *)arg;
+  uint32_t now = ESP.getCycleCount();
+  uint32_t head = self->_edgeHead;
+  self->_edgeTime[head % CAN_AUTOBAUD_EDGES] = now;
+  self->_edgeLevel[head % CAN_AUTOBAUD_EDGES] = digitalRead(self->_rxPin);
+  self->_edgeHead = head + 1;
+}
+
+long ESP_CAN_AutoBaud::poll() {
+  if (_baudrate != 0) return _baudrate;
+
+  // Move new edges from the ISR ring into the analysis window
+  uint32_t head = _edgeHead;
+  if (head - _edgeTail > CAN_AUTOBAUD_EDGES) _edgeTail = head - CAN_AUTOBAUD_EDGES; // Overrun, keep newest
+  while (_edgeTail != head) {
+    if (_count == WINDOW) dropOldest(WINDOW / 2);
+    _time[_count] = _edgeTime[_edgeTail % CAN_AUTOBAUD_EDGES];
+    _level[_count] = _edgeLevel[_edgeTail % CAN_AUTOBAUD_EDGES];
+    _count++;
+    _edgeTail++;
+  }
+  if (_count < 64 || head == _analyzedHead) return 0;
+  _analyzedHead = head;
+
+  CAN_BaudEstimate estimate =
+      can_estimate_baudrate(_time, _level, _count, ESP.getCpuFreqMHz() * 1000000, CAN_AUTOBAUD_FRAMES);
+  if (estimate.status == CAN_BAUD_NEED_MORE) return 0;
+  if (estimate.status == CAN_BAUD_INCONSISTENT) {
+    estimatesRejected++;
+    dropOldest(_count / 2);
+    return 0;
+  }
+
+  framesValidated = estimate.frames;
+  if (estimate.status != CAN_BAUD_FOUND) {
+    if (_count == WINDOW) {
+      estimatesRejected++;
+      dropOldest(WINDOW / 2);
+    }
+    return 0;
+  }
+
+  end();
+  _baudrate = estimate.baudrate;
+  _can.begin(_baudrate);
+  return _baudrate;
+}
+
+void ESP_CAN_AutoBaud::dropOldest(int n) {
+  if (n >= _count) {
+    _count = 0;
+    return;
+  }
+  memmove(_time, _time + n, (_count - n) * sizeof(_time[0]));
+  memmove(_level, _level + n, (_count - n) * sizeof(_level[0]));
+  _count -= n;
+}
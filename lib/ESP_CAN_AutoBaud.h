@@ -0,0 +1,64 @@
+/*
+ * ESP_CAN_AutoBaud.h - Listen-only baud-rate detection from RX edge timing.
+ *
+ * An edge interrupt on the RX pin timestamps every level change with the
+ * CPU cycle counter. poll() estimates the bit time from the shortest
+ * pulse, refines it to the best common divisor of all in-frame pulse
+ * widths, and then validates it by decoding the captured edges with
+ * CAN_BitDecoder (see ESP_CAN_BaudEstimate.h). Only when
+ * CAN_AUTOBAUD_FRAMES frames pass the CRC check is the rate committed
+ * with ESP_CAN::begin(). The TX pin is never driven while detecting, so
+ * the node neither ACKs nor disturbs the bus.
+ */
+
+#ifndef ESP_CAN_AUTOBAUD_H
+#define ESP_CAN_AUTOBAUD_H
+
+#include <Arduino.h>
+#include "ESP_CAN.h"
+#include "ESP_CAN_BaudEstimate.h"
+
+#define CAN_AUTOBAUD_EDGES 1024  // Edge ring size, a power of two
+#define CAN_AUTOBAUD_FRAMES 2    // CRC-valid frames required before committing
+
+class ESP_CAN_AutoBaud {
+public:
+  uint32_t framesValidated;   // CRC-valid frames seen with the current estimate
+  uint32_t estimatesRejected; // Estimates that failed validation
+
+  ESP_CAN_AutoBaud(ESP_CAN &can, int rxPin);
+
+  // Starts timestamping edges on the RX pin.
+  void begin();
+  // Stops edge capture without committing a rate.
+  void end();
+
+  // Non-blocking. Returns the detected baud rate once it has been validated
+  // and committed with ESP_CAN::begin(), or 0 while still listening.
+  long poll();
+
+  long baudrate() const { return _baudrate; }
+
+private:
+  ESP_CAN &_can;
+  int _rxPin;
+  long _baudrate;
+
+  // Written by the ISR only
+  volatile uint32_t _edgeTime[CAN_AUTOBAUD_EDGES];
+  volatile uint8_t _edgeLevel[CAN_AUTOBAUD_EDGES];
+  volatile uint32_t _edgeHead;
+  uint32_t _edgeTail;
+  uint32_t _analyzedHead;   // Edge count at the last analysis
+
+  // Analysis window, oldest edge first
+  static const int WINDOW = 512;  // Holds several worst-case frames
+  uint32_t _time[WINDOW];
+  uint8_t _level[WINDOW];
+  int _count;
+
+  static void IRAM_ATTR onEdge(void *arg);
+  void dropOldest(int n);
+};
+
+#endif // ESP_CAN_AUTOBAUD_H
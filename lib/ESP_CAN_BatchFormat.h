@@ -0,0 +1,88 @@
+/*
+ * ESP_CAN_BatchFormat.h - Wire format of the SLCAN bridge's binary batch mode.
+ *
+ * Shared by the firmware (ESP_CAN_SLCAN) and the host-side decoder in
+ * tools/slcan_decode, so it only depends on <stdint.h>/<stddef.h>.
+ *
+ * A batch is one CAN_BatchHeader followed by `count` fixed-size
+ * CAN_BatchRecord entries, COBS-encoded and terminated by a 0x00 byte. The
+ * delimiter never appears inside an encoded batch, so a host can resync on
+ * the next 0x00 after line noise or a partial read. All fields are little
+ * endian, which is the native order on both the ESP32 and x86/ARM hosts.
+ */
+
+#ifndef ESP_CAN_BATCH_FORMAT_H
+#define ESP_CAN_BATCH_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CAN_BATCH_MAGIC 0xCB
+#define CAN_BATCH_MAX_RECORDS 32
+
+// Record flags
+#define CAN_BATCH_FLAG_ERROR 0x01  // Frame failed validation (id/data unreliable)
+#define CAN_BATCH_FLAG_REMOTE 0x02 // Remote frame (RTR): dlc is the length requested, no data
+
+struct CAN_BatchHeader {
+  uint8_t magic;      // CAN_BATCH_MAGIC
+  uint8_t count;      // Number of records that follow (1..CAN_BATCH_MAX_RECORDS)
+  uint16_t sequence;  // Incremented per batch; gaps mean batches were lost
+  uint32_t dropped;   // Running total of frames the bridge could not queue
+};
+
+struct CAN_BatchRecord {
+  uint32_t timestampUs;  // micros() when the frame was read
+  uint16_t id;           // 11-bit identifier
+  uint8_t dlc;
+  uint8_t flags;         // CAN_BATCH_FLAG_*
+  uint8_t data[8];
+};
+
+static_assert(sizeof(CAN_BatchHeader) == 8, "CAN_BatchHeader must stay 8 bytes");
+static_assert(sizeof(CAN_BatchRecord) == 16, "CAN_BatchRecord must stay 16 bytes");
+
+#define CAN_BATCH_MAX_PAYLOAD (sizeof(CAN_BatchHeader) + CAN_BATCH_MAX_RECORDS * sizeof(CAN_BatchRecord))
+// COBS adds one byte per started 254-byte block, plus the 0x00 delimiter.
+#define CAN_BATCH_MAX_ENCODED (CAN_BATCH_MAX_PAYLOAD + CAN_BATCH_MAX_PAYLOAD / 254 + 2)
+
+// COBS-encodes `len` bytes into `out` and appends the 0x00 delimiter.
+// Returns the number of bytes written, delimiter included.
+inline size_t can_cobs_encode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t codeIndex = 0;
+  size_t outIndex = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < len; i++) {
+    if (in[i] == 0) {
+      out[codeIndex] = code;
+      codeIndex = outIndex++;
+      code = 1;
+    } else {
+      out[outIndex++] = in[i];
+      if (++code == 0xFF) {
+        out[codeIndex] = code;
+        codeIndex = outIndex++;
+        code = 1;
+      }
+    }
+  }
+  out[codeIndex] = code;
+  out[outIndex++] = 0x00;
+  return outIndex;
+}
+
+// Decodes one COBS block (without its delimiter). `out` may alias `in`.
+// Returns the decoded length, or 0 if the block is malformed.
+inline size_t can_cobs_decode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t inIndex = 0;
+  size_t outIndex = 0;
+  while (inIndex < len) {
+    uint8_t code = in[inIndex++];
+    if (code == 0 || inIndex + code - 1 > len) return 0;
+    for (uint8_t i = 1; i < code; i++) out[outIndex++] = in[inIndex++];
+    if (code != 0xFF && inIndex < len) out[outIndex++] = 0;
+  }
+  return outIndex;
+}
+
+#endif // ESP_CAN_BATCH_FORMAT_H
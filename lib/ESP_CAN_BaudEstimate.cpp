@@ -0,0 +1,96 @@
+/*
+ * ESP_CAN_BaudEstimate.cpp - Implementation of edge-timing rate estimation.
+ */
+
+#include "ESP_CAN_BaudEstimate.h"
+#include "ESP_CAN_Decoder.h"
+
+static const long STANDARD_BAUDRATES[] = {10000, 20000, 50000, 83333, 100000, 125000, 250000, 500000, 800000, 1000000};
+
+// Pulses longer than this many bits are idle/EOF gaps, not in-frame pulses.
+// Stuffing limits in-frame runs to 5 bits; 6 allows for error flags.
+static const int MAX_FRAME_RUN = 6;
+
+float can_estimate_bit_ticks(const uint32_t time[], int count, uint32_t clockHz) {
+  // Pulses shorter than half a bit at 1 Mbit/s are glitches
+  uint32_t glitchTicks = clockHz / 2000000;
+  uint32_t minPulse = 0xFFFFFFFF;
+  for (int i = 0; i + 1 < count; i++) {
+    uint32_t width = time[i + 1] - time[i];
+    if (width >= glitchTicks && width < minPulse) minPulse = width;
+  }
+  if (minPulse == 0xFFFFFFFF) return -1;
+
+  // Refine: least-squares common divisor of the in-frame pulses. The first
+  // passes only trust short pulses, where an estimate that is a few percent
+  // off cannot round to the wrong bit count; the last pass uses them all.
+  static const int PASS_MAX_BITS[] = {1, 2, MAX_FRAME_RUN};
+  float bitTicks = minPulse;
+  for (int pass = 0; pass < 3; pass++) {
+    float sumWidth = 0;
+    int sumBits = 0;
+    int pulses = 0;
+    int outliers = 0;
+    for (int i = 0; i + 1 < count; i++) {
+      float width = time[i + 1] - time[i];
+      if (width < glitchTicks) continue;
+      int bits = (int)(width / bitTicks + 0.5f);
+      if (bits > PASS_MAX_BITS[pass]) continue;
+      pulses++;
+      float error = width - bits * bitTicks;
+      if (error < 0) error = -error;
+      if (error > bitTicks / 4) {
+        outliers++;
+        continue;
+      }
+      sumWidth += width;
+      sumBits += bits;
+    }
+    if (sumBits == 0) return 0;
+    if (pass == 2) {
+      if (pulses < 32) return -1;
+      if (outliers * 8 > pulses) return 0;
+    }
+    bitTicks = sumWidth / sumBits;
+  }
+  return bitTicks;
+}
+
+int can_validate_bit_ticks(const uint32_t time[], const uint8_t level[], int count, float bitTicks) {
+  CAN_BitDecoder decoder;
+  int frames = 0;
+  for (int i = 0; i + 1 < count; i++) {
+    int bits = (int)((time[i + 1] - time[i]) / bitTicks + 0.5f);
+    if (bits > 16) bits = 16; // Enough to reach bus idle
+    for (int b = 0; b < bits; b++) {
+      if (decoder.feed(level[i]) == CAN_DECODE_FRAME_OK) frames++;
+    }
+  }
+  return frames;
+}
+
+long can_snap_baudrate(float bitTicks, uint32_t clockHz) {
+  long measured = (long)(clockHz / bitTicks + 0.5f);
+  long rate = measured;
+  for (unsigned i = 0; i < sizeof(STANDARD_BAUDRATES) / sizeof(STANDARD_BAUDRATES[0]); i++) {
+    long delta = measured - STANDARD_BAUDRATES[i];
+    if (delta < 0) delta = -delta;
+    if (delta * 100 < STANDARD_BAUDRATES[i] * 3) rate = STANDARD_BAUDRATES[i];
+  }
+  return rate;
+}
+
+CAN_BaudEstimate can_estimate_baudrate(const uint32_t time[], const uint8_t level[], int count, uint32_t clockHz,
+                                       int framesRequired) {
+  CAN_BaudEstimate result = {CAN_BAUD_NEED_MORE, 0, 0, 0};
+  result.bitTicks = can_estimate_bit_ticks(time, count, clockHz);
+  if (result.bitTicks < 0) return result;
+  if (result.bitTicks == 0) {
+    result.status = CAN_BAUD_INCONSISTENT;
+    return result;
+  }
+  result.frames = can_validate_bit_ticks(time, level, count, result.bitTicks);
+  result.baudrate = can_snap_baudrate(result.bitTicks, clockHz);
+  result.status = result.frames >= framesRequired ? CAN_BAUD_FOUND : CAN_BAUD_UNCONFIRMED;
+  return result;
+}
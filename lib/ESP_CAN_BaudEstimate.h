@@ -0,0 +1,48 @@
+/*
+ * ESP_CAN_BaudEstimate.h - Bit-rate estimation from RX edge timestamps.
+ *
+ * The analysis behind ESP_CAN_AutoBaud, kept free of interrupts and pins so
+ * host tools can feed it synthesized edge streams (tools/baudcheck). The
+ * bit time is estimated from the shortest pulse, refined to the best common
+ * divisor of all in-frame pulse widths, and validated by decoding the edges
+ * with CAN_BitDecoder.
+ * Only depends on <stdint.h>.
+ */
+
+#ifndef ESP_CAN_BAUD_ESTIMATE_H
+#define ESP_CAN_BAUD_ESTIMATE_H
+
+#include <stdint.h>
+
+enum CAN_Baud_Status {
+  CAN_BAUD_NEED_MORE,     // Too few in-frame pulses to tell
+  CAN_BAUD_INCONSISTENT,  // The pulses fit no common bit time
+  CAN_BAUD_UNCONFIRMED,   // Bit time found, but too few CRC-valid frames yet
+  CAN_BAUD_FOUND          // Bit time confirmed by CRC-valid frames
+};
+
+struct CAN_BaudEstimate {
+  CAN_Baud_Status status;
+  float bitTicks;  // Estimated bit time in clock cycles
+  int frames;      // CRC-valid frames decoded with bitTicks
+  long baudrate;   // Measured rate, snapped to a standard rate within 3%
+};
+
+// Bit time in clock cycles from edges time[0..count-1], 0 if the pulses are
+// inconsistent, or -1 if there are too few in-frame pulses to tell. Pulses
+// shorter than half a bit at 1 Mbit/s are ignored as glitches.
+float can_estimate_bit_ticks(const uint32_t time[], int count, uint32_t clockHz);
+
+// Rebuilds the bit stream from the edges and counts CRC-valid frames.
+// level[i] is the bus level after edge i.
+int can_validate_bit_ticks(const uint32_t time[], const uint8_t level[], int count, float bitTicks);
+
+// Rate for a bit time, snapped to the nearest standard rate within 3%.
+long can_snap_baudrate(float bitTicks, uint32_t clockHz);
+
+// Runs all three steps; the rate is only found with `framesRequired`
+// CRC-valid frames.
+CAN_BaudEstimate can_estimate_baudrate(const uint32_t time[], const uint8_t level[], int count, uint32_t clockHz,
+                                       int framesRequired);
+
+#endif // ESP_CAN_BAUD_ESTIMATE_H
@@ -0,0 +1,58 @@
+/*
+ * ESP_CAN_BitTiming.cpp - Bit timing solver.
+ */
+
+#include "ESP_CAN_BitTiming.h"
+
+static float absf(float v) { return v < 0 ? -v : v; }
+
+bool can_solve_bit_timing(uint32_t clockHz, long baudrate, float samplePoint, CAN_BitTiming &timing) {
+  if (baudrate <= 0) return false;
+
+  bool found = false;
+  float bestRateError = 0, bestSpError = 0;
+  uint32_t bestQuanta = 0;
+
+  for (uint32_t quanta = 8; quanta <= 25; quanta++) {
+    uint32_t brp = (uint32_t)((float)clockHz / ((float)baudrate * quanta) + 0.5f);
+    if (brp < 1) continue;
+    float rateError = absf((float)clockHz / (brp * quanta) - baudrate) / baudrate;
+    if (rateError > 0.005f) continue;
+
+    // PHASE_SEG2 from the requested sample point, then split the rest of the
+    // bit between PROP_SEG and PHASE_SEG1 (PHASE_SEG1 = PHASE_SEG2 where possible,
+    // so resynchronization has the same margin in both directions).
+    int phaseSeg2 = (int)(quanta * (1.0f - samplePoint) + 0.5f);
+    if (phaseSeg2 < 1) phaseSeg2 = 1;
+    if (phaseSeg2 > 8) phaseSeg2 = 8;
+    int tseg1 = quanta - 1 - phaseSeg2;
+    if (tseg1 < 2 || tseg1 > 16) continue;
+    int phaseSeg1 = phaseSeg2 < tseg1 - 1 ? phaseSeg2 : tseg1 - 1;
+    int propSeg = tseg1 - phaseSeg1;
+    if (propSeg > 8) {
+      phaseSeg1 += propSeg - 8;
+      propSeg = 8;
+    }
+    if (phaseSeg1 > 8) continue;
+
+    CAN_BitTiming candidate;
+    candidate.brp = brp;
+    candidate.propSeg = propSeg;
+    candidate.phaseSeg1 = phaseSeg1;
+    candidate.phaseSeg2 = phaseSeg2;
+    candidate.sjw = phaseSeg2 < 4 ? phaseSeg2 : 4;
+    float spError = absf(candidate.samplePoint() - samplePoint);
+
+    bool better = !found || rateError < bestRateError ||
+                  (rateError == bestRateError && (spError < bestSpError ||
+                                                  (spError == bestSpError && quanta > bestQuanta)));
+    if (better) {
+      found = true;
+      bestRateError = rateError;
+      bestSpError = spError;
+      bestQuanta = quanta;
+      timing = candidate;
+    }
+  }
+  return found;
+}
@@ -0,0 +1,35 @@
+/*
+ * ESP_CAN_BitTiming.h - Time-quanta bit timing, modelled on CAN controllers.
+ *
+ * A bit is split into SYNC_SEG (1 tq), PROP_SEG, PHASE_SEG1 and PHASE_SEG2.
+ * The bus is sampled between PHASE_SEG1 and PHASE_SEG2, and resynchronization
+ * may stretch PHASE_SEG1 or shorten PHASE_SEG2 by at most SJW quanta. One
+ * time quantum is `brp` cycles of the timing clock; ESP_CAN uses the CPU
+ * cycle counter, so the clock is the CPU frequency.
+ * Only depends on <stdint.h>.
+ */
+
+#ifndef ESP_CAN_BIT_TIMING_H
+#define ESP_CAN_BIT_TIMING_H
+
+#include <stdint.h>
+
+struct CAN_BitTiming {
+  uint32_t brp;       // Timing-clock cycles per time quantum
+  uint8_t propSeg;    // 1..8 tq
+  uint8_t phaseSeg1;  // 1..8 tq
+  uint8_t phaseSeg2;  // 1..8 tq
+  uint8_t sjw;        // 1..4 tq, at most phaseSeg2
+
+  uint32_t quantaPerBit() const { return 1 + propSeg + phaseSeg1 + phaseSeg2; }
+  // Fraction of the bit time at which the bus is sampled
+  float samplePoint() const { return (float)(1 + propSeg + phaseSeg1) / quantaPerBit(); }
+  float baudrate(uint32_t clockHz) const { return (float)clockHz / (brp * quantaPerBit()); }
+};
+
+// Picks the timing for `baudrate` with the smallest rate error, then the
+// sample point closest to `samplePoint` (e.g. 0.875), then the most quanta
+// per bit. Returns false if no setting is within 0.5% of the requested rate.
+bool can_solve_bit_timing(uint32_t clockHz, long baudrate, float samplePoint, CAN_BitTiming &timing);
+
+#endif // ESP_CAN_BIT_TIMING_H
@@ -0,0 +1,94 @@
+/*
+ * ESP_CAN_CaptureFormat.h - On-disk layout of binary CAN capture files.
+ *
+ * Shared by the streaming writer (ESP_CAN_CaptureWriter) and the host reader
+ * in tools/cancap, so it only depends on <stdint.h>.
+ *
+ * Layout (all little endian):
+ *
+ *   CAN_CaptureFileHeader
+ *   block 0: blockRecords x CAN_CaptureRecord, CAN_CaptureBlockIndex
+ *   block 1: ...
+ *   CAN_CaptureFooter
+ *
+ * Every block has the same size, so a reader finds block k's index entry at
+ * a fixed offset and can binary-search by time and skip blocks whose ID
+ * bitmap does not contain the requested ID, touching only a few pages per
+ * query. The index entry trails its block instead of living in one table at
+ * the end of the file, so the writer only ever holds one entry in RAM. The
+ * last block is padded with empty records when the capture is closed.
+ */
+
+#ifndef ESP_CAN_CAPTURE_FORMAT_H
+#define ESP_CAN_CAPTURE_FORMAT_H
+
+#include <stdint.h>
+
+#define CAN_CAPTURE_MAGIC "ESPCANC1"
+#define CAN_CAPTURE_BLOCK_MAGIC 0x4B4C4243u   // "CBLK"
+#define CAN_CAPTURE_FOOTER_MAGIC 0x444E4543u  // "CEND"
+#define CAN_CAPTURE_VERSION 2
+#define CAN_CAPTURE_DEFAULT_BLOCK_RECORDS 1024
+
+// Record flags
+#define CAN_CAPTURE_FLAG_ERROR 0x1   // Frame failed validation
+#define CAN_CAPTURE_FLAG_REMOTE 0x2  // Remote frame: DLC is the length requested, no payload
+
+struct CAN_CaptureFileHeader {
+  char magic[8];              // CAN_CAPTURE_MAGIC, not NUL-terminated
+  uint32_t version;           // CAN_CAPTURE_VERSION
+  uint32_t blockRecords;      // Records per block
+  uint64_t startUnixTimeUs;   // Wall-clock time of timestamp 0, or 0 if unknown
+  uint64_t reserved;
+};
+
+// 16 bytes: 47-bit microsecond timestamp (~4.4 years), remote flag, 11-bit
+// ID, DLC and error flag packed into one word, followed by the payload.
+// Version 1 had a 48-bit timestamp and no remote flag. Its bit 47 is only
+// set 4.4 years into a capture, so readers treat both versions alike.
+struct CAN_CaptureRecord {
+  uint64_t meta;
+  uint8_t data[8];
+};
+
+struct CAN_CaptureBlockIndex {
+  uint64_t firstTimestampUs;
+  uint64_t lastTimestampUs;
+  uint32_t recordCount;       // Valid records; the rest of the block is padding
+  uint32_t magic;             // CAN_CAPTURE_BLOCK_MAGIC
+  uint32_t idBitmap[64];      // Bit `id` is set if the block contains that ID
+};
+
+struct CAN_CaptureFooter {
+  uint64_t recordCount;
+  uint64_t blockCount;
+  uint64_t firstTimestampUs;
+  uint64_t lastTimestampUs;
+  uint32_t magic;             // CAN_CAPTURE_FOOTER_MAGIC
+  uint32_t reserved;
+};
+
+static_assert(sizeof(CAN_CaptureFileHeader) == 32, "CAN_CaptureFileHeader must stay 32 bytes");
+static_assert(sizeof(CAN_CaptureRecord) == 16, "CAN_CaptureRecord must stay 16 bytes");
+static_assert(sizeof(CAN_CaptureBlockIndex) == 280, "CAN_CaptureBlockIndex must stay 280 bytes");
+static_assert(sizeof(CAN_CaptureFooter) == 40, "CAN_CaptureFooter must stay 40 bytes");
+
+#define CAN_CAPTURE_TIMESTAMP_MASK 0x7FFFFFFFFFFFull
+
+inline uint64_t can_capture_pack(uint64_t timestampUs, uint16_t id, uint8_t dlc, uint8_t flags) {
+  return (timestampUs & CAN_CAPTURE_TIMESTAMP_MASK) | ((uint64_t)((flags >> 1) & 0x1) << 47) |
+         ((uint64_t)(id & 0x7FF) << 48) | ((uint64_t)(dlc & 0xF) << 59) | ((uint64_t)(flags & 0x1) << 63);
+}
+
+inline uint64_t can_capture_timestamp(const CAN_CaptureRecord &r) { return r.meta & CAN_CAPTURE_TIMESTAMP_MASK; }
+inline uint16_t can_capture_id(const CAN_CaptureRecord &r) { return (r.meta >> 48) & 0x7FF; }
+inline uint8_t can_capture_dlc(const CAN_CaptureRecord &r) { return (r.meta >> 59) & 0xF; }
+inline uint8_t can_capture_flags(const CAN_CaptureRecord &r) {
+  return (uint8_t)(r.meta >> 63) | (uint8_t)(((r.meta >> 47) & 0x1) << 1);
+}
+
+inline uint64_t can_capture_block_bytes(uint32_t blockRecords) {
+  return (uint64_t)blockRecords * sizeof(CAN_CaptureRecord) + sizeof(CAN_CaptureBlockIndex);
+}
+
+#endif // ESP_CAN_CAPTURE_FORMAT_H
@@ -0,0 +1,84 @@
+/*
+ * ESP_CAN_CaptureWriter.cpp - Implementation of the binary capture writer.
+ */
+
+#include "ESP_CAN_CaptureWriter.h"
+#include <esp_timer.h>
+
+ESP_CAN_CaptureWriter::ESP_CAN_CaptureWriter(Print &out, uint32_t blockRecords) : _out(out) {
+  _blockRecords = blockRecords > 0 ? blockRecords : CAN_CAPTURE_DEFAULT_BLOCK_RECORDS;
+  recordCount = 0;
+  writeErrors = 0;
+}
+
+void ESP_CAN_CaptureWriter::begin(uint64_t startUnixTimeUs) {
+  CAN_CaptureFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CAN_CAPTURE_MAGIC, sizeof(header.magic));
+  header.version = CAN_CAPTURE_VERSION;
+  header.blockRecords = _blockRecords;
+  header.startUnixTimeUs = startUnixTimeUs;
+  put(&header, sizeof(header));
+
+  recordCount = 0;
+  _blockCount = 0;
+  _firstTimestampUs = 0;
+  _lastTimestampUs = 0;
+  _startUs = esp_timer_get_time();
+  memset(&_block, 0, sizeof(_block));
+}
+
+void ESP_CAN_CaptureWriter::write(const CAN_Frame &frame, uint8_t flags) {
+  write(frame, esp_timer_get_time() - _startUs, flags);
+}
+
+void ESP_CAN_CaptureWriter::write(const CAN_Frame &frame, uint64_t timestampUs, uint8_t flags) {
+  CAN_CaptureRecord record;
+  bool remote = can_is_remote(frame);
+  if (remote) flags |= CAN_CAPTURE_FLAG_REMOTE;
+  record.meta = can_capture_pack(timestampUs, frame.id, frame.dlc, flags);
+  // A remote frame has no data field
+  if (remote) memset(record.data, 0, sizeof(record.data));
+  else memcpy(record.data, frame.data, sizeof(record.data));
+  put(&record, sizeof(record));
+
+  if (_block.recordCount == 0) _block.firstTimestampUs = timestampUs;
+  if (recordCount == 0) _firstTimestampUs = timestampUs;
+  _block.lastTimestampUs = timestampUs;
+  _lastTimestampUs = timestampUs;
+  _block.idBitmap[(frame.id & 0x7FF) >> 5] |= 1u << (frame.id & 0x1F);
+  _block.recordCount++;
+  recordCount++;
+
+  if (_block.recordCount == _blockRecords) finishBlock();
+}
+
+void ESP_CAN_CaptureWriter::close() {
+  if (_block.recordCount > 0) {
+    CAN_CaptureRecord padding;
+    memset(&padding, 0, sizeof(padding));
+    for (uint32_t i = _block.recordCount; i < _blockRecords; i++) put(&padding, sizeof(padding));
+    finishBlock();
+  }
+
+  CAN_CaptureFooter footer;
+  memset(&footer, 0, sizeof(footer));
+  footer.recordCount = recordCount;
+  footer.blockCount = _blockCount;
+  footer.firstTimestampUs = _firstTimestampUs;
+  footer.lastTimestampUs = _lastTimestampUs;
+  footer.magic = CAN_CAPTURE_FOOTER_MAGIC;
+  put(&footer, sizeof(footer));
+  _out.flush();
+}
+
+void ESP_CAN_CaptureWriter::finishBlock() {
+  _block.magic = CAN_CAPTURE_BLOCK_MAGIC;
+  put(&_block, sizeof(_block));
+  _blockCount++;
+  memset(&_block, 0, sizeof(_block));
+}
+
+void ESP_CAN_CaptureWriter::put(const void *data, size_t len) {
+  if (_out.write((const uint8_t *)data, len) != len) writeErrors++;
+}
@@ -0,0 +1,49 @@
+/*
+ * ESP_CAN_CaptureWriter.h - Streams received frames into a binary capture file.
+ *
+ * Writes the format described in ESP_CAN_CaptureFormat.h to any Print, such
+ * as a File on SD or LittleFS. Each frame costs one 16-byte write and an
+ * update of the current block's index entry, so it can be called directly
+ * after readFrame(). Call close() to pad the last block and write the footer;
+ * a capture that was never closed is still readable, only its tail is not
+ * indexed.
+ */
+
+#ifndef ESP_CAN_CAPTURE_WRITER_H
+#define ESP_CAN_CAPTURE_WRITER_H
+
+#include <Arduino.h>
+#include "ESP_CAN.h"
+#include "ESP_CAN_CaptureFormat.h"
+
+class ESP_CAN_CaptureWriter {
+public:
+  uint64_t recordCount;
+  uint32_t writeErrors;  // Short writes reported by the underlying Print
+
+  ESP_CAN_CaptureWriter(Print &out, uint32_t blockRecords = CAN_CAPTURE_DEFAULT_BLOCK_RECORDS);
+
+  // Writes the file header. `startUnixTimeUs` anchors timestamps to wall time.
+  void begin(uint64_t startUnixTimeUs = 0);
+
+  // Appends one frame. Without a timestamp, esp_timer time since begin() is
+  // used. Remote frames get CAN_CAPTURE_FLAG_REMOTE.
+  void write(const CAN_Frame &frame, uint8_t flags = 0);
+  void write(const CAN_Frame &frame, uint64_t timestampUs, uint8_t flags);
+
+  void close();
+
+private:
+  Print &_out;
+  uint32_t _blockRecords;
+  int64_t _startUs;
+  uint64_t _blockCount;
+  uint64_t _firstTimestampUs;
+  uint64_t _lastTimestampUs;
+  CAN_CaptureBlockIndex _block;
+
+  void put(const void *data, size_t len);
+  void finishBlock();
+};
+
+#endif // ESP_CAN_CAPTURE_WRITER_H
@@ -0,0 +1,238 @@
+/*
+ * ESP_CAN_Decoder.cpp - Implementation of the bit-level CAN frame decoder.
+ */
+
+#include "ESP_CAN_Decoder.h"
+
+uint16_t can_crc15(const bool bits[], int len) {
+  uint16_t crc = 0;
+  for (int i = 0; i < len; i++) crc = can_crc15_step(crc, bits[i]);
+  return crc;
+}
+
+CAN_BitDecoder::CAN_BitDecoder() {
+  reset();
+}
+
+void CAN_BitDecoder::reset() {
+  _field = FIELD_WAIT_IDLE;
+  _recessiveRun = 0;
+  _error = CAN_DECODE_ERROR_NONE;
+}
+
+void CAN_BitDecoder::resetToIdle() {
+  _field = FIELD_IDLE;
+  _error = CAN_DECODE_ERROR_NONE;
+}
+
+void CAN_BitDecoder::resetToIntermission() {
+  enter(FIELD_INTERMISSION);
+  _error = CAN_DECODE_ERROR_NONE;
+}
+
+void CAN_BitDecoder::enter(Field field) {
+  _field = field;
+  _fieldBits = 0;
+  _shift = 0;
+}
+
+void CAN_BitDecoder::enterFlag(Field field, int dominantRun, int recessiveRun) {
+  _field = field;
+  _dominantRun = dominantRun;
+  _recessiveRun = recessiveRun;
+  _flagSeen = dominantRun >= 6;
+}
+
+// Error-active nodes signal the error with a flag of 6 dominant bits, which
+// may already be on the bus: it is what a stuff error on dominant bits is.
+// After the flags come 8 recessive bits of delimiter and the intermission.
+CAN_Decode_Event CAN_BitDecoder::fail(CAN_Decode_Error error, bool bit) {
+  enterFlag(FIELD_ERROR, _dominantRun, bit ? (error == CAN_DECODE_ERROR_STUFF ? 6 : 1) : 0);
+  _error = error;
+  return CAN_DECODE_ERROR;
+}
+
+// Flags, however many nodes superpose theirs, end with the first of 8
+// recessive bits. Any dominant bit restarts the delimiter.
+CAN_Decode_Event CAN_BitDecoder::feedFlag(bool bit) {
+  if (!bit) {
+    if (++_dominantRun >= 6) _flagSeen = true;
+    _recessiveRun = 0;
+    return CAN_DECODE_NONE;
+  }
+  _dominantRun = 0;
+  if (++_recessiveRun < 8) return CAN_DECODE_NONE;
+  bool overload = _field == FIELD_OVERLOAD;
+  enter(FIELD_INTERMISSION);
+  if (!_flagSeen) return CAN_DECODE_NONE;
+  return overload ? CAN_DECODE_OVERLOAD_FRAME : CAN_DECODE_ERROR_FRAME;
+}
+
+// Start of frame: SOF is the first bit of the stuffed region. It is
+// dominant and the CRC register starts at 0, so it does not change the CRC.
+CAN_Decode_Event CAN_BitDecoder::startOfFrame() {
+  _inStuffRegion = true;
+  _stuffCount = 1;
+  _stuffLevel = false;
+  _crc = 0;
+  _rawBits = 1;
+  _dominantRun = 1;
+  _extended = false;
+  _remote = false;
+  _extId = 0;
+  _acked = false;
+  _error = CAN_DECODE_ERROR_NONE;
+  _frame.id = 0;
+  _frame.dlc = 0;
+  enter(FIELD_ID);
+  return CAN_DECODE_SOF;
+}
+
+CAN_Decode_Event CAN_BitDecoder::feed(bool bit) {
+  switch (_field) {
+    case FIELD_WAIT_IDLE:
+      _recessiveRun = bit ? _recessiveRun + 1 : 0;
+      if (_recessiveRun >= 11) _field = FIELD_IDLE;
+      return CAN_DECODE_NONE;
+
+    case FIELD_IDLE:
+      if (bit) return CAN_DECODE_NONE;
+      return startOfFrame();
+
+    case FIELD_INTERMISSION:
+      _fieldBits++;
+      if (bit) {
+        if (_fieldBits == 3) _field = FIELD_IDLE;
+        return CAN_DECODE_NONE;
+      }
+      // A node whose clock runs fast may start its frame one bit early
+      if (_fieldBits == 3) return startOfFrame();
+      enterFlag(FIELD_OVERLOAD, 1, 0);
+      return CAN_DECODE_NONE;
+
+    case FIELD_ERROR:
+    case FIELD_OVERLOAD:
+      return feedFlag(bit);
+
+    default:
+      break;
+  }
+
+  _rawBits++;
+  _dominantRun = bit ? 0 : _dominantRun + 1;
+
+  if (_inStuffRegion) {
+    if (_stuffCount == 5) {
+      // This must be a stuff bit of the opposite level; it carries no data
+      if (bit == _stuffLevel) return fail(CAN_DECODE_ERROR_STUFF, bit);
+      _stuffLevel = bit;
+      _stuffCount = 1;
+      if (_field == FIELD_CRC_DELIM) _inStuffRegion = false;
+      return CAN_DECODE_NONE;
+    }
+    if (bit == _stuffLevel) {
+      _stuffCount++;
+    } else {
+      _stuffLevel = bit;
+      _stuffCount = 1;
+    }
+  }
+
+  return feedDestuffed(bit);
+}
+
+CAN_Decode_Event CAN_BitDecoder::feedDestuffed(bool bit) {
+  if (_field < FIELD_CRC) _crc = can_crc15_step(_crc, bit);
+  _shift = (_shift << 1) | bit;
+  _fieldBits++;
+
+  switch (_field) {
+    case FIELD_ID:
+      if (_fieldBits == 11) {
+        _frame.id = _shift;
+        enter(FIELD_SRR_RTR);
+      }
+      break;
+
+    case FIELD_SRR_RTR:
+      _remote = bit; // RTR for standard frames, SRR for extended ones
+      enter(FIELD_IDE);
+      break;
+
+    case FIELD_IDE:
+      _extended = bit;
+      _reservedBits = _extended ? 2 : 1;
+      enter(_extended ? FIELD_EXT_ID : FIELD_RESERVED);
+      break;
+
+    case FIELD_EXT_ID:
+      if (_fieldBits == 18) {
+        _extId = (_frame.id << 18) | _shift;
+        enter(FIELD_EXT_RTR);
+      }
+      break;
+
+    case FIELD_EXT_RTR:
+      _remote = bit;
+      enter(FIELD_RESERVED);
+      break;
+
+    case FIELD_RESERVED:
+      if (_fieldBits == _reservedBits) enter(FIELD_DLC);
+      break;
+
+    case FIELD_DLC:
+      if (_fieldBits == 4) {
+        _frame.dlc = _shift > 8 ? 8 : _shift;
+        // Remote frames carry a DLC but no data field
+        enter(_remote || _frame.dlc == 0 ? FIELD_CRC : FIELD_DATA);
+      }
+      break;
+
+    case FIELD_DATA:
+      if ((_fieldBits & 7) == 0) {
+        _frame.data[(_fieldBits >> 3) - 1] = _shift & 0xFF;
+        if (_fieldBits == _frame.dlc * 8) enter(FIELD_CRC);
+      }
+      break;
+
+    case FIELD_CRC:
+      if (_fieldBits == 15) {
+        _crcReceived = _shift & 0x7FFF;
+        enter(FIELD_CRC_DELIM);
+        // A stuff bit may still follow the last CRC bit
+        if (_stuffCount != 5) _inStuffRegion = false;
+      }
+      break;
+
+    case FIELD_CRC_DELIM:
+      if (!bit) return fail(CAN_DECODE_ERROR_FORM, bit);
+      if (_crcReceived != _crc) return fail(CAN_DECODE_ERROR_CRC, bit);
+      enter(FIELD_ACK_SLOT);
+      return CAN_DECODE_ACK_SLOT;
+
+    case FIELD_ACK_SLOT:
+      _acked = !bit;
+      enter(FIELD_ACK_DELIM);
+      break;
+
+    case FIELD_ACK_DELIM:
+      if (!bit) return fail(CAN_DECODE_ERROR_FORM, bit);
+      enter(FIELD_EOF);
+      break;
+
+    case FIELD_EOF:
+      // A dominant last EOF bit does not invalidate the frame for receivers;
+      // it starts an overload flag
+      if (!bit && _fieldBits < 7) return fail(CAN_DECODE_ERROR_FORM, bit);
+      if (_fieldBits == 7) {
+        if (bit) enter(FIELD_INTERMISSION); else enterFlag(FIELD_OVERLOAD, 1, 0);
+        return CAN_DECODE_FRAME_OK;
+      }
+      break;
+
+    default:
+      break;
+  }
+  return CAN_DECODE_NONE;
+}
@@ -0,0 +1,126 @@
+/*
+ * ESP_CAN_Decoder.h - Bit-level CAN frame decoder.
+ *
+ * Consumes the raw (stuffed) bus level one bit at a time and reassembles
+ * frames: destuffing, standard and extended identifiers, remote frames,
+ * DLC/data, CRC-15 check and the fixed-form tail (CRC delimiter, ACK, EOF).
+ * Error and overload frames are followed through their flag and delimiter
+ * into the intermission, so the next frame is caught even when its start
+ * of frame falls on the third intermission bit.
+ * It has no timing or pin knowledge, so the same code validates frames from
+ * the live receiver, from auto-baud edge captures and from host-side tools.
+ * Only depends on <stdint.h>.
+ */
+
+#ifndef ESP_CAN_DECODER_H
+#define ESP_CAN_DECODER_H
+
+#include <stdint.h>
+#include "ESP_CAN_Frame.h"
+
+enum CAN_Decode_Event {
+  CAN_DECODE_NONE,      // Bit consumed, nothing to report
+  CAN_DECODE_SOF,       // Start of frame seen (hard synchronization point)
+  CAN_DECODE_ACK_SLOT,  // CRC delimiter done and CRC valid: next bit is the ACK slot
+  CAN_DECODE_FRAME_OK,  // End of frame reached, frame() holds the result
+  CAN_DECODE_ERROR,     // Frame aborted; lastError() says why
+  CAN_DECODE_ERROR_FRAME,    // An error flag and its delimiter ended
+  CAN_DECODE_OVERLOAD_FRAME  // An overload flag and its delimiter ended
+};
+
+enum CAN_Decode_Error {
+  CAN_DECODE_ERROR_NONE,
+  CAN_DECODE_ERROR_STUFF,  // Six equal bits inside the stuffed region
+  CAN_DECODE_ERROR_CRC,    // Received CRC does not match
+  CAN_DECODE_ERROR_FORM    // Dominant bit in a fixed recessive field
+};
+
+// CRC-15-CAN (polynomial 0x4599) over `len` bits, one bool per bit.
+uint16_t can_crc15(const bool bits[], int len);
+
+// Advances a CRC-15 register by one bit. constexpr for ESP_CAN_Waveform.h.
+constexpr uint16_t can_crc15_step(uint16_t crc, bool bit) {
+  return (uint16_t)(((crc << 1) & 0x7FFF) ^ ((((crc >> 14) & 1) ^ bit) ? 0x4599 : 0));
+}
+
+class CAN_BitDecoder {
+public:
+  CAN_BitDecoder();
+
+  // Waits for 11 recessive bits (bus idle) before accepting a frame.
+  void reset();
+  // Accepts a start of frame on the next dominant bit.
+  void resetToIdle();
+  // Starts the intermission after an EOF: a dominant bit in its first two
+  // bits is an overload flag, in the third a start of frame.
+  void resetToIntermission();
+
+  // Feeds one bus bit (true = recessive).
+  CAN_Decode_Event feed(bool bit);
+
+  // True during a frame and during error and overload flags and delimiters
+  bool inFrame() const { return _field != FIELD_WAIT_IDLE && _field != FIELD_IDLE && _field != FIELD_INTERMISSION; }
+  bool isIdle() const { return _field == FIELD_IDLE; }
+
+  const CAN_Frame &frame() const { return _frame; }
+  bool isExtended() const { return _extended; }
+  bool isRemote() const { return _remote; }
+  uint32_t extendedId() const { return _extId; }
+  bool acknowledged() const { return _acked; }
+  CAN_Decode_Error lastError() const { return _error; }
+
+  // Number of raw bus bits (stuff bits included) since start of frame.
+  int bitPosition() const { return _rawBits; }
+
+private:
+  enum Field {
+    FIELD_WAIT_IDLE,
+    FIELD_IDLE,
+    FIELD_ID,
+    FIELD_SRR_RTR,
+    FIELD_IDE,
+    FIELD_EXT_ID,
+    FIELD_EXT_RTR,
+    FIELD_RESERVED,
+    FIELD_DLC,
+    FIELD_DATA,
+    FIELD_CRC,
+    FIELD_CRC_DELIM,
+    FIELD_ACK_SLOT,
+    FIELD_ACK_DELIM,
+    FIELD_EOF,
+    FIELD_INTERMISSION,
+    FIELD_ERROR,      // Error flags, then the 8-bit error delimiter
+    FIELD_OVERLOAD    // Overload flags, then the 8-bit overload delimiter
+  };
+
+  Field _field;
+  int _fieldBits;       // Bits consumed in the current field
+  int _reservedBits;    // r0 (standard) or r1+r0 (extended)
+  uint32_t _shift;      // Accumulator for the current field
+  int _recessiveRun;    // For bus idle detection and delimiters
+  int _dominantRun;     // Dominant bits in a row, to tell an error flag
+  bool _flagSeen;       // Six dominant bits seen since the error or overload
+  bool _inStuffRegion;
+  int _stuffCount;
+  bool _stuffLevel;
+  uint16_t _crc;
+  uint16_t _crcReceived;
+  int _rawBits;
+
+  CAN_Frame _frame;
+  bool _extended;
+  bool _remote;
+  uint32_t _extId;
+  bool _acked;
+  CAN_Decode_Error _error;
+
+  CAN_Decode_Event fail(CAN_Decode_Error error, bool bit);
+  CAN_Decode_Event startOfFrame();
+  CAN_Decode_Event feedDestuffed(bool bit);
+  CAN_Decode_Event feedFlag(bool bit);
+  void enterFlag(Field field, int dominantRun, int recessiveRun);
+  void enter(Field field);
+};
+
+#endif // ESP_CAN_DECODER_H
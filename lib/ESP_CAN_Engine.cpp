@@ -0,0 +1,158 @@
+/*
+ * ESP_CAN_Engine.cpp - Dedicated-core bus engine.
+ */
+
+#include "ESP_CAN_Engine.h"
+
+#ifndef ESP_PLATFORM
+#include <thread>
+#endif
+
+ESP_CAN_Engine::ESP_CAN_Engine(ESP_CAN &can) : _can(can) {
+  resultsDropped = 0;
+  _running = false;
+  _stopRequested = false;
+  _utilization = 0;
+  _task = NULL;
+  _pool = NULL;
+  _rxSlot = CAN_FRAME_HANDLE_NONE;
+  _txAttempts = 0;
+}
+
+bool ESP_CAN_Engine::start(int core, int priority) {
+  if (_running) return false;
+  _stopRequested = false;
+  _running = true;
+
+#ifdef ESP_PLATFORM
+  // The engine never blocks, so the idle task of its core never runs. Tasks
+  // of a higher priority still preempt it.
+  if (core == 0) disableCore0WDT();
+#ifndef CONFIG_FREERTOS_UNICORE
+  else disableCore1WDT();
+#endif
+  TaskHandle_t handle = NULL;
+  if (xTaskCreatePinnedToCore(taskEntry, "can_engine", 4096, this, priority, &handle, core) != pdPASS) {
+    _running = false;
+    return false;
+  }
+  _task = handle;
+#else
+  // Host build: a plain thread, not pinned
+  (void)core;
+  (void)priority;
+  _task = new std::thread(taskEntry, this);
+#endif
+  return true;
+}
+
+void ESP_CAN_Engine::stop() {
+  if (!_task) return;
+  _stopRequested = true;
+#ifdef ESP_PLATFORM
+  while (_running) delay(1);
+#else
+  std::thread *thread = static_cast<std::thread *>(_task);
+  thread->join();
+  delete thread;
+#endif
+  _task = NULL;
+  if (_pool) {
+    _pool->release(_rxSlot);
+    _rxSlot = CAN_FRAME_HANDLE_NONE;
+  }
+}
+
+void ESP_CAN_Engine::taskEntry(void *arg) {
+  static_cast<ESP_CAN_Engine *>(arg)->run();
+#ifdef ESP_PLATFORM
+  vTaskDelete(NULL);
+#endif
+}
+
+void ESP_CAN_Engine::postResult(CAN_Engine_Result_Type type, const CAN_Frame &frame) {
+  CAN_Engine_Result result;
+  result.type = type;
+  result.cycles = ESP.getCycleCount();
+  result.frame = frame;
+  if (!_results.push(result)) resultsDropped++;
+}
+
+// readFrame() into the spare pool slot, so the decoder's copy is the only
+// write of the frame. The slot is handed over only once a frame is in it.
+CAN_Read_Status ESP_CAN_Engine::readPooled(CAN_Frame &scratch) {
+  if (_rxSlot == CAN_FRAME_HANDLE_NONE) _rxSlot = _pool->alloc();
+  if (_rxSlot == CAN_FRAME_HANDLE_NONE) {
+    CAN_Read_Status status = _can.readFrame(scratch);
+    if (status == CAN_READ_MSG_OK) resultsDropped++;
+    return status;
+  }
+  CAN_Read_Status status = _can.readFrame((*_pool)[_rxSlot]);
+  if (status == CAN_READ_MSG_OK) {
+    if (_rxHandles.push(_rxSlot)) _rxSlot = CAN_FRAME_HANDLE_NONE;
+    else resultsDropped++;  // The slot is reused for the next frame
+  }
+  return status;
+}
+
+// Sends the request at the head of the TX queue once. It stays at the head
+// until it is sent, out of attempts or stale; the counters are the bus's.
+void ESP_CAN_Engine::serviceTx() {
+  TxRequest request;
+  _txQueue.peek(request);
+  if (can_tx_expired(request.policy)) {
+    _can.deadlineMisses++;
+    _txQueue.drop();
+    _txAttempts = 0;
+    postResult(CAN_ENGINE_TX_EXPIRED, request.frame);
+    return;
+  }
+  bool ok = _can.sendFrame(request.frame);
+  _txAttempts++;
+  bool lastAttempt = request.policy.attempts != 0 && _txAttempts >= request.policy.attempts;
+  if (!ok && !lastAttempt && _can.state != CAN_STATE_BUS_OFF) {
+    _can.txRetries++;
+    return;
+  }
+  _txQueue.drop();
+  _txAttempts = 0;
+  postResult(ok ? CAN_ENGINE_TX_OK : CAN_ENGINE_TX_FAILED, request.frame);
+}
+
+void ESP_CAN_Engine::run() {
+  const uint32_t windowCycles = ESP.getCpuFreqMHz() * 1000000;
+  uint32_t windowStart = ESP.getCycleCount();
+  uint32_t busyCycles = 0;
+
+  while (!_stopRequested) {
+    uint32_t pollStart = ESP.getCycleCount();
+    CAN_Frame frame;
+    bool active;
+
+    // TX requests wait for the bus to be idle after the intermission;
+    // sendFrame() then blocks this core for the whole frame, which is what
+    // it is for. In bus-off they fail at once.
+    if ((_can.busIdle() || _can.state == CAN_STATE_BUS_OFF) && !_txQueue.empty()) {
+      serviceTx();
+      active = true;
+    } else {
+      CAN_Read_Status status = _pool ? readPooled(frame) : _can.readFrame(frame);
+      if (status == CAN_READ_MSG_OK && !_pool) {
+        postResult(CAN_ENGINE_RX, frame);
+      } else if (status == CAN_READ_ERROR) {
+        memset(&frame, 0, sizeof(frame));
+        postResult(CAN_ENGINE_RX_ERROR, frame);
+      }
+      active = _can.receiving() || status != CAN_READ_NO_MSG;
+    }
+
+    uint32_t now = ESP.getCycleCount();
+    if (active) busyCycles += now - pollStart;
+    if (now - windowStart >= windowCycles) {
+      _utilization = (float)busyCycles / (now - windowStart);
+      busyCycles = 0;
+      windowStart = now;
+    }
+  }
+  _running = false;
+}
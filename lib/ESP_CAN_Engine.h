@@ -0,0 +1,109 @@
+/*
+ * ESP_CAN_Engine.h - Runs the ESP_CAN bit engine in its own task.
+ *
+ * On the ESP32 the engine is a FreeRTOS task pinned to one core that polls
+ * readFrame() back to back, so Serial, WiFi and the rest of the sketch on
+ * the other core no longer delay the sample point. On other platforms
+ * (host simulation) it is a std::thread. The application only talks to the
+ * engine through two lock-free queues: TX requests in, results out. Once
+ * started, do not call ESP_CAN methods directly.
+ *
+ * The engine never blocks, so it keeps its core busy. start() disables the
+ * task watchdog of that core. By default it runs on core 0 at priority 1:
+ * the WiFi, lwIP and event tasks on that core have higher priorities and
+ * preempt it, so they keep working, while loop() has core 1 to itself.
+ */
+
+#ifndef ESP_CAN_ENGINE_H
+#define ESP_CAN_ENGINE_H
+
+#include <Arduino.h>
+#include "ESP_CAN.h"
+#include "ESP_CAN_FramePool.h"
+#include "ESP_CAN_Queue.h"
+
+#define CAN_ENGINE_TX_QUEUE 16      // TX requests, a power of two
+#define CAN_ENGINE_RESULT_QUEUE 64  // Results, a power of two
+#define CAN_ENGINE_CORE 0           // Default core, away from loop()
+#define CAN_ENGINE_PRIORITY 1       // Default priority, below the WiFi and lwIP tasks
+
+enum CAN_Engine_Result_Type {
+  CAN_ENGINE_RX,         // Frame received
+  CAN_ENGINE_RX_ERROR,   // Frame with a stuff, CRC or form error
+  CAN_ENGINE_TX_OK,      // TX request sent and acknowledged
+  CAN_ENGINE_TX_FAILED,  // TX request lost arbitration, got no ACK or bus-off on its last attempt
+  CAN_ENGINE_TX_EXPIRED  // TX request dropped unsent at its deadline
+};
+
+struct CAN_Engine_Result {
+  CAN_Engine_Result_Type type;
+  uint32_t cycles;  // CPU cycle count at completion
+  CAN_Frame frame;  // Received frame, or the TX request
+};
+
+class ESP_CAN_Engine {
+public:
+  uint32_t resultsDropped;  // Results lost because the result queue was full
+
+  ESP_CAN_Engine(ESP_CAN &can);
+
+  // Starts the engine task on `core`; returns false if it is already running
+  // or the task could not be created. A priority above the system tasks of
+  // that core starves them.
+  bool start(int core = CAN_ENGINE_CORE, int priority = CAN_ENGINE_PRIORITY);
+  // Asks the engine to stop and waits for it to exit.
+  void stop();
+  bool running() const { return _running; }
+
+  // Application side. send() returns false if the TX queue is full. Requests
+  // go out in order, each retried as its policy allows (see CAN_TxPolicy);
+  // one past its deadline is dropped before it reaches the bus, so it does
+  // not hold up the requests behind it.
+  bool send(const CAN_Frame &frame, const CAN_TxPolicy &policy = can_tx_single_shot()) {
+    TxRequest request = {frame, policy};
+    return _txQueue.push(request);
+  }
+  bool receive(CAN_Engine_Result &result) { return _results.pop(result); }
+
+  // Zero-copy RX: received frames are decoded straight into slots of `pool`
+  // and come out of receiveHandle() instead of receive(), which then only
+  // reports RX errors and TX outcomes. The caller releases each handle.
+  // Frames that find the pool empty count as resultsDropped. Call before
+  // start().
+  void setFramePool(CAN_FramePool *pool) { _pool = pool; }
+  bool receiveHandle(CAN_FrameHandle &handle) { return _rxHandles.pop(handle); }
+
+  // Share of the last second that the engine spent on frames (receiving or
+  // transmitting) rather than waiting for the bus to become active.
+  float utilization() const { return _utilization; }
+  // Worst delay between a nominal sample point and the poll that sampled it.
+  uint32_t worstLatenessCycles() const { return _can.maxSampleLateness; }
+  float worstLatenessUs() const { return (float)_can.maxSampleLateness / ESP.getCpuFreqMHz(); }
+
+private:
+  struct TxRequest {
+    CAN_Frame frame;
+    CAN_TxPolicy policy;
+  };
+
+  ESP_CAN &_can;
+  CAN_SpscQueue<TxRequest, CAN_ENGINE_TX_QUEUE> _txQueue;
+  uint8_t _txAttempts;  // Attempts made for the request at the queue head
+  CAN_SpscQueue<CAN_Engine_Result, CAN_ENGINE_RESULT_QUEUE> _results;
+  CAN_FramePool *_pool;
+  CAN_FrameHandle _rxSlot;  // Slot the next received frame is decoded into
+  CAN_SpscQueue<CAN_FrameHandle, CAN_ENGINE_RESULT_QUEUE> _rxHandles;
+
+  volatile bool _running;
+  volatile bool _stopRequested;
+  volatile float _utilization;
+  void *_task;  // TaskHandle_t or std::thread*
+
+  static void taskEntry(void *arg);
+  void run();
+  void postResult(CAN_Engine_Result_Type type, const CAN_Frame &frame);
+  void serviceTx();
+  CAN_Read_Status readPooled(CAN_Frame &scratch);
+};
+
+#endif // ESP_CAN_ENGINE_H
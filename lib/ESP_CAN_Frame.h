@@ -0,0 +1,26 @@
+/*
+ * ESP_CAN_Frame.h - The CAN frame type shared by the library and host tools.
+ *
+ * Kept free of Arduino headers so generated signal headers and host-side
+ * tools can use the same struct as the sketches.
+ */
+
+#ifndef ESP_CAN_FRAME_H
+#define ESP_CAN_FRAME_H
+
+#include <stdint.h>
+
+// Struct to hold CAN frame data
+struct CAN_Frame {
+  uint32_t id;      // 11-bit CAN Identifier, plus CAN_RTR_FLAG for a remote frame
+  uint8_t dlc;      // Data Length Code (0-8); for a remote frame, the length requested
+  uint8_t data[8];  // Data payload
+};
+
+// Set in CAN_Frame::id for a remote frame (RTR), as in SocketCAN. A remote
+// frame has no data field.
+#define CAN_RTR_FLAG 0x40000000
+
+inline bool can_is_remote(const CAN_Frame &frame) { return (frame.id & CAN_RTR_FLAG) != 0; }
+
+#endif // ESP_CAN_FRAME_H
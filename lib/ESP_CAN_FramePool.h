@@ -0,0 +1,95 @@
+/*
+ * ESP_CAN_FramePool.h - Preallocated CAN frames passed around by handle.
+ *
+ * A frame is written once, into a pool slot, and then only its 16-bit
+ * handle moves: through queues, filters, gateways and loggers. Each owner
+ * releases the handle when done, and the slot returns to the pool with the
+ * last release. retain() adds an owner, for a frame that fans out to
+ * several consumers.
+ *
+ * The free list is a lock-free stack with a tag against ABA, and owner
+ * counts are atomic, so alloc() and release() may be called from any task,
+ * core or ISR. There is no heap allocation. The methods are inline, so an
+ * IRAM_ATTR ISR gets them inlined.
+ */
+
+#ifndef ESP_CAN_FRAME_POOL_H
+#define ESP_CAN_FRAME_POOL_H
+
+#include <stdint.h>
+#include <atomic>
+#include "ESP_CAN_Frame.h"
+
+#ifndef CAN_FRAME_POOL_SIZE
+#define CAN_FRAME_POOL_SIZE 32  // Slots, at most 65535
+#endif
+
+typedef uint16_t CAN_FrameHandle;
+#define CAN_FRAME_HANDLE_NONE 0xFFFF
+
+class CAN_FramePool {
+  static_assert(CAN_FRAME_POOL_SIZE > 0 && CAN_FRAME_POOL_SIZE < CAN_FRAME_HANDLE_NONE, "bad CAN_FRAME_POOL_SIZE");
+
+public:
+  CAN_FramePool() : _inUse(0), _highWater(0) {
+    for (uint32_t i = 0; i < CAN_FRAME_POOL_SIZE; i++) {
+      _next[i].store(i + 1 < CAN_FRAME_POOL_SIZE ? i + 1 : CAN_FRAME_HANDLE_NONE, std::memory_order_relaxed);
+      _owners[i].store(0, std::memory_order_relaxed);
+    }
+    _free.store(0, std::memory_order_release);
+  }
+
+  // Takes a free slot with one owner, or returns CAN_FRAME_HANDLE_NONE if
+  // the pool is empty. The slot's previous contents are not cleared.
+  CAN_FrameHandle alloc() {
+    uint32_t head = _free.load(std::memory_order_acquire);
+    for (;;) {
+      CAN_FrameHandle slot = head & 0xFFFF;
+      if (slot == CAN_FRAME_HANDLE_NONE) return CAN_FRAME_HANDLE_NONE;
+      uint32_t next = ((head + 0x10000) & 0xFFFF0000) | _next[slot].load(std::memory_order_relaxed);
+      if (_free.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        _owners[slot].store(1, std::memory_order_relaxed);
+        uint32_t used = _inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+        uint32_t high = _highWater.load(std::memory_order_relaxed);
+        while (used > high && !_highWater.compare_exchange_weak(high, used, std::memory_order_relaxed)) {
+        }
+        return slot;
+      }
+    }
+  }
+
+  // Adds an owner. Only valid while the caller holds the handle.
+  void retain(CAN_FrameHandle handle) { _owners[handle].fetch_add(1, std::memory_order_relaxed); }
+
+  // Drops an owner; the last one returns the slot to the pool.
+  void release(CAN_FrameHandle handle) {
+    if (handle == CAN_FRAME_HANDLE_NONE) return;
+    if (_owners[handle].fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    _inUse.fetch_sub(1, std::memory_order_relaxed);
+    uint32_t head = _free.load(std::memory_order_relaxed);
+    uint32_t next;
+    do {
+      _next[handle].store(head & 0xFFFF, std::memory_order_relaxed);
+      next = ((head + 0x10000) & 0xFFFF0000) | handle;
+    } while (!_free.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  CAN_Frame &operator[](CAN_FrameHandle handle) { return _frames[handle]; }
+  const CAN_Frame &operator[](CAN_FrameHandle handle) const { return _frames[handle]; }
+
+  uint32_t inUse() const { return _inUse.load(std::memory_order_relaxed); }
+  // Most slots ever in use at once, for sizing CAN_FRAME_POOL_SIZE.
+  uint32_t highWater() const { return _highWater.load(std::memory_order_relaxed); }
+  void resetHighWater() { _highWater.store(inUse(), std::memory_order_relaxed); }
+  static uint32_t capacity() { return CAN_FRAME_POOL_SIZE; }
+
+private:
+  CAN_Frame _frames[CAN_FRAME_POOL_SIZE];
+  std::atomic<uint16_t> _next[CAN_FRAME_POOL_SIZE];   // Free list links
+  std::atomic<uint8_t> _owners[CAN_FRAME_POOL_SIZE];
+  std::atomic<uint32_t> _free;  // Tag in the upper 16 bits, first free slot in the lower
+  std::atomic<uint32_t> _inUse;
+  std::atomic<uint32_t> _highWater;
+};
+
+#endif // ESP_CAN_FRAME_POOL_H
@@ -0,0 +1,156 @@
+/*
+ * ESP_CAN_Gateway.cpp - Table-driven CAN-to-CAN routing.
+ */
+
+#include "ESP_CAN_Gateway.h"
+
+ESP_CAN_Gateway::ESP_CAN_Gateway(ESP_CAN_MultiBus &buses) : _buses(buses) {
+  _routeCount = 0;
+  _clockCycles = 0;
+  for (int i = 0; i < CAN_GATEWAY_MAX_BUSES; i++) {
+    _sending[i] = false;
+    _errorRetries[i] = 0;
+  }
+  memset(_lookup, 0, sizeof(_lookup));
+  resetStats();
+}
+
+int ESP_CAN_Gateway::addRoute(const CAN_Route &route) {
+  if (_routeCount == CAN_GATEWAY_MAX_ROUTES) return -1;
+  if (route.srcBus >= CAN_GATEWAY_MAX_BUSES) return -1;
+  if (route.dstBuses >> CAN_GATEWAY_MAX_BUSES) return -1;
+  _routes[_routeCount] = route;
+  return _routeCount++;
+}
+
+void ESP_CAN_Gateway::clearRoutes() {
+  _routeCount = 0;
+}
+
+void ESP_CAN_Gateway::compile() {
+  memset(_lookup, 0, sizeof(_lookup));
+  // Earlier routes take precedence, so only unclaimed IDs are filled in
+  for (int r = 0; r < _routeCount; r++) {
+    const CAN_Route &route = _routes[r];
+    uint8_t *table = _lookup[route.srcBus];
+    for (uint32_t id = 0; id < 2048; id++) {
+      if ((id & route.mask) == (route.id & route.mask) && table[id] == 0) table[id] = r + 1;
+    }
+    _intervalCycles[r] = (uint64_t)route.minIntervalUs * ESP.getCpuFreqMHz();
+    _forwardedOnce[r] = false;
+  }
+}
+
+void ESP_CAN_Gateway::resetStats() {
+  memset(&stats, 0, sizeof(stats));
+}
+
+float ESP_CAN_Gateway::averageLatencyUs() const {
+  if (stats.forwarded == 0) return 0;
+  return (float)stats.totalLatencyCycles / stats.forwarded / ESP.getCpuFreqMHz();
+}
+
+float ESP_CAN_Gateway::maxLatencyUs() const {
+  return (float)stats.maxLatencyCycles / ESP.getCpuFreqMHz();
+}
+
+void ESP_CAN_Gateway::poll() {
+  uint32_t ready = _buses.poll();
+  uint32_t now = _buses.lastPollCycles();
+  _clockCycles += (uint32_t)(now - (uint32_t)_clockCycles);
+  int count = _buses.count() < CAN_GATEWAY_MAX_BUSES ? _buses.count() : CAN_GATEWAY_MAX_BUSES;
+
+  for (int i = 0; i < count; i++) {
+    CAN_Frame frame;
+    if ((ready >> i & 1) && _buses.result(i, frame) == CAN_READ_MSG_OK) route(i, frame, now);
+  }
+  for (int i = 0; i < count; i++) serviceTx(i);
+}
+
+void ESP_CAN_Gateway::route(int bus, const CAN_Frame &frame, uint32_t rxCycles) {
+  stats.received++;
+  // Remote frames take the routes of their ID
+  uint32_t id = frame.id & ~CAN_RTR_FLAG;
+  uint8_t entry = id < 2048 ? _lookup[bus][id] : 0;
+  if (entry == 0) {
+    stats.unrouted++;
+    return;
+  }
+
+  int r = entry - 1;
+  const CAN_Route &route = _routes[r];
+  if (rateLimited(r)) {
+    stats.rateLimited++;
+    return;
+  }
+
+  Pending pending;
+  pending.frame = frame;
+  if (route.newId != CAN_GATEWAY_KEEP_ID) pending.frame.id = route.newId | (frame.id & CAN_RTR_FLAG);
+  pending.rxCycles = rxCycles;
+  for (int dst = 0; dst < CAN_GATEWAY_MAX_BUSES; dst++) {
+    if ((route.dstBuses >> dst & 1) && !_txQueues[dst].push(pending)) stats.queueFull++;
+  }
+}
+
+// Intervals are kept on the 64-bit clock, so neither a long minimum
+// interval nor a long quiet spell on a route wraps around.
+bool ESP_CAN_Gateway::rateLimited(int r) {
+  if (_intervalCycles[r] == 0) return false;
+  if (_forwardedOnce[r] && _clockCycles - _lastForward[r] < _intervalCycles[r]) return true;
+  _forwardedOnce[r] = true;
+  _lastForward[r] = _clockCycles;
+  return false;
+}
+
+void ESP_CAN_Gateway::serviceTx(int bus) {
+  ESP_CAN &can = _buses.bus(bus);
+
+  if (_sending[bus]) {
+    switch (can.txState()) {
+      case CAN_TX_WAITING:
+      case CAN_TX_SENDING:
+        return;
+
+      case CAN_TX_DONE: {
+        // A frame that joined a start of frame already on the bus went out
+        // without waiting
+        int32_t wait = (int32_t)(can.txStartCycles() - _inFlight[bus].rxCycles);
+        uint32_t latency = wait > 0 ? wait : 0;
+        stats.forwarded++;
+        stats.totalLatencyCycles += latency;
+        if (latency > stats.maxLatencyCycles) stats.maxLatencyCycles = latency;
+        _sending[bus] = false;
+        break;
+      }
+
+      case CAN_TX_ARBITRATION_LOST:
+        // Normal on a busy bus: try again as soon as it is idle
+        if (can.startFrame(_inFlight[bus].frame)) {
+          stats.txRetries++;
+          return;
+        }
+        stats.txFailed++;  // Went bus-off meanwhile
+        _sending[bus] = false;
+        break;
+
+      default:
+        if (++_errorRetries[bus] < CAN_GATEWAY_ERROR_RETRIES && can.startFrame(_inFlight[bus].frame)) {
+          stats.txRetries++;
+          return;
+        }
+        stats.txFailed++;
+        _sending[bus] = false;
+        break;
+    }
+  }
+
+  if (_txQueues[bus].pop(_inFlight[bus])) {
+    _errorRetries[bus] = 0;
+    if (can.startFrame(_inFlight[bus].frame)) {
+      _sending[bus] = true;
+    } else {
+      stats.txFailed++;  // Bus-off
+    }
+  }
+}
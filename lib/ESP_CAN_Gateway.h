@@ -0,0 +1,97 @@
+/*
+ * ESP_CAN_Gateway.h - Routes frames between the buses of an ESP_CAN_MultiBus.
+ *
+ * Routes match a source bus and an ID/mask and forward to one or more
+ * destination buses, optionally under a new ID and with a minimum interval
+ * per route. compile() expands the route list into a 2048-entry table per
+ * source bus, so routing a frame is a single array lookup whatever the
+ * number of routes; the first matching route wins, as in the list order.
+ *
+ * Each destination has its own TX queue, sent with the non-blocking
+ * ESP_CAN::startFrame(), so transmitting on one bus never stops the others
+ * from being sampled. Forwarding latency is measured from the RX end of
+ * frame to the TX start of frame of the attempt that succeeded.
+ */
+
+#ifndef ESP_CAN_GATEWAY_H
+#define ESP_CAN_GATEWAY_H
+
+#include <Arduino.h>
+#include "ESP_CAN_MultiBus.h"
+#include "ESP_CAN_Queue.h"
+
+#define CAN_GATEWAY_MAX_BUSES 4
+#define CAN_GATEWAY_MAX_ROUTES 32
+#define CAN_GATEWAY_TX_QUEUE 32     // Frames per destination, a power of two
+#define CAN_GATEWAY_ERROR_RETRIES 3 // Attempts after bit or ACK errors
+#define CAN_GATEWAY_KEEP_ID 0xFFFFFFFF
+
+struct CAN_Route {
+  uint8_t srcBus;
+  uint32_t id;             // Matches when (frame.id & mask) == (id & mask)
+  uint32_t mask;
+  uint8_t dstBuses;        // Bit n forwards to bus n
+  uint32_t newId;          // CAN_GATEWAY_KEEP_ID keeps the received ID
+  uint32_t minIntervalUs;  // Frames closer together than this are dropped; 0 = no limit
+};
+
+struct CAN_Gateway_Stats {
+  uint32_t received;        // Frames received on any bus
+  uint32_t forwarded;       // Frames sent and acknowledged on a destination
+  uint32_t unrouted;        // No route matched (or not an 11-bit ID)
+  uint32_t rateLimited;     // Dropped by a route's minimum interval
+  uint32_t queueFull;       // Dropped because a destination queue was full
+  uint32_t txRetries;       // Restarts after lost arbitration or errors
+  uint32_t txFailed;        // Given up after CAN_GATEWAY_ERROR_RETRIES errors
+  uint32_t maxLatencyCycles;
+  uint64_t totalLatencyCycles;
+};
+
+class ESP_CAN_Gateway {
+public:
+  CAN_Gateway_Stats stats;
+
+  ESP_CAN_Gateway(ESP_CAN_MultiBus &buses);
+
+  // Returns the route index, or -1 if the table is full or a bus index is
+  // out of range. Call compile() after changing the routes.
+  int addRoute(const CAN_Route &route);
+  void clearRoutes();
+  void compile();
+
+  // Non-blocking: samples all buses once, routes what was received and
+  // keeps every destination transmitting. Call it back to back.
+  void poll();
+
+  float averageLatencyUs() const;
+  float maxLatencyUs() const;
+  void resetStats();
+
+private:
+  struct Pending {
+    CAN_Frame frame;
+    uint32_t rxCycles;  // End of frame on the source bus
+  };
+
+  ESP_CAN_MultiBus &_buses;
+  CAN_Route _routes[CAN_GATEWAY_MAX_ROUTES];
+  uint64_t _intervalCycles[CAN_GATEWAY_MAX_ROUTES];
+  uint64_t _lastForward[CAN_GATEWAY_MAX_ROUTES];
+  bool _forwardedOnce[CAN_GATEWAY_MAX_ROUTES];
+  int _routeCount;
+  uint64_t _clockCycles;  // Extends the cycle counter past its 32-bit wrap
+
+  // Route index + 1 for every source bus and 11-bit ID; 0 means no route
+  uint8_t _lookup[CAN_GATEWAY_MAX_BUSES][2048];
+
+  CAN_SpscQueue<Pending, CAN_GATEWAY_TX_QUEUE> _txQueues[CAN_GATEWAY_MAX_BUSES];
+  Pending _inFlight[CAN_GATEWAY_MAX_BUSES];
+  bool _sending[CAN_GATEWAY_MAX_BUSES];
+  uint8_t _errorRetries[CAN_GATEWAY_MAX_BUSES];
+
+  void route(int bus, const CAN_Frame &frame, uint32_t rxCycles);
+  bool rateLimited(int route);
+  void serviceTx(int bus);
+};
+
+#endif // ESP_CAN_GATEWAY_H
@@ -0,0 +1,64 @@
+/*
+ * ESP_CAN_MultiBus.cpp - Single-pass sampling of several buses.
+ */
+
+#include "ESP_CAN_MultiBus.h"
+
+#ifdef ESP_PLATFORM
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#endif
+
+ESP_CAN_MultiBus::ESP_CAN_MultiBus() {
+  _count = 0;
+  _highBank = false;
+  _lastPoll = 0;
+}
+
+int ESP_CAN_MultiBus::addBus(ESP_CAN &can) {
+  if (_count == CAN_MULTIBUS_MAX) return -1;
+  _buses[_count] = &can;
+  _rxPins[_count] = can.rxPin();
+  _status[_count] = CAN_READ_NO_MSG;
+  if (can.rxPin() >= 32) _highBank = true;
+  return _count++;
+}
+
+void ESP_CAN_MultiBus::begin(long baudrate, float samplePoint) {
+  for (int i = 0; i < _count; i++) _buses[i]->begin(baudrate, samplePoint);
+}
+
+// All RX levels at one instant, bit n for GPIOn
+uint64_t ESP_CAN_MultiBus::readInputs() const {
+#ifdef GPIO_IN_REG
+  uint64_t in = REG_READ(GPIO_IN_REG);
+#ifdef GPIO_IN1_REG
+  if (_highBank) in |= (uint64_t)REG_READ(GPIO_IN1_REG) << 32;
+#endif
+  return in;
+#else
+  // Host build without a port register: read the pins one by one
+  uint64_t in = 0;
+  for (int i = 0; i < _count; i++) {
+    if (digitalRead(_rxPins[i])) in |= (uint64_t)1 << _rxPins[i];
+  }
+  return in;
+#endif
+}
+
+uint32_t ESP_CAN_MultiBus::poll() {
+  uint32_t now = ESP.getCycleCount();
+  uint64_t in = readInputs();
+  _lastPoll = now;
+  uint32_t ready = 0;
+  for (int i = 0; i < _count; i++) {
+    _status[i] = _buses[i]->pollLevel(now, (in >> _rxPins[i]) & 1, _frames[i]);
+    if (_status[i] != CAN_READ_NO_MSG) ready |= 1u << i;
+  }
+  return ready;
+}
+
+CAN_Read_Status ESP_CAN_MultiBus::result(int index, CAN_Frame &frame) const {
+  if (_status[index] == CAN_READ_MSG_OK) frame = _frames[index];
+  return _status[index];
+}
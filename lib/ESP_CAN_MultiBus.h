@@ -0,0 +1,56 @@
+/*
+ * ESP_CAN_MultiBus.h - Polls several ESP_CAN buses from one GPIO read.
+ *
+ * Each poll() reads the cycle counter once and the GPIO input register once
+ * (twice if an RX pin is above 31), then advances every attached bus with
+ * its bit of that word. One pass therefore costs a single port read plus a
+ * short bit-engine step per bus, instead of a full readFrame() per bus. The
+ * buses share a baud rate but keep independent bit grids, decoders and
+ * error counters.
+ *
+ * sendFrame() on one bus still blocks, and the other buses are not sampled
+ * while it runs. Use this class for monitoring and receive-heavy gateways.
+ */
+
+#ifndef ESP_CAN_MULTIBUS_H
+#define ESP_CAN_MULTIBUS_H
+
+#include <Arduino.h>
+#include "ESP_CAN.h"
+
+#define CAN_MULTIBUS_MAX 8
+
+class ESP_CAN_MultiBus {
+public:
+  ESP_CAN_MultiBus();
+
+  // Attaches a bus and returns its index, or -1 if CAN_MULTIBUS_MAX buses
+  // are already attached.
+  int addBus(ESP_CAN &can);
+  // Calls begin() on every attached bus with the same timing.
+  void begin(long baudrate, float samplePoint = 0.875);
+
+  int count() const { return _count; }
+  ESP_CAN &bus(int index) { return *_buses[index]; }
+
+  // Non-blocking. Samples all buses once and returns a bitmask of the buses
+  // that produced a result (bit i for bus i).
+  uint32_t poll();
+  // Result of bus `index` from the last poll(), as readFrame() would return it.
+  CAN_Read_Status result(int index, CAN_Frame &frame) const;
+  // Cycle count at which the last poll() sampled the buses
+  uint32_t lastPollCycles() const { return _lastPoll; }
+
+private:
+  ESP_CAN *_buses[CAN_MULTIBUS_MAX];
+  uint8_t _rxPins[CAN_MULTIBUS_MAX];
+  CAN_Read_Status _status[CAN_MULTIBUS_MAX];
+  CAN_Frame _frames[CAN_MULTIBUS_MAX];
+  int _count;
+  bool _highBank;      // Some RX pin is GPIO32 or above
+  uint32_t _lastPoll;  // Cycle count of the last poll()
+
+  uint64_t readInputs() const;
+};
+
+#endif // ESP_CAN_MULTIBUS_H
@@ -0,0 +1,61 @@
+/*
+ * ESP_CAN_Queue.h - Lock-free single-producer/single-consumer ring buffer.
+ *
+ * One side only calls push(), the other only pop()/peek(), so the queue
+ * can connect two cores (or a task and an ISR) without a mutex. Head and
+ * tail are free-running 32-bit counters; N must be a power of two.
+ */
+
+#ifndef ESP_CAN_QUEUE_H
+#define ESP_CAN_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint32_t N>
+class CAN_SpscQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "queue size must be a power of two");
+
+public:
+  CAN_SpscQueue() : _head(0), _tail(0) {}
+
+  // Producer side. Returns false if the queue is full.
+  bool push(const T &item) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) == N) return false;
+    _items[head & (N - 1)] = item;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if the queue is empty.
+  bool peek(T &item) const {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (_head.load(std::memory_order_acquire) == tail) return false;
+    item = _items[tail & (N - 1)];
+    return true;
+  }
+
+  bool pop(T &item) {
+    if (!peek(item)) return false;
+    _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Drops the item returned by the last successful peek()
+  void drop() { _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  // Approximate when called from a third context
+  uint32_t size() const {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+  static uint32_t capacity() { return N; }
+
+private:
+  T _items[N];
+  std::atomic<uint32_t> _head;  // Written by the producer only
+  std::atomic<uint32_t> _tail;  // Written by the consumer only
+};
+
+#endif // ESP_CAN_QUEUE_H
@@ -0,0 +1,109 @@
+/*
+ * ESP_CAN_Render.h - Renders frames into an oversampled bit buffer.
+ *
+ * I2S or SPI with DMA can play a buffer of samples on the TX pin at a
+ * fixed rate. With the sample rate set to OVERSAMPLE times the bit rate,
+ * CAN_BurstRenderer fills that buffer with one frame or a whole burst:
+ * the stuffed bits, the recessive tail (CRC delimiter, ACK slot, ACK
+ * delimiter, EOF) and the intermission. Eight bus bits at a time index a
+ * table of precomputed sample patterns, so rendering is one copy of
+ * OVERSAMPLE / 4 words per byte of bus bits.
+ *
+ * Like the RMT, DMA output plays open loop, with no arbitration or bit
+ * monitoring; see ESP_CAN_RmtTx.h. Depends on ESP_CAN_Waveform.h and the C
+ * library only, so it builds without Arduino.
+ */
+
+#ifndef ESP_CAN_RENDER_H
+#define ESP_CAN_RENDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "ESP_CAN_Waveform.h"
+
+#define CAN_RENDER_TAIL_BITS 10       // CRC delimiter, ACK slot, ACK delimiter, EOF
+#define CAN_RENDER_INTERMISSION_BITS 3
+
+template <uint8_t OVERSAMPLE>
+class CAN_BurstRenderer {
+  static_assert(OVERSAMPLE == 4 || OVERSAMPLE == 8 || OVERSAMPLE == 16 || OVERSAMPLE == 32,
+                "OVERSAMPLE must be 4, 8, 16 or 32");
+
+public:
+  static const int WORDS_PER_BYTE = OVERSAMPLE / 4;  // 8 bits * OVERSAMPLE samples / 32
+
+  // msbFirst: the first sample goes out in bit 31 of each word, as I2S and
+  // SPI shift. Otherwise bit 0 first, as in ESP_CAN_SampleFormat.h.
+  explicit CAN_BurstRenderer(bool msbFirst = true) {
+    for (int b = 0; b < 256; b++) {
+      uint32_t *entry = _table[b];
+      memset(entry, 0, sizeof(_table[b]));
+      for (int s = 0; s < 8 * OVERSAMPLE; s++) {
+        if (!((b >> (s / OVERSAMPLE)) & 1)) continue;
+        entry[s / 32] |= (uint32_t)1 << (msbFirst ? 31 - s % 32 : s % 32);
+      }
+    }
+    start(NULL, 0);
+  }
+
+  // Starts a burst in `buffer`, which holds `words` words.
+  void start(uint32_t *buffer, size_t words) {
+    _out = buffer;
+    _capacity = words;
+    _used = 0;
+    _acc = 0;
+    _accBits = 0;
+  }
+
+  // Appends a frame, its tail and the intermission. Returns false, and
+  // appends nothing, if the frame does not fit.
+  bool frame(const CAN_Waveform &wave) {
+    size_t bits = wave.length + CAN_RENDER_TAIL_BITS + CAN_RENDER_INTERMISSION_BITS;
+    if (wordsFor(_accBits + bits) > _capacity - _used) return false;
+    for (int w = 0; w < 4 && w * 32 < wave.length; w++) {
+      int n = wave.length - w * 32 < 32 ? wave.length - w * 32 : 32;
+      put(wave.words[w], n);
+    }
+    put(0xFFFFFFFF, CAN_RENDER_TAIL_BITS + CAN_RENDER_INTERMISSION_BITS);
+    return true;
+  }
+  bool frame(const CAN_Frame &f) { return frame(can_encode_waveform(f)); }
+
+  // Appends recessive bits, e.g. to space frames out or to lead in.
+  bool idle(size_t bits) {
+    if (wordsFor(_accBits + bits) > _capacity - _used) return false;
+    for (; bits > 32; bits -= 32) put(0xFFFFFFFF, 32);
+    put(0xFFFFFFFF, bits);
+    return true;
+  }
+
+  // Pads the last byte of bus bits with recessive bits and renders it.
+  // Returns the number of words used.
+  size_t finish() {
+    if (_accBits > 0) put(0xFFFFFFFF, 8 - _accBits);
+    return _used;
+  }
+
+  // Words needed for `bits` bus bits, rounded up to whole bytes of bits.
+  static size_t wordsFor(size_t bits) { return (bits + 7) / 8 * WORDS_PER_BYTE; }
+
+private:
+  uint32_t _table[256][WORDS_PER_BYTE];  // Samples of each byte of bus bits, bit 0 first
+  uint32_t *_out;
+  size_t _capacity;
+  size_t _used;
+  uint64_t _acc;  // Bus bits not yet rendered, first one in bit 0
+  int _accBits;   // Always < 8 between calls
+
+  // Appends n <= 32 bits of `bits`, bit 0 first, and renders whole bytes.
+  void put(uint32_t bits, int n) {
+    _acc |= (uint64_t)(bits & (uint32_t)(((uint64_t)1 << n) - 1)) << _accBits;
+    for (_accBits += n; _accBits >= 8; _accBits -= 8, _acc >>= 8) {
+      memcpy(_out + _used, _table[_acc & 0xFF], sizeof(_table[0]));
+      _used += WORDS_PER_BYTE;
+    }
+  }
+};
+
+#endif // ESP_CAN_RENDER_H
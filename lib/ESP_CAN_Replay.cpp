@@ -0,0 +1,267 @@
+/*
+ * ESP_CAN_Replay.cpp - Implementation of the candump/ASC log replay engine.
+ */
+
+#include "ESP_CAN_Replay.h"
+
+static int hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+static const char *skipSpaces(const char *p) {
+  while (*p == ' ' || *p == '\t') p++;
+  return p;
+}
+
+// "1436509052.249713" -> microseconds, without going through a double.
+static const char *parseTimestamp(const char *p, uint64_t &us) {
+  if (*p < '0' || *p > '9') return NULL;
+  uint64_t seconds = 0;
+  while (*p >= '0' && *p <= '9') seconds = seconds * 10 + (*p++ - '0');
+  uint32_t fraction = 0;
+  int digits = 0;
+  if (*p == '.') {
+    p++;
+    while (*p >= '0' && *p <= '9') {
+      if (digits < 6) { fraction = fraction * 10 + (*p - '0'); digits++; }
+      p++;
+    }
+  }
+  for (; digits < 6; digits++) fraction *= 10;
+  us = seconds * 1000000 + fraction;
+  return p;
+}
+
+ESP_CAN_Replay::ESP_CAN_Replay(ESP_CAN &can, Stream &log) : _can(can), _log(log) {
+  begin(CAN_REPLAY_TRANSMIT, CAN_REPLAY_ORIGINAL);
+}
+
+void ESP_CAN_Replay::begin(CAN_Replay_Target target, CAN_Replay_Timing timing, float speed) {
+  _target = target;
+  _timing = timing;
+  // Fixed point keeps the scaled due time exact on logs of any length
+  if (!(speed > 0)) speed = 1.0;
+  _speedQ16 = speed >= 65535.0f ? 0xFFFFFFFFu : (uint32_t)(speed * 65536.0f + 0.5f);
+  if (_speedQ16 == 0) _speedQ16 = 1;
+  _ascHex = true;
+  _done = false;
+  _finished = false;
+  _lineLen = 0;
+  _linePartial = false;
+  _lastByteMs = millis();
+  _havePending = false;
+  _handedOff = false;
+  _started = false;
+  memset(&stats, 0, sizeof(stats));
+}
+
+bool ESP_CAN_Replay::poll() {
+  if (_done) return false;
+
+  while (!_havePending) {
+    LineResult line = readLine();
+    if (line == LINE_WAIT) return true;
+    if (line == LINE_END) {
+      _done = true;
+      return false;
+    }
+    if (parseLine(_pending, _pendingTs)) _havePending = true;
+    else stats.linesSkipped++;
+  }
+
+  unsigned long now = micros();
+  if (!_started) {
+    _started = true;
+    _firstTs = _pendingTs;
+    _clockUs = 0;
+    _lastMicros = now;
+  }
+  _clockUs += (unsigned long)(now - _lastMicros);
+  _lastMicros = now;
+
+  // Out-of-order timestamps are sent immediately rather than rewinding the clock
+  uint64_t logOffset = _pendingTs > _firstTs ? _pendingTs - _firstTs : 0;
+  uint64_t dueUs = 0;
+  if (_timing == CAN_REPLAY_ORIGINAL) dueUs = logOffset;
+  else if (_timing == CAN_REPLAY_SCALED) dueUs = (logOffset << 16) / _speedQ16;
+
+  if (_clockUs < dueUs) return true;
+
+  bool ok = true;
+  if (!_handedOff) {
+    if (_target == CAN_REPLAY_TRANSMIT) {
+      // startFrame() waits for the bus to be idle, so poll() never blocks
+      // for a frame or a lost arbitration
+      if (!_can.startFrame(_pending)) {
+        CAN_Tx_State tx = _can.txState();
+        if (tx != CAN_TX_WAITING && tx != CAN_TX_SENDING) ok = false; // Bus-off or listen-only
+        else return driveBus(); // A frame the application started is still on its way
+      }
+    } else if (!_can.injectFrame(_pending)) {
+      // A full inject queue means the application has not read yet; retry later
+      return true;
+    }
+    _handedOff = ok;
+    if (_timing != CAN_REPLAY_FAST && _clockUs - dueUs > stats.maxLatenessUs) {
+      stats.maxLatenessUs = _clockUs - dueUs;
+    }
+    if (logOffset > stats.logSpanUs) stats.logSpanUs = logOffset;
+    stats.elapsedUs = _clockUs;
+  }
+  if (_handedOff && _target == CAN_REPLAY_TRANSMIT) {
+    driveBus();
+    CAN_Tx_State tx = _can.txState();
+    if (tx == CAN_TX_WAITING || tx == CAN_TX_SENDING) return true;
+    ok = tx == CAN_TX_DONE;
+  }
+
+  if (ok) stats.framesSent++; else stats.framesFailed++;
+  _handedOff = false;
+  _havePending = false;
+  return true;
+}
+
+void ESP_CAN_Replay::finish() {
+  _finished = true;
+}
+
+// One bit-engine step for a frame on its way. What is received meanwhile is
+// counted, not returned to the application.
+bool ESP_CAN_Replay::driveBus() {
+  CAN_Frame frame;
+  if (_can.readFrame(frame) == CAN_READ_MSG_OK) stats.framesReceived++;
+  return true;
+}
+
+float ESP_CAN_Replay::requestedRate() const {
+  uint32_t frames = stats.framesSent + stats.framesFailed;
+  if (_timing == CAN_REPLAY_FAST || frames < 2 || stats.logSpanUs == 0) return 0; // Unbounded
+  float span = (float)stats.logSpanUs / 1e6f;
+  if (_timing == CAN_REPLAY_SCALED) span = span * 65536.0f / _speedQ16;
+  return (frames - 1) / span;
+}
+
+float ESP_CAN_Replay::achievedRate() const {
+  uint32_t frames = stats.framesSent + stats.framesFailed;
+  if (frames < 2 || stats.elapsedUs == 0) return 0;
+  return (frames - 1) / ((float)stats.elapsedUs / 1e6f);
+}
+
+// --- LOG PARSING ---
+
+// Collects bytes into _line across calls until the '\n' arrives.
+ESP_CAN_Replay::LineResult ESP_CAN_Replay::readLine() {
+  bool newline = false;
+  while (!newline && _log.available() > 0) {
+    int c = _log.read();
+    if (c < 0) break;
+    _linePartial = true;
+    _lastByteMs = millis();
+    if (c == '\n') newline = true;
+    else if (c != '\r' && _lineLen < (int)sizeof(_line) - 1) _line[_lineLen++] = (char)c; // Overlong lines are truncated
+  }
+  // No bytes yet is not the end: a serial port or socket may be between
+  // packets. The log ends once it has been quiet for the stream's timeout,
+  // or at once after finish().
+  bool ended = _finished || millis() - _lastByteMs >= _log.getTimeout();
+  if (!_linePartial) return ended ? LINE_END : LINE_WAIT;
+  if (!newline && !ended) return LINE_WAIT;
+
+  _line[_lineLen] = '\0';
+  _lineLen = 0;
+  _linePartial = false;
+  return LINE_READY;
+}
+
+bool ESP_CAN_Replay::parseLine(CAN_Frame &frame, uint64_t &timestampUs) {
+  const char *p = skipSpaces(_line);
+  if (*p == '(') return parseCandump(p + 1, frame, timestampUs);
+
+  // ASC header: "base hex  timestamps absolute"
+  if (strncmp(p, "base ", 5) == 0) {
+    _ascHex = strncmp(skipSpaces(p + 5), "hex", 3) == 0;
+    return false;
+  }
+  return parseAsc(p, frame, timestampUs);
+}
+
+// (1436509052.249713) can0 123#DEADBEEF
+bool ESP_CAN_Replay::parseCandump(const char *p, CAN_Frame &frame, uint64_t &timestampUs) {
+  p = parseTimestamp(p, timestampUs);
+  if (!p || *p != ')') return false;
+  p = skipSpaces(p + 1);
+  while (*p && *p != ' ' && *p != '\t') p++; // Interface name
+  p = skipSpaces(p);
+
+  uint32_t id = 0;
+  int idDigits = 0;
+  int d;
+  while ((d = hexDigit(*p)) >= 0) { id = (id << 4) | d; idDigits++; p++; }
+  if (*p != '#' || idDigits != 3 || id > 0x7FF) return false; // 8 digits = extended
+  p++;
+  if (*p == '#') return false; // CAN FD
+
+  // 123#R, or 123#R4 with the DLC requested
+  if (*p == 'R') {
+    int dlc = hexDigit(p[1]);
+    if (dlc > 8) return false;
+    frame.id = id | CAN_RTR_FLAG;
+    frame.dlc = dlc > 0 ? dlc : 0;
+    return true;
+  }
+
+  frame.id = id;
+  frame.dlc = 0;
+  while (frame.dlc < 8) {
+    if (*p == '.') p++;
+    int hi = hexDigit(p[0]);
+    int lo = hi >= 0 ? hexDigit(p[1]) : -1;
+    if (lo < 0) break;
+    frame.data[frame.dlc++] = (hi << 4) | lo;
+    p += 2;
+  }
+  return true;
+}
+
+// 0.010000 1  123             Rx   d 4 DE AD BE EF  Length = ...
+// 0.010000 1  123             Rx   r 4                remote, DLC optional
+bool ESP_CAN_Replay::parseAsc(const char *p, CAN_Frame &frame, uint64_t &timestampUs) {
+  p = parseTimestamp(p, timestampUs);
+  if (!p) return false;
+  char *end;
+  strtoul(skipSpaces(p), &end, 10); // Channel
+  if (end == skipSpaces(p)) return false;
+  p = skipSpaces(end);
+
+  uint32_t id = strtoul(p, &end, _ascHex ? 16 : 10);
+  if (end == p || *end == 'x' || id > 0x7FF) return false; // "123x" = extended
+  p = skipSpaces(end);
+
+  if (strncmp(p, "Rx", 2) == 0 || strncmp(p, "Tx", 2) == 0) p = skipSpaces(p + 2);
+  if (*p != 'd' && *p != 'r') return false;
+  bool remote = *p == 'r';
+  p = skipSpaces(p + 1);
+
+  unsigned long dlc = strtoul(p, &end, 16);
+  if (end == p && remote) dlc = 0;
+  else if (end == p || dlc > 8) return false;
+  if (remote) {
+    frame.id = id | CAN_RTR_FLAG;
+    frame.dlc = dlc;
+    return true;
+  }
+  p = end;
+
+  frame.id = id;
+  frame.dlc = dlc;
+  for (unsigned long i = 0; i < dlc; i++) {
+    unsigned long value = strtoul(p, &end, _ascHex ? 16 : 10);
+    if (end == p || value > 0xFF) return false;
+    frame.data[i] = value;
+    p = end;
+  }
+  return true;
+}
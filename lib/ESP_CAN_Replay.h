@@ -0,0 +1,106 @@
+/*
+ * ESP_CAN_Replay.h - Replays recorded CAN traffic through ESP_CAN.
+ *
+ * Reads candump log lines ("(1436509052.249713) can0 123#DEADBEEF") and
+ * Vector ASC lines ("0.010000 1  123  Rx   d 4 DE AD BE EF") from any Stream,
+ * typically a File on SD/LittleFS, one line at a time so logs of any size can
+ * be replayed. Frames are either transmitted with sendFrame() or injected
+ * into the receive path with injectFrame().
+ *
+ * A line is used once its '\n' has arrived, so a log streamed over a serial
+ * port or socket may arrive in pieces, with pauses between them. The log
+ * ends once the stream has had no bytes for its timeout (Stream::
+ * setTimeout(), 1000 ms by default), or as soon as it is empty after
+ * finish(). A last line without '\n' counts at that point. For a File,
+ * setTimeout(0) ends the replay at its last byte.
+ *
+ * The TRANSMIT target queues each frame with startFrame(), which waits for
+ * the bus to be idle, and poll() drives the bit engine with readFrame()
+ * until the frame is done. Frames received meanwhile are counted in
+ * stats.framesReceived and not returned to the application.
+ *
+ * Remote frames ("123#R4", ASC "r 4") are replayed with CAN_RTR_FLAG set.
+ * Lines that are not 11-bit data or remote frames (headers, extended,
+ * CAN FD, error frames) are skipped and counted.
+ */
+
+#ifndef ESP_CAN_REPLAY_H
+#define ESP_CAN_REPLAY_H
+
+#include <Arduino.h>
+#include "ESP_CAN.h"
+
+enum CAN_Replay_Target {
+  CAN_REPLAY_TRANSMIT,  // Send each frame on the bus with sendFrame()
+  CAN_REPLAY_INJECT     // Hand each frame to readFrame() via injectFrame()
+};
+
+enum CAN_Replay_Timing {
+  CAN_REPLAY_ORIGINAL,  // Reproduce the recorded inter-frame gaps
+  CAN_REPLAY_SCALED,    // Recorded gaps divided by the speed factor
+  CAN_REPLAY_FAST       // As fast as the target accepts frames
+};
+
+struct CAN_Replay_Stats {
+  uint32_t framesSent;      // Frames handed to the target successfully
+  uint32_t framesFailed;    // Not sent: lost arbitration, error, or bus-off
+  uint32_t framesReceived;  // Read from the bus while a frame was on its way
+  uint32_t linesSkipped;    // Lines that were not replayable frames
+  uint32_t maxLatenessUs;   // Worst delay between due time and hand-off
+  uint64_t logSpanUs;       // Log time between first and last replayed frame
+  uint64_t elapsedUs;       // Wall time between first and last hand-off
+};
+
+class ESP_CAN_Replay {
+public:
+  CAN_Replay_Stats stats;
+
+  ESP_CAN_Replay(ESP_CAN &can, Stream &log);
+
+  void begin(CAN_Replay_Target target, CAN_Replay_Timing timing, float speed = 1.0);
+
+  // Non-blocking: hands the next frame to the target once it is due.
+  // Returns false when the log is exhausted.
+  bool poll();
+
+  // No more bytes will be added to the stream: the replay ends as soon as
+  // it has read them all.
+  void finish();
+
+  // Frames per second implied by the log and the timing mode, and the rate
+  // actually achieved so far.
+  float requestedRate() const;
+  float achievedRate() const;
+
+private:
+  ESP_CAN &_can;
+  Stream &_log;
+  CAN_Replay_Target _target;
+  CAN_Replay_Timing _timing;
+  uint32_t _speedQ16;       // Speed factor, 16.16 fixed point
+  bool _ascHex;
+  bool _done;
+  bool _finished;           // finish() was called
+
+  enum LineResult { LINE_READY, LINE_WAIT, LINE_END };
+  char _line[160];
+  int _lineLen;
+  bool _linePartial;        // Part of a line is in _line, waiting for '\n'
+  unsigned long _lastByteMs; // millis() when the last byte arrived
+  bool _havePending;
+  bool _handedOff;          // _pending was started or injected
+  CAN_Frame _pending;
+  uint64_t _pendingTs;
+  bool _started;
+  uint64_t _firstTs;
+  uint64_t _clockUs;        // Replay clock, extends micros() past its 32-bit wrap
+  unsigned long _lastMicros;
+
+  LineResult readLine();
+  bool driveBus();
+  bool parseLine(CAN_Frame &frame, uint64_t &timestampUs);
+  bool parseCandump(const char *p, CAN_Frame &frame, uint64_t &timestampUs);
+  bool parseAsc(const char *p, CAN_Frame &frame, uint64_t &timestampUs);
+};
+
+#endif // ESP_CAN_REPLAY_H
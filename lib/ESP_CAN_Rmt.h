@@ -0,0 +1,102 @@
+/*
+ * ESP_CAN_Rmt.h - A frame as run-length (level, duration) symbols.
+ *
+ * The ESP32 RMT peripheral plays a list of 32-bit symbols, each holding
+ * two (duration, level) pairs, with tick-exact timing and no CPU. This
+ * turns a CAN_Waveform into that list: each run of equal bits becomes one
+ * pair. Edges are placed at round(k * resolution / bitrate) for bit k, so
+ * a fractional number of ticks per bit does not drift over the frame. Runs
+ * longer than the 15-bit duration field are split.
+ *
+ * can_rmt_to_bits() goes the other way, sampling the symbols at every bit
+ * centre, to verify an encoding on the host. ESP_CAN_RmtTx plays the
+ * symbols on the device. Depends on ESP_CAN_Waveform.h only, so it builds
+ * without Arduino.
+ */
+
+#ifndef ESP_CAN_RMT_H
+#define ESP_CAN_RMT_H
+
+#include <stdint.h>
+#include "ESP_CAN_Waveform.h"
+
+// Recessive bits after the CRC: CRC delimiter, ACK slot, ACK delimiter and
+// EOF. The transmitter leaves the ACK slot recessive.
+#define CAN_RMT_TAIL_BITS 10
+#define CAN_RMT_MAX_DURATION 32767
+// Worst case: every run a single bit (SOF to CRC plus a stuff bit every
+// four bits) and the tail split once. Each symbol holds two runs.
+#define CAN_RMT_MAX_SYMBOLS 72
+
+// Same layout as rmt_item32_t / rmt_data_t. A zero duration ends the list.
+struct CAN_RmtSymbol {
+  uint32_t duration0 : 15;
+  uint32_t level0 : 1;
+  uint32_t duration1 : 15;
+  uint32_t level1 : 1;
+};
+
+static_assert(sizeof(CAN_RmtSymbol) == 4, "CAN_RmtSymbol must match the 32-bit RMT item");
+
+// Tick at which bit k starts.
+inline uint32_t can_rmt_edge(uint32_t k, uint32_t resolutionHz, uint32_t bitrate) {
+  return (uint32_t)(((uint64_t)k * resolutionHz + bitrate / 2) / bitrate);
+}
+
+// Encodes `wave` plus tailBits recessive bits. Returns the number of
+// symbols written, or 0 if more than maxSymbols are needed. An odd number
+// of runs leaves a zero-duration end marker in the last symbol.
+inline int can_rmt_encode(const CAN_Waveform &wave, uint32_t resolutionHz, uint32_t bitrate, CAN_RmtSymbol *out,
+                          int maxSymbols, int tailBits = CAN_RMT_TAIL_BITS) {
+  int total = wave.length + tailBits;
+  int halves = 0;
+  for (int i = 0; i < total;) {
+    bool level = i < wave.length ? wave.bit(i) : true;
+    int j = i + 1;
+    while (j < total && (j < wave.length ? wave.bit(j) : true) == level) j++;
+    uint32_t ticks = can_rmt_edge(j, resolutionHz, bitrate) - can_rmt_edge(i, resolutionHz, bitrate);
+    while (ticks > 0) {
+      uint32_t d = ticks > CAN_RMT_MAX_DURATION ? CAN_RMT_MAX_DURATION : ticks;
+      if (halves / 2 >= maxSymbols) return 0;
+      CAN_RmtSymbol &s = out[halves / 2];
+      if (halves % 2 == 0) {
+        s.duration0 = d;
+        s.level0 = level;
+        s.duration1 = 0;
+        s.level1 = level;
+      } else {
+        s.duration1 = d;
+        s.level1 = level;
+      }
+      halves++;
+      ticks -= d;
+    }
+    i = j;
+  }
+  return (halves + 1) / 2;
+}
+
+// Samples the symbols at the centre of each bit, as a receiver would.
+// Returns the number of bits written (at most maxBits); the list ends at
+// the first zero duration or after `count` symbols.
+inline int can_rmt_to_bits(const CAN_RmtSymbol *symbols, int count, uint32_t resolutionHz, uint32_t bitrate,
+                           bool *bits, int maxBits) {
+  uint32_t runStart = 0;
+  int n = 0;
+  for (int i = 0; i < count * 2; i++) {
+    const CAN_RmtSymbol &s = symbols[i / 2];
+    uint32_t duration = i % 2 ? s.duration1 : s.duration0;
+    bool level = i % 2 ? s.level1 : s.level0;
+    if (duration == 0) break;
+    uint32_t runEnd = runStart + duration;
+    for (;;) {
+      uint32_t centre = (can_rmt_edge(n, resolutionHz, bitrate) + can_rmt_edge(n + 1, resolutionHz, bitrate)) / 2;
+      if (n >= maxBits || centre >= runEnd) break;
+      bits[n++] = level;
+    }
+    runStart = runEnd;
+  }
+  return n;
+}
+
+#endif // ESP_CAN_RMT_H
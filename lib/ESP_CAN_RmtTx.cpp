@@ -0,0 +1,62 @@
+/*
+ * ESP_CAN_RmtTx.cpp - RMT transmit backend.
+ */
+
+#include "ESP_CAN_RmtTx.h"
+
+#if defined(ESP_PLATFORM) && defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+#define CAN_HAVE_RMT 1
+static_assert(sizeof(rmt_data_t) == sizeof(CAN_RmtSymbol), "RMT symbol layout changed");
+#endif
+
+ESP_CAN_RmtTx::ESP_CAN_RmtTx(int txPin) {
+  _txPin = txPin;
+  _bitrate = 0;
+  _ready = false;
+  _lastSendCycles = 0;
+}
+
+bool ESP_CAN_RmtTx::begin(long bitrate) {
+  _bitrate = bitrate;
+#ifdef CAN_HAVE_RMT
+  // Recessive between frames
+  _ready = rmtInit(_txPin, RMT_TX_MODE, RMT_MEM_NUM_BLOCKS_2, CAN_RMT_RESOLUTION_HZ) && rmtSetEOT(_txPin, HIGH);
+#else
+  _ready = false;
+#endif
+  return _ready;
+}
+
+bool ESP_CAN_RmtTx::busy() {
+#ifdef CAN_HAVE_RMT
+  return _ready && !rmtTransmitCompleted(_txPin);
+#else
+  return false;
+#endif
+}
+
+bool ESP_CAN_RmtTx::send(const CAN_Frame &frame) {
+  uint32_t start = ESP.getCycleCount();
+  if (!_ready || busy()) return false;
+  bool ok = play(can_encode_waveform(frame));
+  _lastSendCycles = ESP.getCycleCount() - start;
+  return ok;
+}
+
+bool ESP_CAN_RmtTx::sendPrecomputed(const CAN_PrecomputedFrame &frame) {
+  uint32_t start = ESP.getCycleCount();
+  if (!_ready || busy()) return false;
+  bool ok = play(frame.waveform);
+  _lastSendCycles = ESP.getCycleCount() - start;
+  return ok;
+}
+
+bool ESP_CAN_RmtTx::play(const CAN_Waveform &wave) {
+  int count = can_rmt_encode(wave, CAN_RMT_RESOLUTION_HZ, _bitrate, _symbols, CAN_RMT_MAX_SYMBOLS);
+  if (count == 0) return false;
+#ifdef CAN_HAVE_RMT
+  return rmtWriteAsync(_txPin, (rmt_data_t *)_symbols, count);
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,51 @@
+/*
+ * ESP_CAN_RmtTx.h - Plays frames on the TX pin with the RMT peripheral.
+ *
+ * The frame is encoded into RMT symbols (ESP_CAN_Rmt.h) and handed to the
+ * RMT, which clocks it out with tick-exact timing while the CPU does other
+ * work. The CPU cost per frame is the encode plus starting the transfer.
+ *
+ * The RMT plays open loop: it does not watch the bus, so it cannot back
+ * off after losing arbitration or stop on a bit error. Use it where this
+ * node never contends for the bus (a test-bench stimulus, a single-master
+ * bus or a reserved time slot) and start a frame only while the bus is
+ * idle. For RX alongside it, run ESP_CAN in listen-only mode so that both
+ * do not drive the same pin.
+ *
+ * Needs the RMT API of Arduino-ESP32 3.x; elsewhere begin() returns false.
+ */
+
+#ifndef ESP_CAN_RMT_TX_H
+#define ESP_CAN_RMT_TX_H
+
+#include <Arduino.h>
+#include "ESP_CAN_Rmt.h"
+
+#define CAN_RMT_RESOLUTION_HZ 20000000  // 50 ns ticks: 20 per bit at 1 Mbit/s
+
+class ESP_CAN_RmtTx {
+public:
+  ESP_CAN_RmtTx(int txPin);
+
+  bool begin(long bitrate);
+
+  // Encodes and starts the frame. Returns false while the previous frame
+  // is still playing, or if begin() failed.
+  bool send(const CAN_Frame &frame);
+  bool sendPrecomputed(const CAN_PrecomputedFrame &frame);
+  bool busy();
+
+  // CPU cycles the last send() took, encode included.
+  uint32_t lastSendCycles() const { return _lastSendCycles; }
+
+private:
+  int _txPin;
+  long _bitrate;
+  bool _ready;
+  uint32_t _lastSendCycles;
+  CAN_RmtSymbol _symbols[CAN_RMT_MAX_SYMBOLS];  // Read by the RMT while it plays
+
+  bool play(const CAN_Waveform &wave);
+};
+
+#endif // ESP_CAN_RMT_TX_H
@@ -0,0 +1,262 @@
+/*
+ * ESP_CAN_SLCAN.cpp - Implementation of the SLCAN serial bridge.
+ */
+
+#include "ESP_CAN_SLCAN.h"
+
+#define SLCAN_OK "\r"
+#define SLCAN_ERROR "\a"
+
+static const long SLCAN_BITRATES[] = {10000, 20000, 50000, 100000, 125000, 250000, 500000, 800000, 1000000};
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// Parses `digits` hex characters; returns -1 on a non-hex character.
+static long parseHex(const char *s, int digits) {
+  long value = 0;
+  for (int i = 0; i < digits; i++) {
+    int v = hexValue(s[i]);
+    if (v < 0) return -1;
+    value = (value << 4) | v;
+  }
+  return value;
+}
+
+ESP_CAN_SLCAN::ESP_CAN_SLCAN(ESP_CAN &can, Stream &serial) : _can(can), _serial(serial) {
+  dropped = 0;
+  _open = false;
+  _timestamps = false;
+  _binary = false;
+  _baudrate = 125000;
+  _cmdLen = 0;
+  _batchCount = 0;
+  _encodedLength = 0;
+  _encodedSent = 0;
+  _batchSequence = 0;
+  _batchStartUs = 0;
+  _batchTimeoutUs = 2000;
+}
+
+void ESP_CAN_SLCAN::setBatchTimeout(unsigned long timeoutUs) {
+  _batchTimeoutUs = timeoutUs;
+}
+
+void ESP_CAN_SLCAN::poll() {
+  // --- Host commands ---
+  while (_serial.available() > 0) {
+    char c = (char)_serial.read();
+    if (c == '\r' || c == '\n') {
+      if (_cmdLen > 0) handleCommand();
+      _cmdLen = 0;
+    } else if (_cmdLen < (int)sizeof(_cmd) - 1) {
+      _cmd[_cmdLen++] = c;
+    } else {
+      _cmdLen = 0; // Overlong command, discard it
+      reply(SLCAN_ERROR);
+    }
+  }
+
+  drainEncoded();
+  if (!_open) return;
+
+  // --- Bus to host ---
+  // readFrame() leaves `frame` alone on an error, so an error record is all
+  // zeros apart from its flag.
+  CAN_Frame frame = {};
+  CAN_Read_Status status = _can.readFrame(frame);
+  if (status == CAN_READ_MSG_OK) {
+    if (_binary) forwardBinary(frame, micros(), 0);
+    else forwardText(frame, micros());
+  } else if (status == CAN_READ_ERROR && _binary) {
+    forwardBinary(frame, micros(), CAN_BATCH_FLAG_ERROR);
+  }
+
+  if (_binary && _batchCount > 0 && micros() - _batchStartUs >= _batchTimeoutUs) {
+    flushBatch();
+  }
+}
+
+// --- COMMANDS ---
+
+void ESP_CAN_SLCAN::handleCommand() {
+  _cmd[_cmdLen] = '\0';
+  switch (_cmd[0]) {
+    case 'S': { // Sn: set standard bitrate, only while closed
+      int index = _cmd[1] - '0';
+      if (_open || _cmdLen != 2 || index < 0 || index > 8) { reply(SLCAN_ERROR); return; }
+      _baudrate = SLCAN_BITRATES[index];
+      reply(SLCAN_OK);
+      return;
+    }
+    case 'O':
+      if (_open) { reply(SLCAN_ERROR); return; }
+      _can.begin(_baudrate);
+      _open = true;
+      reply(SLCAN_OK);
+      return;
+    case 'C':
+      if (_binary && _batchCount > 0) flushBatch();
+      _open = false;
+      reply(SLCAN_OK);
+      return;
+    case 't':
+    case 'r':
+      if (!_open) { reply(SLCAN_ERROR); return; }
+      reply(transmit(_cmd, _cmdLen) ? "z\r" : SLCAN_ERROR);
+      return;
+    case 'Z': // Z0/Z1: millisecond timestamps on received text frames
+      if (_cmd[1] != '0' && _cmd[1] != '1') { reply(SLCAN_ERROR); return; }
+      _timestamps = (_cmd[1] == '1');
+      reply(SLCAN_OK);
+      return;
+    case 'B': // B0/B1: binary batch mode for received frames (extension)
+      if (_cmd[1] != '0' && _cmd[1] != '1') { reply(SLCAN_ERROR); return; }
+      if (_binary && _batchCount > 0) flushBatch();
+      _binary = (_cmd[1] == '1');
+      reply(SLCAN_OK);
+      return;
+    case 'F': { // Status flags: 0x08 overrun, 0x20 error passive, 0x80 bus error
+      uint8_t flags = 0;
+      if (dropped > 0) flags |= 0x08;
+      if (_can.state == CAN_STATE_ERROR_PASSIVE) flags |= 0x20;
+      if (_can.state == CAN_STATE_BUS_OFF) flags |= 0x80;
+      char text[5] = {'F', HEX_DIGITS[flags >> 4], HEX_DIGITS[flags & 0x0F], '\r', '\0'};
+      reply(text);
+      return;
+    }
+    case 'V':
+      reply("V1010\r");
+      return;
+    case 'N':
+      reply("NESP1\r");
+      return;
+    case 'M': // Acceptance code/mask: accepted, filtering is left to the host
+    case 'm':
+      reply(SLCAN_OK);
+      return;
+    default: // Extended frames (T, R) are not supported
+      reply(SLCAN_ERROR);
+      return;
+  }
+}
+
+// tiiildd...: standard data frame, riiil: standard remote frame. The frame
+// is queued with startFrame() and sent by the readFrame() calls in poll(),
+// so a busy bus never stalls the command loop. Fails while the previous
+// frame is still waiting or being sent.
+bool ESP_CAN_SLCAN::transmit(const char *cmd, int len) {
+  if (len < 5) return false;
+  bool remote = cmd[0] == 'r';
+  long id = parseHex(cmd + 1, 3);
+  long dlc = parseHex(cmd + 4, 1);
+  if (id < 0 || id > 0x7FF || dlc < 0 || dlc > 8 || len != 5 + (remote ? 0 : dlc * 2)) return false;
+
+  CAN_Frame frame;
+  frame.id = remote ? id | CAN_RTR_FLAG : id;
+  frame.dlc = dlc;
+  for (int i = 0; i < (remote ? 0 : dlc); i++) {
+    long value = parseHex(cmd + 5 + i * 2, 2);
+    if (value < 0) return false;
+    frame.data[i] = value;
+  }
+  return _can.startFrame(frame);
+}
+
+void ESP_CAN_SLCAN::reply(const char *text) {
+  // Bytes inside a COBS frame would corrupt it
+  if (_encodedSent < _encodedLength) {
+    _serial.write(_encoded + _encodedSent, _encodedLength - _encodedSent);
+    _encodedSent = _encodedLength;
+  }
+  _serial.write((const uint8_t *)text, strlen(text));
+}
+
+// --- FORWARDING ---
+
+void ESP_CAN_SLCAN::forwardText(const CAN_Frame &frame, unsigned long timestampUs) {
+  // Whole line is formatted into one buffer and written once.
+  char line[32];
+  int n = 0;
+  bool remote = can_is_remote(frame);
+  line[n++] = remote ? 'r' : 't';
+  line[n++] = HEX_DIGITS[(frame.id >> 8) & 0x07];
+  line[n++] = HEX_DIGITS[(frame.id >> 4) & 0x0F];
+  line[n++] = HEX_DIGITS[frame.id & 0x0F];
+  line[n++] = HEX_DIGITS[frame.dlc & 0x0F];
+  for (int i = 0; i < (remote ? 0 : frame.dlc); i++) {
+    line[n++] = HEX_DIGITS[frame.data[i] >> 4];
+    line[n++] = HEX_DIGITS[frame.data[i] & 0x0F];
+  }
+  if (_timestamps) {
+    uint16_t ms = (timestampUs / 1000) % 60000;
+    line[n++] = HEX_DIGITS[(ms >> 12) & 0x0F];
+    line[n++] = HEX_DIGITS[(ms >> 8) & 0x0F];
+    line[n++] = HEX_DIGITS[(ms >> 4) & 0x0F];
+    line[n++] = HEX_DIGITS[ms & 0x0F];
+  }
+  line[n++] = '\r';
+
+  if (_encodedSent < _encodedLength || _serial.availableForWrite() < n) {
+    dropped++;
+    return;
+  }
+  _serial.write((const uint8_t *)line, n);
+}
+
+void ESP_CAN_SLCAN::forwardBinary(const CAN_Frame &frame, unsigned long timestampUs, uint8_t flags) {
+  if (_batchCount == CAN_BATCH_MAX_RECORDS && !flushBatch()) {
+    dropped++;
+    return;
+  }
+  if (_batchCount == 0) _batchStartUs = timestampUs;
+
+  CAN_BatchRecord record;
+  record.timestampUs = timestampUs;
+  record.id = frame.id & 0x7FF;
+  record.dlc = frame.dlc;
+  record.flags = can_is_remote(frame) ? flags | CAN_BATCH_FLAG_REMOTE : flags;
+  memcpy(record.data, frame.data, sizeof(record.data));
+  memcpy(_batch + sizeof(CAN_BatchHeader) + _batchCount * sizeof(CAN_BatchRecord), &record, sizeof(record));
+  _batchCount++;
+
+  if (_batchCount == CAN_BATCH_MAX_RECORDS) flushBatch();
+}
+
+// Hands the batch over to be written. Returns false (and keeps the batch)
+// while the previous one is still being written.
+bool ESP_CAN_SLCAN::flushBatch() {
+  if (!drainEncoded()) return false;
+  CAN_BatchHeader header;
+  header.magic = CAN_BATCH_MAGIC;
+  header.count = _batchCount;
+  header.sequence = _batchSequence;
+  header.dropped = dropped;
+  memcpy(_batch, &header, sizeof(header));
+
+  size_t length = sizeof(CAN_BatchHeader) + _batchCount * sizeof(CAN_BatchRecord);
+  _encodedLength = can_cobs_encode(_batch, length, _encoded);
+  _encodedSent = 0;
+  _batchSequence++;
+  _batchCount = 0;
+  drainEncoded();
+  return true;
+}
+
+// Writes as much of the encoded batch as the port takes. Returns true once
+// all of it is written.
+bool ESP_CAN_SLCAN::drainEncoded() {
+  size_t left = _encodedLength - _encodedSent;
+  if (left == 0) return true;
+  int room = _serial.availableForWrite();
+  if (room <= 0) return false;
+  size_t n = (size_t)room < left ? (size_t)room : left;
+  _serial.write(_encoded + _encodedSent, n);
+  _encodedSent += n;
+  return _encodedSent == _encodedLength;
+}
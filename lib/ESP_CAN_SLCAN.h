@@ -0,0 +1,66 @@
+/*
+ * ESP_CAN_SLCAN.h - SLCAN (Lawicel) serial bridge for ESP_CAN.
+ *
+ * Speaks the ASCII SLCAN protocol so standard PC tools (slcand, SavvyCAN,
+ * python-can, CANHacker) can use the node as a USB-CAN adapter. The
+ * non-standard "B1" command switches received frames to a binary batch mode
+ * (see ESP_CAN_BatchFormat.h) that packs up to CAN_BATCH_MAX_RECORDS
+ * timestamped frames into one COBS frame.
+ *
+ * Forwarding never blocks on the serial port: when the port cannot accept
+ * a line, or the next batch while the last one is still being written, the
+ * frame is counted in `dropped` instead. An encoded batch is written in
+ * parts as the port drains, so batches may be larger than its TX buffer.
+ * A command reply first completes a batch that is partly written, so the
+ * reply cannot split it.
+ */
+
+#ifndef ESP_CAN_SLCAN_H
+#define ESP_CAN_SLCAN_H
+
+#include <Arduino.h>
+#include "ESP_CAN.h"
+#include "ESP_CAN_BatchFormat.h"
+
+class ESP_CAN_SLCAN {
+public:
+  uint32_t dropped;  // Frames lost because the serial port could not keep up
+
+  ESP_CAN_SLCAN(ESP_CAN &can, Stream &serial);
+
+  // Call from loop(): handles host commands and forwards received frames.
+  void poll();
+
+  // Binary batches are sent when full or when the oldest frame is this old.
+  void setBatchTimeout(unsigned long timeoutUs);
+
+private:
+  ESP_CAN &_can;
+  Stream &_serial;
+  bool _open;
+  bool _timestamps;
+  bool _binary;
+  long _baudrate;
+
+  char _cmd[32];
+  int _cmdLen;
+
+  uint8_t _batch[CAN_BATCH_MAX_PAYLOAD];
+  uint8_t _encoded[CAN_BATCH_MAX_ENCODED];
+  size_t _encodedLength;
+  size_t _encodedSent;      // Part of _encoded already written
+  int _batchCount;
+  uint16_t _batchSequence;
+  unsigned long _batchStartUs;
+  unsigned long _batchTimeoutUs;
+
+  void handleCommand();
+  bool transmit(const char *cmd, int len);
+  void reply(const char *text);
+  void forwardText(const CAN_Frame &frame, unsigned long timestampUs);
+  void forwardBinary(const CAN_Frame &frame, unsigned long timestampUs, uint8_t flags);
+  bool flushBatch();
+  bool drainEncoded();
+};
+
+#endif // ESP_CAN_SLCAN_H
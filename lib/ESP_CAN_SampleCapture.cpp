@@ -0,0 +1,124 @@
+/*
+ * ESP_CAN_SampleCapture.cpp - Fixed-rate RX pin sampler.
+ */
+
+#include "ESP_CAN_SampleCapture.h"
+
+#ifdef ESP_PLATFORM
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#else
+#include <thread>
+#endif
+
+ESP_CAN_SampleCapture::ESP_CAN_SampleCapture(int rxPin) {
+  _rxPin = rxPin;
+  _bitrate = 0;
+  _periodCycles = CAN_SAMPLE_MIN_CYCLES;
+  overruns = 0;
+  lateSamples = 0;
+  _running = false;
+  _stopRequested = false;
+  _task = NULL;
+}
+
+bool ESP_CAN_SampleCapture::begin(long bitrate, uint8_t oversample) {
+  if (bitrate <= 0 || oversample == 0) return false;
+  uint32_t period = ESP.getCpuFreqMHz() * 1000000 / ((uint32_t)bitrate * oversample);
+  if (period < CAN_SAMPLE_MIN_CYCLES) return false;
+  pinMode(_rxPin, INPUT_PULLUP);
+  _bitrate = bitrate;
+  _periodCycles = period;
+  return true;
+}
+
+CAN_SampleFileHeader ESP_CAN_SampleCapture::header(uint64_t startUnixTimeUs) const {
+  CAN_SampleFileHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, CAN_SAMPLE_MAGIC, 8);
+  h.version = CAN_SAMPLE_VERSION;
+  h.sampleRateHz = sampleRate();
+  h.bitrate = _bitrate;
+  h.startUnixTimeUs = startUnixTimeUs;
+  return h;
+}
+
+bool ESP_CAN_SampleCapture::start(int core, int priority) {
+  if (_running || _bitrate == 0) return false;
+  _stopRequested = false;
+  _running = true;
+
+#ifdef ESP_PLATFORM
+  // The sampler never blocks, so the idle task of its core never runs. Tasks
+  // of a higher priority still preempt it.
+  if (core == 0) disableCore0WDT();
+#ifndef CONFIG_FREERTOS_UNICORE
+  else disableCore1WDT();
+#endif
+  TaskHandle_t handle = NULL;
+  if (xTaskCreatePinnedToCore(taskEntry, "can_sampler", 2048, this, priority, &handle, core) != pdPASS) {
+    _running = false;
+    return false;
+  }
+  _task = handle;
+#else
+  // Host build: a plain thread, not pinned
+  (void)core;
+  (void)priority;
+  _task = new std::thread(taskEntry, this);
+#endif
+  return true;
+}
+
+void ESP_CAN_SampleCapture::stop() {
+  if (!_task) return;
+  _stopRequested = true;
+#ifdef ESP_PLATFORM
+  while (_running) delay(1);
+#else
+  std::thread *thread = static_cast<std::thread *>(_task);
+  thread->join();
+  delete thread;
+#endif
+  _task = NULL;
+}
+
+void ESP_CAN_SampleCapture::taskEntry(void *arg) {
+  static_cast<ESP_CAN_SampleCapture *>(arg)->run();
+#ifdef ESP_PLATFORM
+  vTaskDelete(NULL);
+#endif
+}
+
+bool ESP_CAN_SampleCapture::readPin() const {
+#ifdef ESP_PLATFORM
+#ifdef GPIO_IN1_REG
+  if (_rxPin >= 32) return (REG_READ(GPIO_IN1_REG) >> (_rxPin - 32)) & 1;
+#endif
+  return (REG_READ(GPIO_IN_REG) >> _rxPin) & 1;
+#else
+  return digitalRead(_rxPin);
+#endif
+}
+
+void ESP_CAN_SampleCapture::run() {
+  const uint32_t period = _periodCycles;
+  uint32_t next = ESP.getCycleCount() + period;
+  uint32_t word = 0;
+  int bit = 0;
+
+  while (!_stopRequested) {
+    uint32_t now;
+    while ((int32_t)((now = ESP.getCycleCount()) - next) < 0) {
+    }
+    word |= (uint32_t)readPin() << bit;
+    if (now - next >= period) lateSamples++;
+    next += period;
+    if (++bit == 32) {
+      if (!_ring.push(word)) overruns++;
+      word = 0;
+      bit = 0;
+    }
+  }
+  _running = false;
+}
@@ -0,0 +1,70 @@
+/*
+ * ESP_CAN_SampleCapture.h - Logic-analyzer style capture of the RX pin.
+ *
+ * Samples the RX pin at a fixed multiple of the bit rate and packs the
+ * samples, 32 per word, into a lock-free ring. There is no decoding and no
+ * bit timing, so it keeps up at bit rates where live decoding cannot. The
+ * application drains the ring with read() and stores the words after
+ * header(), e.g. on SD. tools/cansample decodes the file on the PC
+ * (CAN_SampleDecoder), where every bit can be inspected afterwards.
+ *
+ * Like ESP_CAN_Engine, the sampler is a task pinned to one core that busy-
+ * waits on the cycle counter between samples, and it disables that core's
+ * task watchdog. Sampling jitter is therefore a few CPU cycles. It also
+ * has the same defaults: core 0 at priority 1, below the WiFi and lwIP
+ * tasks there. They preempt it, and the samples this delays count in
+ * lateSamples.
+ */
+
+#ifndef ESP_CAN_SAMPLE_CAPTURE_H
+#define ESP_CAN_SAMPLE_CAPTURE_H
+
+#include <Arduino.h>
+#include "ESP_CAN_Queue.h"
+#include "ESP_CAN_SampleFormat.h"
+
+#define CAN_SAMPLE_RING_WORDS 4096   // 16 KB, a power of two
+#define CAN_SAMPLE_MIN_CYCLES 24     // Fastest sampling the loop can sustain
+#define CAN_SAMPLE_CORE 0            // Default core, away from loop()
+#define CAN_SAMPLE_PRIORITY 1        // Default priority, below the WiFi and lwIP tasks
+
+class ESP_CAN_SampleCapture {
+public:
+  uint32_t overruns;     // Words lost because the ring was full
+  uint32_t lateSamples;  // Samples taken a whole period or more late
+
+  ESP_CAN_SampleCapture(int rxPin);
+
+  // Sets the sample rate to `oversample` samples per bit. Returns false if
+  // that would leave fewer than CAN_SAMPLE_MIN_CYCLES cycles per sample.
+  bool begin(long bitrate, uint8_t oversample = 8);
+
+  // A priority above the system tasks of `core` starves them.
+  bool start(int core = CAN_SAMPLE_CORE, int priority = CAN_SAMPLE_PRIORITY);
+  void stop();
+  bool running() const { return _running; }
+
+  // Application side: the next 32 samples, first sample in bit 0
+  bool read(uint32_t &word) { return _ring.pop(word); }
+  uint32_t available() const { return _ring.size(); }
+
+  // Actual rate: a whole number of CPU cycles per sample
+  uint32_t sampleRate() const { return ESP.getCpuFreqMHz() * 1000000 / _periodCycles; }
+  CAN_SampleFileHeader header(uint64_t startUnixTimeUs = 0) const;
+
+private:
+  int _rxPin;
+  long _bitrate;
+  uint32_t _periodCycles;
+  CAN_SpscQueue<uint32_t, CAN_SAMPLE_RING_WORDS> _ring;
+
+  volatile bool _running;
+  volatile bool _stopRequested;
+  void *_task;  // TaskHandle_t or std::thread*
+
+  static void taskEntry(void *arg);
+  void run();
+  bool readPin() const;
+};
+
+#endif // ESP_CAN_SAMPLE_CAPTURE_H
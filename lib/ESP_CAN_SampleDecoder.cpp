@@ -0,0 +1,197 @@
+/*
+ * ESP_CAN_SampleDecoder.cpp - Edge-driven decoding of oversampled captures.
+ */
+
+#include "ESP_CAN_SampleDecoder.h"
+
+#include <string.h>
+
+// Bits fed for one run at most. Longer runs only occur on an idle (or
+// stuck) bus, where anything past the 11 bits that mark idle is redundant.
+#define CAN_SAMPLE_MAX_RUN_BITS 32
+
+static inline int ctz64(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+CAN_SampleDecoder::CAN_SampleDecoder() {
+  _callback = NULL;
+  _callbackArg = NULL;
+  begin(8);
+}
+
+void CAN_SampleDecoder::begin(double samplesPerBit, double samplePoint, bool busIdle) {
+  memset(&stats, 0, sizeof(stats));
+  _samplesPerBit = samplesPerBit;
+  _samplePoint = samplePoint;
+  _bits.reset();
+  if (busIdle) _bits.resetToIdle();
+  _glitchSamples = (uint64_t)(samplesPerBit / 4 + 0.5);
+  _pos = 0;
+  _level = true;
+  _runLevel = true;
+  _runStart = 0;
+  _edgePending = false;
+  _nextSample = samplePoint * samplesPerBit;
+  _sof = 0;
+}
+
+void CAN_SampleDecoder::onFrame(CAN_SampleFrameCallback callback, void *arg) {
+  _callback = callback;
+  _callbackArg = arg;
+}
+
+void CAN_SampleDecoder::feed(const uint64_t *words, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    uint64_t w = words[i];
+    // Set bits differ from the level of the open run, so the lowest one is
+    // the next edge
+    uint64_t x = _level ? ~w : w;
+    while (x) {
+      int b = ctz64(x);
+      onEdge(_pos + b);
+      _level = !_level;
+      x = (_level ? ~w : w) & (b == 63 ? 0 : ~0ULL << (b + 1));
+    }
+    _pos += 64;
+  }
+  stats.samples += (uint64_t)count * 64;
+}
+
+void CAN_SampleDecoder::finish() {
+  if (_edgePending) {
+    closeRun(_pendingEdge);
+    _runLevel = !_runLevel;
+    _edgePending = false;
+  }
+  closeRun(_pos);
+  _runStart = _pos;
+}
+
+// An edge is held back until the next one shows whether the two enclose a
+// glitch. If they do, both vanish and the open run simply continues.
+void CAN_SampleDecoder::onEdge(uint64_t edge) {
+  stats.edges++;
+  if (_edgePending && edge - _pendingEdge < _glitchSamples) {
+    _edgePending = false;
+    stats.glitches++;
+    return;
+  }
+  if (_edgePending) {
+    closeRun(_pendingEdge);
+    _runLevel = !_runLevel;
+  }
+  _edgePending = true;
+  _pendingEdge = edge;
+}
+
+// The open run ends at sample `end`. Every sample point inside it reads its
+// level; then the edge at `end` re-centres the sample point, unless the run
+// was too short to be anything but a glitch.
+void CAN_SampleDecoder::closeRun(uint64_t end) {
+  double e = (double)end;
+  if (_nextSample < e) {
+    uint64_t n = (uint64_t)((e - _nextSample) / _samplesPerBit) + 1;
+    if (_nextSample + (n - 1) * _samplesPerBit >= e) n--;
+    uint64_t fed = n < CAN_SAMPLE_MAX_RUN_BITS ? n : CAN_SAMPLE_MAX_RUN_BITS;
+    for (uint64_t k = 0; k < fed; k++) decodeBit(_runLevel, _nextSample + k * _samplesPerBit);
+    _nextSample += n * _samplesPerBit;
+  }
+  if (end - _runStart >= _samplesPerBit / 2) _nextSample = e + _samplePoint * _samplesPerBit;
+  _runStart = end;
+}
+
+void CAN_SampleDecoder::decodeBit(bool level, double position) {
+  stats.bits++;
+  CAN_Decode_Event event = _bits.feed(level);
+  if (event == CAN_DECODE_NONE || event == CAN_DECODE_ACK_SLOT) return;
+  if (event == CAN_DECODE_ERROR_FRAME) {
+    stats.errorFrames++;
+    return;
+  }
+  if (event == CAN_DECODE_OVERLOAD_FRAME) {
+    stats.overloadFrames++;
+    return;
+  }
+
+  if (event == CAN_DECODE_SOF) {
+    _sof = (uint64_t)(position - _samplePoint * _samplesPerBit + 0.5);
+    return;
+  }
+
+  CAN_SampleFrame result;
+  result.frame = _bits.frame();
+  result.sofSample = _sof;
+  result.extended = _bits.isExtended();
+  result.remote = _bits.isRemote();
+  result.extendedId = _bits.extendedId();
+  result.acknowledged = _bits.acknowledged();
+  result.error = event == CAN_DECODE_ERROR ? _bits.lastError() : CAN_DECODE_ERROR_NONE;
+
+  switch (result.error) {
+    case CAN_DECODE_ERROR_NONE: stats.frames++; break;
+    case CAN_DECODE_ERROR_STUFF: stats.stuffErrors++; break;
+    case CAN_DECODE_ERROR_CRC: stats.crcErrors++; break;
+    case CAN_DECODE_ERROR_FORM: stats.formErrors++; break;
+  }
+  if (_callback) _callback(result, _callbackArg);
+}
+
+double CAN_SampleDecoder::estimateSamplesPerBit(const uint64_t *words, size_t count) {
+  // Histogram of run lengths; single-bit runs are the shortest common ones
+  const int maxLength = 1024;
+  uint32_t histogram[maxLength];
+  memset(histogram, 0, sizeof(histogram));
+  uint32_t runs = 0;
+
+  bool level = true;
+  uint64_t runStart = 0;
+  bool started = false;  // The first run has no known start
+  for (size_t i = 0; i < count && runs < 100000; i++) {
+    uint64_t w = words[i];
+    uint64_t x = level ? ~w : w;
+    while (x) {
+      int b = ctz64(x);
+      uint64_t edge = (uint64_t)i * 64 + b;
+      uint64_t length = edge - runStart;
+      if (started && length >= 2 && length < maxLength) {
+        histogram[length]++;
+        runs++;
+      }
+      started = true;
+      runStart = edge;
+      level = !level;
+      x = (level ? ~w : w) & (b == 63 ? 0 : ~0ULL << (b + 1));
+    }
+  }
+  if (runs < 50) return 0;
+
+  // Coarse estimate: the 5th percentile of run lengths
+  uint32_t seen = 0;
+  int coarse = 2;
+  for (; coarse < maxLength; coarse++) {
+    seen += histogram[coarse];
+    if (seen * 20 >= runs) break;
+  }
+
+  // Refine over runs of up to 5 bits (longer ones are idle or stuffing-
+  // limited anyway): total samples / total bits
+  double samples = 0, bits = 0;
+  for (int length = 2; length < maxLength; length++) {
+    if (!histogram[length]) continue;
+    int k = (int)((double)length / coarse + 0.5);
+    if (k < 1 || k > 5) continue;
+    samples += (double)length * histogram[length];
+    bits += (double)k * histogram[length];
+  }
+  return bits > 0 ? samples / bits : 0;
+}
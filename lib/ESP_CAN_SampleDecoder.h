@@ -0,0 +1,98 @@
+/*
+ * ESP_CAN_SampleDecoder.h - Decodes oversampled RX captures into frames.
+ *
+ * Input is packed samples, 64 per word, first sample in bit 0 (see
+ * ESP_CAN_SampleFormat.h). Edges are found a word at a time. A word with
+ * no edge costs one XOR and one test, so long idle stretches are nearly
+ * free. Each edge is located with a count-trailing-zeros. The bit clock is
+ * recovered from the edges: every edge re-centres the sample point, and
+ * each run between two edges is turned into whole bits arithmetically
+ * rather than sample by sample. Pulses shorter than a quarter bit are
+ * dropped as glitches before they can reach a sample point or move the bit
+ * clock. The bits go through the same CAN_BitDecoder as the live receiver,
+ * which destuffs them and checks CRC and form.
+ *
+ * Needs only <stdint.h>, so the same code runs on the ESP32 and in host
+ * tools. feed() can be called with consecutive chunks of a capture of any
+ * length.
+ */
+
+#ifndef ESP_CAN_SAMPLE_DECODER_H
+#define ESP_CAN_SAMPLE_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ESP_CAN_Decoder.h"
+
+struct CAN_SampleFrame {
+  CAN_Frame frame;
+  uint64_t sofSample;          // Sample index of the start-of-frame edge
+  bool extended;
+  bool remote;
+  uint32_t extendedId;         // 29-bit ID when extended
+  bool acknowledged;
+  CAN_Decode_Error error;      // CAN_DECODE_ERROR_NONE for a valid frame
+};
+
+typedef void (*CAN_SampleFrameCallback)(const CAN_SampleFrame &frame, void *arg);
+
+struct CAN_SampleDecoder_Stats {
+  uint64_t samples;
+  uint64_t edges;
+  uint64_t glitches;          // Pulses dropped by the glitch filter
+  uint64_t bits;              // Bus bits fed to the frame decoder
+  uint64_t frames;            // Valid frames
+  uint64_t stuffErrors;
+  uint64_t crcErrors;
+  uint64_t formErrors;
+  uint64_t errorFrames;       // Error flags and delimiters
+  uint64_t overloadFrames;
+};
+
+class CAN_SampleDecoder {
+public:
+  CAN_SampleDecoder_Stats stats;
+
+  CAN_SampleDecoder();
+
+  // Starts a new capture. samplesPerBit may be fractional; samplePoint is
+  // the position within the bit, measured from the last edge, where the
+  // level is taken. With busIdle the capture is known to start on an idle
+  // bus, so the first dominant edge is a start of frame; otherwise 11
+  // recessive bits are needed first.
+  void begin(double samplesPerBit, double samplePoint = 0.5, bool busIdle = false);
+  // Called for every valid frame and every frame aborted by an error.
+  void onFrame(CAN_SampleFrameCallback callback, void *arg = NULL);
+
+  void feed(const uint64_t *words, size_t count);
+  // Decodes the run still open at the end of the capture.
+  void finish();
+
+  // Estimates samples per bit from the run lengths in a stretch of capture
+  // that contains traffic. Returns 0 if there are too few edges.
+  static double estimateSamplesPerBit(const uint64_t *words, size_t count);
+
+private:
+  CAN_BitDecoder _bits;
+  CAN_SampleFrameCallback _callback;
+  void *_callbackArg;
+  double _samplesPerBit;
+  double _samplePoint;
+
+  uint64_t _glitchSamples;  // Pulses shorter than this are dropped
+
+  uint64_t _pos;        // Sample index of bit 0 of the next word
+  bool _level;          // Raw level after the last edge seen
+  bool _runLevel;       // Level of the open run, glitches removed
+  uint64_t _runStart;
+  bool _edgePending;    // An edge waits to see if a second one cancels it
+  uint64_t _pendingEdge;
+  double _nextSample;   // Sample position of the next bit's sample point
+  uint64_t _sof;
+
+  void onEdge(uint64_t edge);
+  void closeRun(uint64_t end);
+  void decodeBit(bool level, double position);
+};
+
+#endif // ESP_CAN_SAMPLE_DECODER_H
@@ -0,0 +1,36 @@
+/*
+ * ESP_CAN_SampleFormat.h - Layout of raw oversampled RX captures.
+ *
+ * Shared by ESP_CAN_SampleCapture on the ESP32 and the host decoder in
+ * tools/cansample, so it only depends on <stdint.h>.
+ *
+ * Layout (all little endian):
+ *
+ *   CAN_SampleFileHeader
+ *   uint32_t words: sample n is bit (n % 32) of word n / 32, 1 = recessive
+ *
+ * Because the words are little endian with the first sample in bit 0, two
+ * consecutive words read as one uint64_t on the host give 64 samples in
+ * order. The decoder works on 64-bit words for that reason.
+ */
+
+#ifndef ESP_CAN_SAMPLE_FORMAT_H
+#define ESP_CAN_SAMPLE_FORMAT_H
+
+#include <stdint.h>
+
+#define CAN_SAMPLE_MAGIC "ESPCANS1"
+#define CAN_SAMPLE_VERSION 1
+
+struct CAN_SampleFileHeader {
+  char magic[8];              // CAN_SAMPLE_MAGIC, not NUL-terminated
+  uint32_t version;           // CAN_SAMPLE_VERSION
+  uint32_t sampleRateHz;
+  uint32_t bitrate;           // Nominal bit rate, or 0 to let the decoder estimate it
+  uint32_t reserved;
+  uint64_t startUnixTimeUs;   // Wall-clock time of sample 0, or 0 if unknown
+};
+
+static_assert(sizeof(CAN_SampleFileHeader) == 32, "CAN_SampleFileHeader must stay 32 bytes");
+
+#endif // ESP_CAN_SAMPLE_FORMAT_H
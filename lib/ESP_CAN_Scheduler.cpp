@@ -0,0 +1,227 @@
+/*
+ * ESP_CAN_Scheduler.cpp - Heap-based periodic transmission.
+ */
+
+#include "ESP_CAN_Scheduler.h"
+
+static uint32_t gcd32(uint32_t a, uint32_t b) {
+  while (b) {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+ESP_CAN_Scheduler::ESP_CAN_Scheduler(ESP_CAN &can) : _can(can) {
+  _count = 0;
+  _slotUs = CAN_SCHEDULER_SLOT_US;
+  _started = false;
+  _heapSize = 0;
+  _inFlight = -1;
+}
+
+int ESP_CAN_Scheduler::add(const CAN_Frame &frame, uint32_t periodUs, uint32_t offsetUs,
+                           CAN_ProducerCallback producer, void *arg) {
+  if (_count == CAN_SCHEDULER_MAX) return -1;
+  if (periodUs == 0 || periodUs > 0x80000000UL) return -1;
+  if (offsetUs != CAN_SCHEDULER_AUTO_OFFSET && offsetUs >= periodUs) return -1;
+
+  // Before begin() due times are relative to the start of the schedule
+  uint32_t ref = _started ? micros() : 0;
+  if (offsetUs == CAN_SCHEDULER_AUTO_OFFSET) offsetUs = staggerOffset(periodUs, ref);
+
+  Message &m = _msgs[_count];
+  m.frame = frame;
+  m.periodUs = periodUs;
+  m.offsetUs = offsetUs;
+  m.producer = producer;
+  m.arg = arg;
+  m.due = ref + offsetUs;
+  m.ready = false;
+  memset(&m.stats, 0, sizeof(m.stats));
+
+  if (_started) {
+    _heap[_heapSize] = _count;
+    siftUp(_heapSize++);
+  }
+  return _count++;
+}
+
+uint32_t ESP_CAN_Scheduler::staggerOffset(uint32_t periodUs, uint32_t ref) const {
+  // Releases at c + a*P and o + b*Q come closer than g = gcd(P, Q) only
+  // where (c - o) mod g is near 0, and then once every P*Q/g. Score each
+  // candidate offset by the collision rate it would cause.
+  uint32_t candidates = (periodUs + _slotUs - 1) / _slotUs;
+  uint32_t step = _slotUs * ((candidates + 1023) / 1024);
+  uint32_t best = 0;
+  float bestCost = -1;
+
+  for (uint32_t c = 0; c < periodUs; c += step) {
+    float cost = 0;
+    for (int j = 0; j < _count; j++) {
+      const Message &m = _msgs[j];
+      int32_t ahead = (int32_t)(m.due - ref);
+      uint32_t phase = ahead > 0 ? (uint32_t)ahead % m.periodUs : 0;
+      uint32_t g = gcd32(periodUs, m.periodUs);
+      uint32_t d = (c % g + g - phase % g) % g;
+      if (g - d < d) d = g - d;
+      if (d < _slotUs) cost += (float)g / periodUs / m.periodUs;
+    }
+    if (bestCost < 0 || cost < bestCost) {
+      bestCost = cost;
+      best = c;
+      if (cost == 0) break;
+    }
+  }
+  return best;
+}
+
+void ESP_CAN_Scheduler::begin() {
+  uint32_t now = micros();
+  _heapSize = 0;
+  for (int i = 0; i < _count; i++) {
+    _msgs[i].due = now + _msgs[i].offsetUs;
+    _msgs[i].ready = false;
+    _heap[_heapSize] = i;
+    siftUp(_heapSize++);
+  }
+  _inFlight = -1;
+  _started = true;
+}
+
+void ESP_CAN_Scheduler::resetStats() {
+  for (int i = 0; i < _count; i++) memset(&_msgs[i].stats, 0, sizeof(_msgs[i].stats));
+}
+
+float ESP_CAN_Scheduler::averageJitterUs(int i) const {
+  const CAN_Periodic_Stats &s = _msgs[i].stats;
+  return s.sent ? (float)s.totalJitterUs / s.sent : 0;
+}
+
+// --- HEAP ---
+
+void ESP_CAN_Scheduler::siftUp(int pos) {
+  while (pos > 0) {
+    int parent = (pos - 1) / 2;
+    if (!earlier(pos, parent)) break;
+    uint8_t t = _heap[pos];
+    _heap[pos] = _heap[parent];
+    _heap[parent] = t;
+    pos = parent;
+  }
+}
+
+void ESP_CAN_Scheduler::siftDown(int pos) {
+  for (;;) {
+    int first = pos;
+    int left = 2 * pos + 1;
+    int right = left + 1;
+    if (left < _heapSize && earlier(left, first)) first = left;
+    if (right < _heapSize && earlier(right, first)) first = right;
+    if (first == pos) break;
+    uint8_t t = _heap[pos];
+    _heap[pos] = _heap[first];
+    _heap[first] = t;
+    pos = first;
+  }
+}
+
+// --- RELEASE AND TRANSMIT ---
+
+CAN_Read_Status ESP_CAN_Scheduler::poll(CAN_Frame &frame) {
+  CAN_Read_Status status = _can.readFrame(frame);
+  if (!_started) return status;
+
+  uint32_t now = micros();
+  while (_heapSize && (int32_t)(now - _msgs[_heap[0]].due) >= 0) {
+    release(_heap[0], now);
+    siftDown(0);  // The root's due time moved one or more periods on
+  }
+  serviceTx();
+  return status;
+}
+
+void ESP_CAN_Scheduler::release(int i, uint32_t now) {
+  Message &m = _msgs[i];
+  uint32_t late = now - m.due;
+  if (late > m.stats.maxReleaseLatenessUs) m.stats.maxReleaseLatenessUs = late;
+
+  // If poll() was starved for whole periods, those releases never happened
+  uint32_t skippedPeriods = late / m.periodUs;
+  uint32_t nominal = m.due + skippedPeriods * m.periodUs;
+  m.stats.releases += skippedPeriods + 1;
+  m.stats.missedDeadlines += skippedPeriods;
+  m.due = nominal + m.periodUs;
+
+  // The previous release is still queued, or was still waiting for an idle
+  // bus: poll() has just let it expire, or is about to
+  CAN_Tx_State tx = _inFlight == i ? _can.txState() : CAN_TX_IDLE;
+  if (m.ready || tx == CAN_TX_WAITING || tx == CAN_TX_EXPIRED) m.stats.missedDeadlines++;
+
+  if (m.producer && !m.producer(m.frame, m.arg)) {
+    m.stats.skipped++;
+    m.ready = false;
+    return;
+  }
+  m.ready = true;
+  m.released = nominal;
+}
+
+void ESP_CAN_Scheduler::serviceTx() {
+  if (_inFlight >= 0) {
+    Message &m = _msgs[_inFlight];
+    CAN_Tx_State state = _can.txState();
+    if (state == CAN_TX_WAITING || state == CAN_TX_SENDING) return;
+
+    if (state == CAN_TX_DONE) {
+      uint32_t sinceSof = (ESP.getCycleCount() - _can.txStartCycles()) / ESP.getCpuFreqMHz();
+      int32_t jitter = (int32_t)(micros() - sinceSof - _inFlightReleased);
+      uint32_t jitterUs = jitter > 0 ? jitter : 0;
+      m.stats.sent++;
+      m.stats.lastJitterUs = jitterUs;
+      m.stats.totalJitterUs += jitterUs;
+      if (jitterUs > m.stats.maxJitterUs) m.stats.maxJitterUs = jitterUs;
+    } else if (state != CAN_TX_EXPIRED) {
+      // Lost arbitration or an error: send it again unless a newer release
+      // has replaced it meanwhile. An expired frame was replaced already.
+      if (state == CAN_TX_ERROR) m.stats.txErrors++;
+      if (!m.ready) {
+        m.ready = true;
+        m.released = _inFlightReleased;
+      } else {
+        m.stats.missedDeadlines++;
+      }
+    }
+    _inFlight = -1;
+  }
+
+  // Earliest deadline first; between equal deadlines the lower ID, as the
+  // bus would arbitrate between them
+  int next = -1;
+  for (int i = 0; i < _count; i++) {
+    if (!_msgs[i].ready) continue;
+    int32_t diff = next < 0 ? -1 : (int32_t)(deadline(i) - deadline(next));
+    if (diff < 0 || (diff == 0 && _msgs[i].frame.id < _msgs[next].frame.id)) next = i;
+  }
+  if (next < 0) return;
+
+  // One attempt, dropped by the bus engine if it is still waiting for the
+  // bus when the next release is due, so a stale copy never goes out. The
+  // policy's deadline is the last microsecond in which it may start.
+  Message &m = _msgs[next];
+  CAN_TxPolicy policy = can_tx_until(deadline(next) - 1);
+  policy.attempts = 1;
+  if (!_can.startFrame(m.frame, policy)) {
+    // A retry whose period is over is dropped; in bus-off it waits
+    if (_can.txState() == CAN_TX_EXPIRED) {
+      m.ready = false;
+      m.stats.missedDeadlines++;
+    }
+    return;
+  }
+
+  m.ready = false;
+  _inFlight = next;
+  _inFlightReleased = m.released;
+}
@@ -0,0 +1,112 @@
+/*
+ * ESP_CAN_Scheduler.h - Periodic message scheduler.
+ *
+ * Each message has a period and an offset (its first release after
+ * begin()). Release times are kept in a binary min-heap, so poll() only
+ * looks at the earliest one and a release costs O(log n). When a message is
+ * released its producer callback fills in the current data and the message
+ * becomes ready. Ready messages are sent with the non-blocking startFrame(),
+ * earliest deadline first.
+ *
+ * A message that is still waiting to be sent at its next release has missed
+ * its deadline (the deadline is the period), and so has one that lost
+ * arbitration or failed and could not be sent again before it. The stale
+ * data is replaced by the new release, and a copy already handed to
+ * startFrame() expires then and is dropped before it reaches the bus.
+ * Jitter is the delay from the nominal release time to the start of frame
+ * on the bus. It includes poll latency, waiting behind other messages and
+ * lost arbitration.
+ *
+ * Offsets left at CAN_SCHEDULER_AUTO_OFFSET are staggered by add(). The
+ * offset is chosen so that the new message collides least often with the
+ * releases of the messages added before it.
+ */
+
+#ifndef ESP_CAN_SCHEDULER_H
+#define ESP_CAN_SCHEDULER_H
+
+#include <Arduino.h>
+#include "ESP_CAN.h"
+
+#define CAN_SCHEDULER_MAX 32
+#define CAN_SCHEDULER_AUTO_OFFSET 0xFFFFFFFF
+#define CAN_SCHEDULER_SLOT_US 1000  // Default stagger slot, about one frame at 125 kbit/s
+
+// Called at each release with the message's frame; update its data here.
+// Returning false skips this release.
+typedef bool (*CAN_ProducerCallback)(CAN_Frame &frame, void *arg);
+
+struct CAN_Periodic_Stats {
+  uint32_t releases;          // Periods started (including skipped ones)
+  uint32_t sent;              // Sent and acknowledged
+  uint32_t skipped;           // Producer returned false
+  uint32_t missedDeadlines;   // Not sent before the next release
+  uint32_t txErrors;          // Bit or ACK errors (retried until the deadline)
+  uint32_t maxReleaseLatenessUs; // Worst delay from due time to the poll that released it
+  uint32_t lastJitterUs;      // Nominal release to start of frame
+  uint32_t maxJitterUs;
+  uint64_t totalJitterUs;     // Divide by `sent` for the average
+};
+
+class ESP_CAN_Scheduler {
+public:
+  ESP_CAN_Scheduler(ESP_CAN &can);
+
+  // Returns the message index, or -1 if the table is full or the period is
+  // 0 or longer than 2^31 us. With a fixed offset, offsetUs must be
+  // below periodUs.
+  int add(const CAN_Frame &frame, uint32_t periodUs, uint32_t offsetUs = CAN_SCHEDULER_AUTO_OFFSET,
+          CAN_ProducerCallback producer = NULL, void *arg = NULL);
+  // Granularity of automatic offsets; two releases closer than this count
+  // as a collision. Set it before add().
+  void setStaggerSlot(uint32_t slotUs) { _slotUs = slotUs ? slotUs : 1; }
+
+  // Starts the schedule: message i is first released offset(i) from now.
+  void begin();
+
+  // Non-blocking: reads the bus once, like readFrame(), and releases and
+  // sends whatever is due. Call it back to back instead of readFrame().
+  CAN_Read_Status poll(CAN_Frame &frame);
+
+  int count() const { return _count; }
+  uint32_t offset(int i) const { return _msgs[i].offsetUs; }
+  const CAN_Periodic_Stats &stats(int i) const { return _msgs[i].stats; }
+  float averageJitterUs(int i) const;
+  void resetStats();
+
+private:
+  struct Message {
+    CAN_Frame frame;
+    uint32_t periodUs;
+    uint32_t offsetUs;
+    CAN_ProducerCallback producer;
+    void *arg;
+    uint32_t due;         // Next release, micros()
+    uint32_t released;    // Nominal time of the release waiting to be sent
+    bool ready;           // Released and not sent yet
+    CAN_Periodic_Stats stats;
+  };
+
+  ESP_CAN &_can;
+  Message _msgs[CAN_SCHEDULER_MAX];
+  int _count;
+  uint32_t _slotUs;
+  bool _started;
+
+  // Indices into _msgs, ordered by due time
+  uint8_t _heap[CAN_SCHEDULER_MAX];
+  int _heapSize;
+
+  int _inFlight;  // Message handed to startFrame(), or -1
+  uint32_t _inFlightReleased;
+
+  uint32_t staggerOffset(uint32_t periodUs, uint32_t ref) const;
+  bool earlier(int a, int b) const { return (int32_t)(_msgs[_heap[a]].due - _msgs[_heap[b]].due) < 0; }
+  uint32_t deadline(int i) const { return _msgs[i].released + _msgs[i].periodUs; }
+  void siftUp(int pos);
+  void siftDown(int pos);
+  void release(int i, uint32_t now);
+  void serviceTx();
+};
+
+#endif // ESP_CAN_SCHEDULER_H
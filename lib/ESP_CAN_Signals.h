@@ -0,0 +1,71 @@
+/*
+ * ESP_CAN_Signals.h - constexpr helpers used by headers generated with
+ * tools/dbc2can.
+ *
+ * Every helper is a single-expression constexpr function so the generated
+ * decode()/encode() calls compile with C++11 and fold down to a 64-bit word
+ * load, one shift and one mask per signal. Shift amounts and masks are
+ * computed by the generator, not at runtime.
+ */
+
+#ifndef ESP_CAN_SIGNALS_H
+#define ESP_CAN_SIGNALS_H
+
+#include <stdint.h>
+#include "ESP_CAN_Frame.h"
+
+namespace can_signals {
+
+// Payload as a little-endian word: data[0] is bits 0..7 (Intel signals).
+constexpr uint64_t wordLE(const CAN_Frame &f) {
+  return (uint64_t)f.data[0]         | ((uint64_t)f.data[1] << 8)  |
+         ((uint64_t)f.data[2] << 16) | ((uint64_t)f.data[3] << 24) |
+         ((uint64_t)f.data[4] << 32) | ((uint64_t)f.data[5] << 40) |
+         ((uint64_t)f.data[6] << 48) | ((uint64_t)f.data[7] << 56);
+}
+
+// Payload as a big-endian word: data[0] is bits 56..63 (Motorola signals).
+constexpr uint64_t wordBE(const CAN_Frame &f) {
+  return ((uint64_t)f.data[0] << 56) | ((uint64_t)f.data[1] << 48) |
+         ((uint64_t)f.data[2] << 40) | ((uint64_t)f.data[3] << 32) |
+         ((uint64_t)f.data[4] << 24) | ((uint64_t)f.data[5] << 16) |
+         ((uint64_t)f.data[6] << 8)  | (uint64_t)f.data[7];
+}
+
+constexpr uint64_t mask(unsigned len) {
+  return len >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << len) - 1);
+}
+
+// Raw unsigned field of `len` bits starting at bit `shift` of `word`.
+constexpr uint64_t get(uint64_t word, unsigned shift, unsigned len) {
+  return (word >> shift) & mask(len);
+}
+
+// Two's complement sign extension of a `len`-bit raw value.
+constexpr int64_t sext(uint64_t raw, unsigned len) {
+  return (int64_t)(raw ^ ((uint64_t)1 << (len - 1))) - (int64_t)((uint64_t)1 << (len - 1));
+}
+
+// Physical value to raw integer, rounded to nearest, truncated to `len` bits.
+constexpr uint64_t toRaw(float phys, float scale, float offset, unsigned len) {
+  return (uint64_t)(int64_t)((phys - offset) / scale + ((phys - offset) / scale >= 0 ? 0.5f : -0.5f)) & mask(len);
+}
+
+// Place a raw value at `shift` in the payload word.
+constexpr uint64_t put(uint64_t raw, unsigned shift, unsigned len) {
+  return (raw & mask(len)) << shift;
+}
+
+// Builds a frame whose payload bytes combine an Intel and a Motorola word.
+constexpr uint8_t byteOf(uint64_t le, uint64_t be, unsigned i) {
+  return (uint8_t)((le >> (8 * i)) | (be >> (8 * (7 - i))));
+}
+
+constexpr CAN_Frame frame(uint32_t id, uint8_t dlc, uint64_t le, uint64_t be) {
+  return CAN_Frame{id, dlc, {byteOf(le, be, 0), byteOf(le, be, 1), byteOf(le, be, 2), byteOf(le, be, 3),
+                             byteOf(le, be, 4), byteOf(le, be, 5), byteOf(le, be, 6), byteOf(le, be, 7)}};
+}
+
+} // namespace can_signals
+
+#endif // ESP_CAN_SIGNALS_H
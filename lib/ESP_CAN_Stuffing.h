@@ -0,0 +1,307 @@
+/*
+ * ESP_CAN_Stuffing.h - Bit stuffing and destuffing on 64-bit words.
+ *
+ * Bit streams are packed 64 bits per word in transmission order, bit n in
+ * bit (n % 64) of word n / 64, as in ESP_CAN_SampleFormat.h. A stream is
+ * one stuffed region: SOF through the CRC sequence, including a stuff bit
+ * that may follow the last CRC bit.
+ *
+ * Destuffing needs no sequential state. In a correctly stuffed stream, bit
+ * j is a stuff bit exactly when bits j-5..j-1 are equal. That is four
+ * "no transition" flags in a row, so a word's stuff bits are found with
+ * four shifts and ANDs. They are then squeezed out in one step. Stuffing
+ * works the other way round: each insertion restarts the run count, so
+ * the kernel finds the next run of five with the same masks, notes the
+ * gap, and repeats from there. The data bits are then spread around the
+ * gaps in one step. Both cost O(words + stuff bits) instead of O(bits).
+ *
+ * With BMI2 (__BMI2__, e.g. -mbmi2 or -march=native on x86) the squeeze
+ * and spread are PEXT and PDEP. Otherwise bits are removed or inserted one
+ * gap at a time with masks. That replaces the usual byte table, because
+ * stuff bits are sparse: at most one in five bits, about one in 30 in
+ * typical traffic.
+ *
+ * The *_scalar functions are the bit-at-a-time reference. Only depends on
+ * <stdint.h>/<stddef.h>.
+ */
+
+#ifndef ESP_CAN_STUFFING_H
+#define ESP_CAN_STUFFING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+// --- WORD HELPERS ---
+
+inline int can_ctz64(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+inline int can_clz64(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_clzll(x);
+#else
+  int n = 0;
+  while (!(x >> 63)) {
+    x <<= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+inline int can_popcount64(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_popcountll(x);
+#else
+  int n = 0;
+  for (; x; x &= x - 1) n++;
+  return n;
+#endif
+}
+
+inline uint64_t can_low_mask(unsigned n) {
+  return n >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+}
+
+// Packs the bits of x where keep is set into the low bits (PEXT).
+inline uint64_t can_squeeze_bits(uint64_t x, uint64_t keep) {
+#if defined(__BMI2__)
+  return _pext_u64(x, keep);
+#else
+  // Remove the few dropped bits from the top down, so lower indices stay put
+  uint64_t drop = ~keep;
+  x &= keep;
+  while (drop) {
+    int g = 63 - can_clz64(drop);
+    drop &= ~((uint64_t)1 << g);
+    x = (x & can_low_mask(g)) | ((x >> 1) & ~can_low_mask(g));
+  }
+  return x;
+#endif
+}
+
+// Spreads the low bits of x over the set bits of place (PDEP).
+inline uint64_t can_spread_bits(uint64_t x, uint64_t place) {
+#if defined(__BMI2__)
+  return _pdep_u64(x, place);
+#else
+  // Open the few gaps from the bottom up
+  uint64_t gaps = ~place;
+  while (gaps) {
+    int g = can_ctz64(gaps);
+    gaps &= gaps - 1;
+    x = (x & can_low_mask(g)) | ((x & ~can_low_mask(g)) << 1);
+  }
+  return x & place;
+#endif
+}
+
+// Reads n <= 64 bits starting at bit `pos` of a packed stream of `words` words.
+inline uint64_t can_read_bits(const uint64_t *in, size_t words, size_t pos, unsigned n) {
+  size_t k = pos / 64;
+  unsigned off = pos % 64;
+  uint64_t v = in[k] >> off;
+  if (off && k + 1 < words) v |= in[k + 1] << (64 - off);
+  return v & can_low_mask(n);
+}
+
+// Appends bits to a packed stream, a word at a time.
+struct CAN_BitWriter {
+  uint64_t *out;
+  size_t word;
+  uint64_t acc;
+  unsigned accBits;
+
+  CAN_BitWriter(uint64_t *dest) : out(dest), word(0), acc(0), accBits(0) {}
+
+  void put(uint64_t v, unsigned n) {  // n <= 64, v has no bits above n
+    acc |= v << accBits;
+    if (accBits + n < 64) {
+      accBits += n;
+      return;
+    }
+    out[word++] = acc;
+    acc = accBits ? v >> (64 - accBits) : 0;
+    accBits = accBits + n - 64;
+  }
+  size_t bits() const { return word * 64 + accBits; }
+  void flush() {
+    if (accBits) out[word] = acc;
+  }
+};
+
+// --- DESTUFF ---
+
+// Removes the stuff bits of nBits stuffed bits. Returns the number of data
+// bits written to `out`, which needs (nBits + 63) / 64 words. On a stuff
+// error (six equal bits) it stops there and sets *errorAt to the position
+// of the offending bit; otherwise *errorAt is nBits.
+inline size_t can_destuff_bits(const uint64_t *in, size_t nBits, uint64_t *out, size_t *errorAt) {
+  size_t words = (nBits + 63) / 64;
+  CAN_BitWriter writer(out);
+  uint64_t prevBit = 0;  // Last bit of the previous word
+  uint64_t prevEq = 0;   // "No transition" flags of the previous word
+  *errorAt = nBits;
+
+  for (size_t k = 0; k < words; k++) {
+    uint64_t w = in[k];
+    unsigned valid = k + 1 < words ? 64 : (unsigned)(nBits - k * 64);
+    // eq bit i: bit i equals bit i-1. The first bit of the stream starts a run.
+    uint64_t eq = ~(w ^ ((w << 1) | prevBit));
+    if (k == 0) eq &= ~(uint64_t)1;
+    // Stuff bit j: bits j-5..j-1 equal, i.e. eq at j-1..j-4
+    uint64_t stuff = ((eq << 1) | (prevEq >> 63)) & ((eq << 2) | (prevEq >> 62)) &
+                     ((eq << 3) | (prevEq >> 61)) & ((eq << 4) | (prevEq >> 60));
+    uint64_t keep = can_low_mask(valid);
+
+    // A stuff bit at the same level as the bit before is a sixth equal bit
+    uint64_t error = stuff & eq & keep;
+    if (error) {
+      int p = can_ctz64(error);
+      *errorAt = k * 64 + p;
+      keep = can_low_mask(p);
+    }
+
+    keep &= ~stuff;
+    writer.put(can_squeeze_bits(w, keep), can_popcount64(keep));
+    if (error) break;
+    prevBit = w >> 63;
+    prevEq = eq;
+  }
+  writer.flush();
+  return writer.bits();
+}
+
+// --- STUFF ---
+
+// Stuffs nBits data bits. Returns the number of bits written to `out`,
+// which needs (nBits + nBits / 4 + 64) / 64 words.
+inline size_t can_stuff_bits(const uint64_t *in, size_t nBits, uint64_t *out) {
+  size_t words = (nBits + 63) / 64;
+  CAN_BitWriter writer(out);
+  uint64_t last = 0;  // Level of the current run
+  unsigned run = 0;   // Its length so far, 0 before the first bit
+
+  // 48 input bits gain at most 13 stuff bits, so a chunk fits one word
+  for (size_t pos = 0; pos < nBits;) {
+    unsigned n = nBits - pos < 48 ? (unsigned)(nBits - pos) : 48;
+    uint64_t x = can_read_bits(in, words, pos, n);
+    uint64_t gaps = 0;       // Stuff positions in the output chunk
+    uint64_t stuffBits = 0;  // Their levels
+    unsigned start = 0;
+    unsigned inserted = 0;
+
+    for (;;) {
+      uint64_t y = x >> start;
+      unsigned m = n - start;
+      uint64_t eq = ~(y ^ ((y << 1) | last));
+      if (run == 0) eq &= ~(uint64_t)1;
+      // The current run contributes run - 1 "no transition" flags before bit 0
+      uint64_t prevEq = run >= 2 ? ~(uint64_t)0 << (64 - (run - 1)) : 0;
+      // Bit p ends a run of five: eq at p..p-3
+      uint64_t five = eq & ((eq << 1) | (prevEq >> 63)) & ((eq << 2) | (prevEq >> 62)) &
+                      ((eq << 3) | (prevEq >> 61));
+      five &= can_low_mask(m);
+
+      if (!five) {
+        // Carry the trailing run into the next chunk
+        uint64_t top = (y >> (m - 1)) & 1;
+        uint64_t differ = (y ^ (0 - top)) & can_low_mask(m);
+        if (differ == 0) run = (eq & 1) ? run + m : m;
+        else run = m - 1 - (63 - can_clz64(differ));
+        last = top;
+        break;
+      }
+
+      int p = can_ctz64(five);
+      unsigned at = start + p + 1 + inserted;
+      last = ((y >> p) & 1) ^ 1;
+      gaps |= (uint64_t)1 << at;
+      stuffBits |= last << at;
+      inserted++;
+      run = 1;
+      start += p + 1;
+      if (start == n) break;
+    }
+
+    unsigned outBits = n + inserted;
+    writer.put(can_spread_bits(x, ~gaps & can_low_mask(outBits)) | stuffBits, outBits);
+    pos += n;
+  }
+  writer.flush();
+  return writer.bits();
+}
+
+// --- SCALAR REFERENCE ---
+
+inline bool can_get_bit(const uint64_t *bits, size_t i) { return (bits[i / 64] >> (i % 64)) & 1; }
+
+inline void can_set_bit(uint64_t *bits, size_t i, bool level) {
+  if (level) bits[i / 64] |= (uint64_t)1 << (i % 64);
+  else bits[i / 64] &= ~((uint64_t)1 << (i % 64));
+}
+
+inline size_t can_destuff_bits_scalar(const uint64_t *in, size_t nBits, uint64_t *out, size_t *errorAt) {
+  size_t n = 0;
+  int count = 0;
+  bool level = false;
+  *errorAt = nBits;
+  for (size_t i = 0; i < nBits; i++) {
+    bool bit = can_get_bit(in, i);
+    if (count == 5) {
+      if (bit == level) {
+        *errorAt = i;
+        break;
+      }
+      level = bit;
+      count = 1;
+      continue;
+    }
+    if (count > 0 && bit == level) {
+      count++;
+    } else {
+      level = bit;
+      count = 1;
+    }
+    can_set_bit(out, n++, bit);
+  }
+  return n;
+}
+
+inline size_t can_stuff_bits_scalar(const uint64_t *in, size_t nBits, uint64_t *out) {
+  size_t n = 0;
+  int count = 0;
+  bool level = false;
+  for (size_t i = 0; i < nBits; i++) {
+    bool bit = can_get_bit(in, i);
+    can_set_bit(out, n++, bit);
+    if (count > 0 && bit == level) {
+      count++;
+    } else {
+      level = bit;
+      count = 1;
+    }
+    if (count == 5) {
+      level = !level;
+      can_set_bit(out, n++, level);
+      count = 1;
+    }
+  }
+  return n;
+}
+
+#endif // ESP_CAN_STUFFING_H
@@ -0,0 +1,98 @@
+/*
+ * ESP_CAN_Waveform.h - Stuffed bus bits of a frame, ready to clock out.
+ *
+ * can_encode_waveform() builds the bit sequence, CRC-15 and stuffing of a
+ * data or remote frame in one pass. It is what sendFrame() and
+ * startFrame() run for every frame. Built as C++14 or later it is
+ * constexpr, so a frame whose ID, DLC and payload are constant can be
+ * encoded by the compiler:
+ *
+ *   static constexpr CAN_PrecomputedFrame HEARTBEAT =
+ *       can_precompute({0x123, 4, {0xDE, 0xAD, 0xBE, 0xEF}});
+ *   can.sendPrecomputed(HEARTBEAT);
+ *
+ * A constexpr object at namespace scope lives in flash (.rodata). Depends
+ * on ESP_CAN_Frame.h and the CRC step in ESP_CAN_Decoder.h only, so host
+ * tools can use it without Arduino. tools/wavecheck checks it.
+ */
+
+#ifndef ESP_CAN_WAVEFORM_H
+#define ESP_CAN_WAVEFORM_H
+
+#include <stdint.h>
+#include "ESP_CAN_Decoder.h"
+#include "ESP_CAN_Frame.h"
+
+#if __cplusplus >= 201402L
+#define CAN_CONSTEXPR14 constexpr
+#else
+#define CAN_CONSTEXPR14 inline
+#endif
+
+struct CAN_Waveform {
+  uint32_t words[4];       // Bit i in bit (i % 32) of words[i / 32], 1 = recessive
+  uint8_t length;          // SOF to the last CRC bit, stuff bits included
+  uint8_t arbitrationEnd;  // Bits before this index are in arbitration
+
+  constexpr bool bit(int i) const { return (words[i >> 5] >> (i & 31)) & 1; }
+};
+
+struct CAN_PrecomputedFrame {
+  CAN_Frame frame;  // Kept for loopback, which returns the frame sent
+  CAN_Waveform waveform;
+};
+
+// Appends bits with stuffing and, for the fields it covers, the CRC.
+struct CAN_WaveformBuilder {
+  CAN_Waveform wave;
+  uint16_t crc;
+  int run;
+  bool last;
+
+  CAN_CONSTEXPR14 void put(bool bit) {
+    if (bit) wave.words[wave.length >> 5] |= (uint32_t)1 << (wave.length & 31);
+    wave.length++;
+  }
+  CAN_CONSTEXPR14 void stuffed(bool bit) {
+    put(bit);
+    run = bit == last ? run + 1 : 1;
+    last = bit;
+    if (run == 5) {
+      put(!bit);
+      last = !bit;
+      run = 1;
+    }
+  }
+  CAN_CONSTEXPR14 void field(uint32_t value, int bits) {
+    for (int i = bits - 1; i >= 0; i--) {
+      bool bit = (value >> i) & 1;
+      crc = can_crc15_step(crc, bit);
+      stuffed(bit);
+    }
+  }
+};
+
+CAN_CONSTEXPR14 CAN_Waveform can_encode_waveform(const CAN_Frame &frame) {
+  CAN_WaveformBuilder b = {{{0, 0, 0, 0}, 0, 0}, 0, 1, false};
+  b.put(false);  // SOF
+  b.field(frame.id & 0x7FF, 11);
+  bool remote = (frame.id & CAN_RTR_FLAG) != 0;
+  b.field(remote, 1);  // RTR
+  // A stuff bit right after RTR is still arbitration
+  b.wave.arbitrationEnd = b.wave.length;
+  b.field(0, 2);  // IDE, r0
+  uint8_t dlc = frame.dlc > 8 ? 8 : frame.dlc;
+  b.field(dlc, 4);
+  if (!remote) {
+    for (int i = 0; i < dlc; i++) b.field(frame.data[i], 8);
+  }
+  uint16_t crc = b.crc;
+  for (int i = 14; i >= 0; i--) b.stuffed((crc >> i) & 1);
+  return b.wave;
+}
+
+CAN_CONSTEXPR14 CAN_PrecomputedFrame can_precompute(const CAN_Frame &frame) {
+  return CAN_PrecomputedFrame{frame, can_encode_waveform(frame)};
+}
+
+#endif // ESP_CAN_WAVEFORM_H
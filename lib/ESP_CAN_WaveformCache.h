@@ -0,0 +1,118 @@
+/*
+ * ESP_CAN_WaveformCache.h - Reuses the encoded bits of repeated frames.
+ *
+ * Status frames often repeat the same payload for long stretches. A cache
+ * attached with ESP_CAN::setWaveformCache() keeps the stuffed waveforms of
+ * the last N distinct frames, keyed by ID, RTR, DLC and payload.
+ * sendFrame() and startFrame() then skip building the bit sequence, CRC
+ * and stuffing when the frame was sent before. Payload bytes past the DLC
+ * are not part of the key. A new payload for an ID replaces the entry of
+ * that ID; otherwise entries that were never reused go first, least
+ * recently used first.
+ *
+ * A lookup compares every entry, so N should stay small (4 to 32).
+ * Header-only, so sketches need no extra .cpp. Depends on
+ * ESP_CAN_Waveform.h only, so it builds without Arduino.
+ */
+
+#ifndef ESP_CAN_WAVEFORM_CACHE_H
+#define ESP_CAN_WAVEFORM_CACHE_H
+
+#include <stdint.h>
+#include "ESP_CAN_Waveform.h"
+
+struct CAN_WaveformCacheEntry {
+  uint64_t payload;   // data[0] in the low byte, bytes past the DLC zero
+  uint32_t key;       // RTR << 15 | ID << 4 | DLC, or CAN_WAVEFORM_CACHE_EMPTY
+  uint32_t lastUse;
+  bool reused;        // Hit at least once since it was stored
+  CAN_Waveform waveform;
+};
+
+#define CAN_WAVEFORM_CACHE_EMPTY 0xFFFFFFFF
+
+// The cache without its storage, so ESP_CAN can hold any size.
+class CAN_WaveformCacheBase {
+public:
+  uint32_t hits;
+  uint32_t misses;
+
+  // The waveform of `frame`, from the cache or freshly encoded and stored.
+  const CAN_Waveform &encode(const CAN_Frame &frame) {
+    uint8_t dlc = frame.dlc > 8 ? 8 : frame.dlc;
+    bool remote = can_is_remote(frame);
+    uint32_t key = (uint32_t)remote << 15 | (frame.id & 0x7FF) << 4 | dlc;
+    uint64_t payload = 0;
+    if (!remote) {
+      for (int i = dlc - 1; i >= 0; i--) payload = payload << 8 | frame.data[i];
+    }
+    _clock++;
+
+    // A hit, else the entry to replace: the same ID with an older payload,
+    // since a periodic message only repeats its latest one. Otherwise the
+    // least recently used entry that was never reused, so frames that
+    // change on every send (alive counters) cannot push out the ones that
+    // repeat. Failing that, the least recently used entry.
+    int same = -1;
+    uint8_t victim = 0;
+    for (uint8_t i = 0; i < _size; i++) {
+      CAN_WaveformCacheEntry &e = _entries[i];
+      if (e.key == key) {
+        if (e.payload == payload) {
+          e.lastUse = _clock;
+          e.reused = true;
+          hits++;
+          return e.waveform;
+        }
+        same = i;
+      }
+      const CAN_WaveformCacheEntry &v = _entries[victim];
+      if (e.reused != v.reused ? !e.reused : _clock - e.lastUse > _clock - v.lastUse) victim = i;
+    }
+    if (same >= 0) victim = same;
+
+    misses++;
+    CAN_WaveformCacheEntry &e = _entries[victim];
+    e.key = key;
+    e.payload = payload;
+    e.lastUse = _clock;
+    e.reused = false;
+    e.waveform = can_encode_waveform(frame);
+    return e.waveform;
+  }
+
+  // Forgets all entries and zeroes the counters.
+  void clear() {
+    for (uint8_t i = 0; i < _size; i++) {
+      _entries[i].key = CAN_WAVEFORM_CACHE_EMPTY;
+      _entries[i].lastUse = 0;
+      _entries[i].reused = false;
+    }
+    hits = 0;
+    misses = 0;
+    _clock = 0;
+  }
+
+  uint8_t size() const { return _size; }
+
+protected:
+  CAN_WaveformCacheBase(CAN_WaveformCacheEntry *entries, uint8_t size) : _entries(entries), _size(size) { clear(); }
+
+private:
+  CAN_WaveformCacheEntry *_entries;
+  uint8_t _size;
+  uint32_t _clock;  // Incremented on every lookup, for LRU
+};
+
+template <uint8_t N>
+class CAN_WaveformCache : public CAN_WaveformCacheBase {
+  static_assert(N > 0, "cache needs at least one entry");
+
+public:
+  CAN_WaveformCache() : CAN_WaveformCacheBase(_storage, N) {}
+
+private:
+  CAN_WaveformCacheEntry _storage[N];
+};
+
+#endif // ESP_CAN_WAVEFORM_CACHE_H
@@ -0,0 +1,153 @@
+/*
+ * baudcheck.cpp - Checks auto-baud detection on synthesized edge streams.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -Ilib -o baudcheck tools/baudcheck/baudcheck.cpp \
+ *       lib/ESP_CAN_BaudEstimate.cpp lib/ESP_CAN_Decoder.cpp
+ * Usage:
+ *   baudcheck [-n trials] [-j jitter_percent] [-o clock_ppm] [-f max_frames]
+ *
+ * For every standard rate from 10 kbit/s to 1 Mbit/s, random frames (ACKed,
+ * with random idle time between them) are turned into edge timestamps on a
+ * 240 MHz cycle counter that starts just before its 32-bit wrap. The bit
+ * clock of the sender is off by up to -o ppm and every edge moves by up to
+ * -j percent of a bit. The edges reach can_estimate_baudrate() in small
+ * chunks through the same analysis window ESP_CAN_AutoBaud uses. Prints the
+ * frames needed per rate and exits 1 if a wrong rate is picked or none is
+ * found within -f frames.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "ESP_CAN_BaudEstimate.h"
+#include "ESP_CAN_Waveform.h"
+
+static const long BITRATES[] = {10000, 20000, 50000, 83333, 100000, 125000, 250000, 500000, 800000, 1000000};
+static const uint32_t CLOCK_HZ = 240000000;
+static const int WINDOW = 512;        // As ESP_CAN_AutoBaud
+static const int FRAMES_REQUIRED = 2; // CAN_AUTOBAUD_FRAMES
+
+struct Edge {
+  uint32_t time;
+  uint8_t level;
+};
+
+// Bus bits of one frame as a receiver sees them, ACK slot driven dominant,
+// followed by the intermission and random idle time.
+static void frameBits(std::mt19937 &rng, std::vector<uint8_t> &bits) {
+  CAN_Frame f;
+  f.id = rng() & 0x7FF;
+  f.dlc = rng() % 9;
+  // Mostly zero or all-ones bytes, so stuffing is common
+  for (int i = 0; i < 8; i++) f.data[i] = rng() % 3 == 0 ? rng() : (rng() & 1) * 0xFF;
+  if (rng() % 8 == 0) f.id |= CAN_RTR_FLAG;
+  CAN_Waveform wave = can_encode_waveform(f);
+  for (int i = 0; i < wave.length; i++) bits.push_back(wave.bit(i));
+  bits.push_back(1);  // CRC delimiter
+  bits.push_back(0);  // ACK slot
+  for (int i = 0; i < 7 + 1 + 3; i++) bits.push_back(1);  // ACK delimiter, EOF, intermission
+  for (int i = rng() % 40; i > 0; i--) bits.push_back(1);
+}
+
+// Frames needed until the rate is found, 0 if not within maxFrames, -1 if
+// a wrong rate was picked.
+static int trial(std::mt19937 &rng, long rate, double jitter, double ppm, int maxFrames, long &picked) {
+  double skew = 1.0 + ppm * 1e-6 * ((double)rng() / rng.max() * 2 - 1);
+  double bitTicks = CLOCK_HZ / (rate * skew);
+  std::uniform_real_distribution<double> move(-jitter * bitTicks, jitter * bitTicks);
+
+  uint32_t time[WINDOW];
+  uint8_t level[WINDOW];
+  int count = 0;
+  uint32_t start = 0xFFF00000u;  // Wraps during the trial
+  uint64_t bitIndex = 100 + rng() % 100;
+  bool bus = true;
+
+  for (int frame = 1; frame <= maxFrames; frame++) {
+    std::vector<uint8_t> bits;
+    frameBits(rng, bits);
+    std::vector<Edge> edges;
+    for (size_t i = 0; i < bits.size(); i++, bitIndex++) {
+      if (bits[i] == bus) continue;
+      bus = bits[i];
+      edges.push_back(Edge{start + (uint32_t)(int64_t)(bitIndex * bitTicks + move(rng)), bus});
+    }
+
+    // Polls see a few edges at a time
+    size_t next = 0;
+    while (next < edges.size()) {
+      size_t chunk = 1 + rng() % 32;
+      for (; chunk > 0 && next < edges.size(); chunk--, next++) {
+        if (count == WINDOW) {
+          memmove(time, time + WINDOW / 2, (WINDOW / 2) * sizeof(time[0]));
+          memmove(level, level + WINDOW / 2, (WINDOW / 2) * sizeof(level[0]));
+          count -= WINDOW / 2;
+        }
+        time[count] = edges[next].time;
+        level[count] = edges[next].level;
+        count++;
+      }
+      if (count < 64) continue;
+
+      CAN_BaudEstimate e = can_estimate_baudrate(time, level, count, CLOCK_HZ, FRAMES_REQUIRED);
+      if (e.status == CAN_BAUD_FOUND) {
+        picked = e.baudrate;
+        return e.baudrate == rate ? frame : -1;
+      }
+      int drop = e.status == CAN_BAUD_INCONSISTENT ? count / 2 : count == WINDOW ? WINDOW / 2 : 0;
+      if (drop > 0) {
+        memmove(time, time + drop, (count - drop) * sizeof(time[0]));
+        memmove(level, level + drop, (count - drop) * sizeof(level[0]));
+        count -= drop;
+      }
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int trials = 200;
+  double jitter = 6;
+  double ppm = 5000;
+  int maxFrames = 8;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) trials = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-j") && i + 1 < argc) jitter = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc) ppm = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-f") && i + 1 < argc) maxFrames = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: baudcheck [-n trials] [-j jitter_percent] [-o clock_ppm] [-f max_frames]\n");
+      return 2;
+    }
+  }
+
+  printf("%d trials per rate, %.1f%% edge jitter, %.0f ppm clock error\n", trials, jitter, ppm);
+  std::mt19937 rng(1);
+  int failures = 0;
+  for (long rate : BITRATES) {
+    long frames = 0;
+    int worst = 0, wrong = 0, missed = 0;
+    for (int t = 0; t < trials; t++) {
+      long picked = 0;
+      int n = trial(rng, rate, jitter / 100, ppm, maxFrames, picked);
+      if (n < 0) {
+        if (wrong++ == 0) fprintf(stderr, "%ld bit/s: picked %ld bit/s\n", rate, picked);
+      } else if (n == 0) {
+        missed++;
+      } else {
+        frames += n;
+        if (n > worst) worst = n;
+      }
+    }
+    int found = trials - wrong - missed;
+    printf("%8ld bit/s: %.2f frames average, %d worst", rate, found ? (double)frames / found : 0.0, worst);
+    if (wrong || missed) printf(", %d wrong, %d not found", wrong, missed);
+    printf("\n");
+    failures += wrong + missed;
+  }
+  return failures ? 1 : 0;
+}
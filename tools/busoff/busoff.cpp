@@ -0,0 +1,204 @@
+/*
+ * busoff.cpp - Checks fault confinement and bus-off recovery of ESP_CAN.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -Itools/canloop -Ilib -o busoff tools/busoff/busoff.cpp
+ * Usage:
+ *   busoff [-r bitrate] [-s cycles]
+ *
+ * Two nodes share canloop's simulated wired-AND bus and are polled in turn,
+ * so each sees the bus every 2 x -s cycles. A transmitter only moves its TX
+ * pin when polled, so an interval that does not divide the bit time has to
+ * stay well inside the part of a bit after the sample point (1/8 at the
+ * default timing), as with canloop -R. A third pin holds the
+ * bus dominant for 7 bits in the middle of every frame the transmitter
+ * starts, so each attempt ends in a bit error and the TEC climbs by 8
+ * until the node goes bus-off. While it recovers, one dominant bit is put
+ * on the bus half way through, which must restart the current sequence.
+ * The node must rejoin exactly 128 x 11 recessive bits after bus-off (plus
+ * the restarted part), with both counters cleared, after the state
+ * changes active -> passive -> bus-off -> active, and then send a frame.
+ * The run is done with auto-recovery and with recover() called by hand.
+ * Exits 1 on any deviation.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "ESP_CAN.cpp"
+#include "ESP_CAN_BitTiming.cpp"
+#include "ESP_CAN_Decoder.cpp"
+
+uint64_t canloop_cycles = 0;
+uint32_t canloop_step = 40;
+uint32_t canloop_mhz = 240;
+uint64_t canloop_dominant = 0;
+EspClass ESP;
+
+static const int DISTURB_PIN = 5;
+
+struct Transitions {
+  CAN_State states[8];
+  int count;
+  uint64_t busOffAt;  // Cycle count of bus-off entry
+  uint64_t activeAt;  // Cycle count of the return to error active
+};
+
+static void onState(CAN_State, CAN_State current, void *arg) {
+  Transitions &t = *(Transitions *)arg;
+  if (t.count < 8) t.states[t.count++] = current;
+  if (current == CAN_STATE_BUS_OFF) t.busOffAt = canloop_cycles;
+  if (current == CAN_STATE_ERROR_ACTIVE) t.activeAt = canloop_cycles;
+}
+
+static const char *stateName(CAN_State s) {
+  return s == CAN_STATE_ERROR_ACTIVE ? "active" : s == CAN_STATE_ERROR_PASSIVE ? "passive" : "bus-off";
+}
+
+static int run(long bitrate, bool autoRecover) {
+  canloop_dominant = 0;
+  ESP_CAN node(0, 1), peer(2, 3);
+  node.begin(bitrate);
+  peer.begin(bitrate);
+  node.setAutoRecover(autoRecover);
+  Transitions t = {{}, 0, 0, 0};
+  node.onStateChange(onState, &t);
+
+  uint64_t bitCycles = (uint64_t)canloop_mhz * 1000000 / bitrate;
+  CAN_Frame frame = {0x123, 8, {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88}};
+  CAN_Frame got;
+  int failures = 0;
+
+  // Every attempt is retried and every attempt is disturbed
+  node.startFrame(frame, can_tx_retries(255));
+  uint32_t disturbedSof = 0;
+  uint64_t releaseAt = 0;
+  int attempts = 0;
+  uint64_t limit = canloop_cycles + 2000 * 200 * bitCycles;
+  while (node.state != CAN_STATE_BUS_OFF && canloop_cycles < limit) {
+    node.readFrame(got);
+    peer.readFrame(got);
+    if (releaseAt && canloop_cycles >= releaseAt) {
+      digitalWrite(DISTURB_PIN, HIGH);
+      releaseAt = 0;
+    }
+    if (node.txState() == CAN_TX_SENDING && node.txStartCycles() != disturbedSof &&
+        (uint32_t)canloop_cycles - node.txStartCycles() > 20 * bitCycles) {
+      disturbedSof = node.txStartCycles();
+      attempts++;
+      digitalWrite(DISTURB_PIN, LOW);
+      releaseAt = canloop_cycles + 7 * bitCycles;
+    }
+  }
+  digitalWrite(DISTURB_PIN, HIGH);
+  if (node.state != CAN_STATE_BUS_OFF) {
+    printf("  never went bus-off: TEC %u after %d attempts\n", node.tec, attempts);
+    return 1;
+  }
+  printf("  bus-off after %d disturbed attempts, %u bit errors, TEC %u\n", attempts, node.errors.bit, node.tec);
+  if (attempts != 32) {
+    printf("  expected 32 attempts to pass TEC 255\n");
+    failures++;
+  }
+  if (node.startFrame(frame) || node.sendFrame(frame)) {
+    printf("  a frame was accepted while bus-off\n");
+    failures++;
+  }
+
+  // Without auto-recovery nothing happens until recover()
+  uint64_t recoverAt = t.busOffAt;
+  if (!autoRecover) {
+    uint64_t waitUntil = canloop_cycles + 3000 * bitCycles;
+    while (canloop_cycles < waitUntil) {
+      node.readFrame(got);
+      peer.readFrame(got);
+    }
+    if (node.state != CAN_STATE_BUS_OFF || node.recoveryProgress() != 0) {
+      printf("  recovered without recover()\n");
+      failures++;
+    }
+    node.recover();
+    recoverAt = canloop_cycles;
+  }
+
+  // One dominant bit half way through, 5 bits into the 65th sequence
+  uint64_t pulseAt = recoverAt + (64 * 11 + 5) * bitCycles;
+  uint64_t pulseEnd = pulseAt + bitCycles;
+  bool pulsed = false;
+  int sequencesAtPulse = 0;
+  limit = canloop_cycles + 4000 * bitCycles;
+  while (node.state == CAN_STATE_BUS_OFF && canloop_cycles < limit) {
+    if (!pulsed && canloop_cycles >= pulseAt) {
+      sequencesAtPulse = node.recoveryProgress();
+      digitalWrite(DISTURB_PIN, LOW);
+      pulsed = true;
+    }
+    if (pulsed && canloop_cycles >= pulseEnd) digitalWrite(DISTURB_PIN, HIGH);
+    node.readFrame(got);
+    peer.readFrame(got);
+  }
+  if (node.state != CAN_STATE_ERROR_ACTIVE) {
+    printf("  no recovery, %u of 128 sequences\n", node.recoveryProgress());
+    return 1;
+  }
+
+  // The pulse restarts the 65th sequence: the remaining 64 count from
+  // the end of the pulse.
+  double expected = (double)(pulseEnd - recoverAt) / bitCycles + (128 - sequencesAtPulse) * 11;
+  double measured = (double)(t.activeAt - recoverAt) / bitCycles;
+  printf("  recovered %.2f bit times after %s, %.2f expected (pulse in sequence %d)\n", measured,
+         autoRecover ? "bus-off" : "recover()", expected, sequencesAtPulse + 1);
+  if (measured < expected || measured > expected + 2.0 * canloop_step / bitCycles + 0.01) failures++;
+  if (node.tec != 0 || node.rec != 0) {
+    printf("  counters not cleared: TEC %u, REC %u\n", node.tec, node.rec);
+    failures++;
+  }
+
+  static const CAN_State SEQUENCE[] = {CAN_STATE_ERROR_PASSIVE, CAN_STATE_BUS_OFF, CAN_STATE_ERROR_ACTIVE};
+  bool order = t.count == 3;
+  for (int i = 0; order && i < 3; i++) order = t.states[i] == SEQUENCE[i];
+  if (!order) {
+    printf("  state changes:");
+    for (int i = 0; i < t.count; i++) printf(" %s", stateName(t.states[i]));
+    printf("\n");
+    failures++;
+  }
+
+  // Back on the bus: the peer acknowledges and receives the next frame
+  bool received = false;
+  node.startFrame(frame);
+  limit = canloop_cycles + 400 * bitCycles;
+  while (!received && canloop_cycles < limit) {
+    node.readFrame(got);
+    received = peer.readFrame(got) == CAN_READ_MSG_OK && got.id == frame.id;
+  }
+  while (node.txState() == CAN_TX_SENDING && canloop_cycles < limit + 100 * bitCycles) {
+    node.readFrame(got);
+    peer.readFrame(got);
+  }
+  if (!received || node.txState() != CAN_TX_DONE) {
+    printf("  no frame after recovery\n");
+    failures++;
+  }
+  return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  long bitrate = 500000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-r") && i + 1 < argc) bitrate = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) canloop_step = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: busoff [-r bitrate] [-s cycles]\n");
+      return 2;
+    }
+  }
+  printf("%ld bit/s, %u cycles per poll\n", bitrate, canloop_step);
+  printf("auto-recovery:\n");
+  int status = run(bitrate, true);
+  printf("recover() by hand:\n");
+  status |= run(bitrate, false);
+  printf(status ? "FAILED\n" : "ok\n");
+  return status;
+}
@@ -0,0 +1,177 @@
+/*
+ * CaptureReader.h - Memory-mapped reader for binary CAN capture files (host).
+ *
+ * Answers "all frames for ID X between t0 and t1" by binary-searching the
+ * per-block index entries by time, skipping blocks whose ID bitmap lacks X,
+ * and binary-searching inside the remaining blocks. Only the pages that hold
+ * matching blocks are touched, so query cost does not grow with file size.
+ *
+ * POSIX only (mmap). Records written after the last complete block of a
+ * capture that was never closed are scanned linearly.
+ */
+
+#ifndef CAPTURE_READER_H
+#define CAPTURE_READER_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+#include "ESP_CAN_CaptureFormat.h"
+
+class CaptureReader {
+public:
+  ~CaptureReader() { close(); }
+
+  bool open(const char *path, std::string &error) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) { error = std::string("cannot open ") + path; return false; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CAN_CaptureFileHeader)) {
+      ::close(fd);
+      error = "file too small";
+      return false;
+    }
+    _size = (size_t)st.st_size;
+    void *map = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) { error = "mmap failed"; return false; }
+    _base = (const uint8_t *)map;
+    madvise(map, _size, MADV_RANDOM);
+
+    CAN_CaptureFileHeader header;
+    memcpy(&header, _base, sizeof(header));
+    if (memcmp(header.magic, CAN_CAPTURE_MAGIC, 8) != 0 || header.version < 1 || header.version > CAN_CAPTURE_VERSION ||
+        header.blockRecords == 0) {
+      error = "not a capture file";
+      close();
+      return false;
+    }
+    _startUnixTimeUs = header.startUnixTimeUs;
+    _blockRecords = header.blockRecords;
+    _blockBytes = can_capture_block_bytes(_blockRecords);
+
+    size_t body = _size - sizeof(header);
+    _closed = false;
+    if (body >= sizeof(CAN_CaptureFooter)) {
+      CAN_CaptureFooter footer;
+      memcpy(&footer, _base + _size - sizeof(footer), sizeof(footer));
+      if (footer.magic == CAN_CAPTURE_FOOTER_MAGIC && (body - sizeof(footer)) % _blockBytes == 0) {
+        _closed = true;
+        _recordCount = footer.recordCount;
+        _firstTimestampUs = footer.firstTimestampUs;
+        _lastTimestampUs = footer.lastTimestampUs;
+        body -= sizeof(footer);
+      }
+    }
+    _blockCount = body / _blockBytes;
+    // An unclosed capture may end inside a block; those records have no index yet.
+    size_t tailBytes = _closed ? 0 : body - _blockCount * _blockBytes;
+    _tail = (const CAN_CaptureRecord *)(_base + sizeof(header) + _blockCount * _blockBytes);
+    _tailCount = tailBytes / sizeof(CAN_CaptureRecord);
+    if (!_closed) {
+      _recordCount = _tailCount;
+      _firstTimestampUs = _lastTimestampUs = 0;
+      bool any = false;
+      for (uint64_t b = 0; b < _blockCount && index(b).magic == CAN_CAPTURE_BLOCK_MAGIC; b++) {
+        _recordCount += index(b).recordCount;
+        if (!any) _firstTimestampUs = index(b).firstTimestampUs;
+        _lastTimestampUs = index(b).lastTimestampUs;
+        any = true;
+      }
+      if (_tailCount > 0) {
+        if (!any) _firstTimestampUs = can_capture_timestamp(_tail[0]);
+        _lastTimestampUs = can_capture_timestamp(_tail[_tailCount - 1]);
+      }
+    }
+    return true;
+  }
+
+  void close() {
+    if (_base) munmap((void *)_base, _size);
+    _base = nullptr;
+    _size = 0;
+  }
+
+  uint64_t recordCount() const { return _recordCount; }
+  uint64_t blockCount() const { return _blockCount; }
+  bool closedCleanly() const { return _closed; }
+  uint64_t startUnixTimeUs() const { return _startUnixTimeUs; }
+  // Timestamps of the first and last record, from the footer when the
+  // capture was closed, otherwise from the block index and the tail.
+  uint64_t firstTimestampUs() const { return _firstTimestampUs; }
+  uint64_t lastTimestampUs() const { return _lastTimestampUs; }
+
+  // Calls fn(const CAN_CaptureRecord&) for every frame with timestamp in
+  // [t0, t1] and, if id >= 0, that ID. Returns the number of matches, 0 for
+  // an ID above 0x7FF.
+  template <class Fn>
+  uint64_t query(int id, uint64_t t0, uint64_t t1, Fn fn) const {
+    uint64_t matches = 0;
+    if (id > 0x7FF) return 0;
+
+    // First block whose last timestamp reaches t0
+    uint64_t lo = 0, hi = _blockCount;
+    while (lo < hi) {
+      uint64_t mid = (lo + hi) / 2;
+      if (index(mid).lastTimestampUs < t0) lo = mid + 1; else hi = mid;
+    }
+
+    for (uint64_t b = lo; b < _blockCount; b++) {
+      const CAN_CaptureBlockIndex &entry = index(b);
+      if (entry.magic != CAN_CAPTURE_BLOCK_MAGIC) break; // Torn write
+      if (entry.firstTimestampUs > t1) return matches;
+      if (id >= 0 && !(entry.idBitmap[id >> 5] & (1u << (id & 31)))) continue;
+      matches += scan(records(b), entry.recordCount, id, t0, t1, fn);
+    }
+    matches += scan(_tail, _tailCount, id, t0, t1, fn);
+    return matches;
+  }
+
+private:
+  const uint8_t *_base = nullptr;
+  size_t _size = 0;
+  uint32_t _blockRecords = 0;
+  uint64_t _blockBytes = 0;
+  uint64_t _blockCount = 0;
+  uint64_t _recordCount = 0;
+  uint64_t _startUnixTimeUs = 0;
+  uint64_t _firstTimestampUs = 0;
+  uint64_t _lastTimestampUs = 0;
+  bool _closed = false;
+  const CAN_CaptureRecord *_tail = nullptr;
+  size_t _tailCount = 0;
+
+  const CAN_CaptureRecord *records(uint64_t block) const {
+    return (const CAN_CaptureRecord *)(_base + sizeof(CAN_CaptureFileHeader) + block * _blockBytes);
+  }
+
+  const CAN_CaptureBlockIndex &index(uint64_t block) const {
+    return *(const CAN_CaptureBlockIndex *)((const uint8_t *)records(block) +
+                                             (uint64_t)_blockRecords * sizeof(CAN_CaptureRecord));
+  }
+
+  template <class Fn>
+  static uint64_t scan(const CAN_CaptureRecord *r, size_t count, int id, uint64_t t0, uint64_t t1, Fn &fn) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (can_capture_timestamp(r[mid]) < t0) lo = mid + 1; else hi = mid;
+    }
+    uint64_t matches = 0;
+    for (size_t i = lo; i < count; i++) {
+      if (can_capture_timestamp(r[i]) > t1) break;
+      if (id >= 0 && can_capture_id(r[i]) != id) continue;
+      fn(r[i]);
+      matches++;
+    }
+    return matches;
+  }
+};
+
+#endif // CAPTURE_READER_H
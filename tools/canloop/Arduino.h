@@ -0,0 +1,72 @@
+/*
+ * Arduino.h - Host stand-in for the few Arduino-ESP32 calls that the ESP_CAN
+ * bit engine uses, so canloop can build lib/ESP_CAN.cpp unchanged.
+ *
+ * The cycle counter is virtual: every read advances it by canloop_step
+ * cycles, which is how far apart the polls of a real ESP32 would be. The
+ * bus timing therefore behaves as on the device, and the program runs as
+ * fast as the host can execute the library code. Pins 8k to 8k+7 form
+ * wired-AND bus k: any of them reads LOW while one of them is driven LOW,
+ * so several ESP_CAN objects can share a bus as nodes. GPIO_IN_REG and
+ * GPIO_IN1_REG return the levels of all pins at once, as on the ESP32.
+ * Stream is the part of the Arduino class that ESP_CAN_Replay reads from.
+ */
+
+#ifndef CANLOOP_ARDUINO_H
+#define CANLOOP_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+extern uint64_t canloop_cycles;
+extern uint32_t canloop_step;
+extern uint32_t canloop_mhz;
+extern uint64_t canloop_dominant;  // Bit i set: pin i driven LOW
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int pin, int level) {
+  if (level) canloop_dominant &= ~(1ULL << pin);
+  else canloop_dominant |= 1ULL << pin;
+}
+inline int digitalRead(int pin) { return (canloop_dominant >> (pin & ~7)) & 0xFF ? LOW : HIGH; }
+
+#define GPIO_IN_REG 0
+#define GPIO_IN1_REG 1
+inline uint32_t REG_READ(int reg) {
+  uint64_t levels = ~0ULL;
+  for (int bus = 0; bus < 8; bus++) {
+    if ((canloop_dominant >> (8 * bus)) & 0xFF) levels &= ~(0xFFULL << (8 * bus));
+  }
+  return (uint32_t)(levels >> (32 * reg));
+}
+inline unsigned long micros() { return (unsigned long)(canloop_cycles / canloop_mhz); }
+inline unsigned long millis() { return (unsigned long)(canloop_cycles / canloop_mhz / 1000); }
+
+class Stream {
+public:
+  Stream() : _timeout(1000) {}
+  virtual ~Stream() {}
+  virtual int available() = 0;
+  virtual int read() = 0;
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+  unsigned long getTimeout() const { return _timeout; }
+
+private:
+  unsigned long _timeout;
+};
+
+struct EspClass {
+  uint32_t getCycleCount() { return (uint32_t)(canloop_cycles += canloop_step); }
+  uint32_t getCpuFreqMHz() { return canloop_mhz; }
+};
+extern EspClass ESP;
+
+#endif // CANLOOP_ARDUINO_H
@@ -0,0 +1,183 @@
+/*
+ * canloop.cpp - End-to-end loopback benchmark of the ESP_CAN bit engine.
+ *
+ * Build on the host:  g++ -std=c++11 -O2 -Itools/canloop -Ilib -o canloop tools/canloop/canloop.cpp
+ * Usage:              canloop [-n frames] [-r bitrate] [-s cycles] [-b] [-p] [-R]
+ *
+ * Random frames go through the library's full path in internal loopback:
+ * encode and stuff, bit timing on the cycle counter, ACK, sampling and
+ * decode. Every frame read back is compared with the one sent. -s is the
+ * number of CPU cycles between two polls, as on a 240 MHz ESP32 (default
+ * 40). -b uses the blocking sendFrame() instead of startFrame(). -p
+ * encodes each frame up front and sends it with sendPrecomputed() or
+ * startPrecomputed(). -R puts two nodes on the bus instead: one sends
+ * remote frames, the other answers them from its response table, and the
+ * request-to-response latency is measured; the two nodes take turns, so
+ * each is polled every 2 * -s cycles. The exit status is non-zero if
+ * any frame was lost or corrupted, so it can run in CI.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "ESP_CAN.cpp"
+#include "ESP_CAN_BitTiming.cpp"
+#include "ESP_CAN_Decoder.cpp"
+
+uint64_t canloop_cycles = 0;
+uint32_t canloop_step = 40;
+uint32_t canloop_mhz = 240;
+uint64_t canloop_dominant = 0;
+EspClass ESP;
+
+static bool sameFrame(const CAN_Frame &a, const CAN_Frame &b) {
+  return a.id == b.id && a.dlc == b.dlc && memcmp(a.data, b.data, a.dlc) == 0;
+}
+
+// -R: the requester sends a remote frame for a random entry of the
+// responder's table and waits for the answer. The gap is measured from the
+// responder's sample of the request's last EOF bit to its response SOF,
+// the round trip from request SOF to the response read by the requester.
+static int runRemote(long frames, long bitrate) {
+  ESP_CAN requester(0, 1), responder(2, 3);
+  requester.begin(bitrate);
+  responder.begin(bitrate);
+
+  std::mt19937 rng(1);
+  static CAN_PrecomputedFrame responses[CAN_REMOTE_RESPONSES];
+  for (int i = 0; i < CAN_REMOTE_RESPONSES; i++) {
+    CAN_Frame f;
+    f.id = 0x100 + i * 0x40 + (rng() & 0x3F);
+    f.dlc = rng() % 9;
+    for (int k = 0; k < 8; k++) f.data[k] = rng();
+    responses[i] = can_precompute(f);
+    responder.setRemoteResponse(responses[i]);
+  }
+
+  CAN_Frame got, seen;
+  long ok = 0, lost = 0, corrupted = 0;
+  uint64_t gapSum = 0, gapMax = 0, tripSum = 0, tripMax = 0;
+  // Request and response, in polls of each node
+  uint64_t timeoutPolls = 400ULL * ESP.getCpuFreqMHz() * 1000000 / bitrate / canloop_step;
+  double bitCycles = (double)ESP.getCpuFreqMHz() * 1e6 / bitrate;
+
+  for (long n = 0; n < frames; n++) {
+    const CAN_Frame &expected = responses[rng() % CAN_REMOTE_RESPONSES].frame;
+    CAN_Frame request;
+    request.id = expected.id | CAN_RTR_FLAG;
+    request.dlc = expected.dlc;
+    requester.startFrame(request);
+
+    bool received = false;
+    uint32_t requestEnd = 0;
+    for (uint64_t poll = 0; poll < timeoutPolls && !received; poll++) {
+      if (responder.readFrame(seen) == CAN_READ_MSG_OK && can_is_remote(seen)) requestEnd = (uint32_t)canloop_cycles;
+      received = requester.readFrame(got) == CAN_READ_MSG_OK;
+    }
+
+    if (!received) {
+      lost++;
+      continue;
+    }
+    if (!sameFrame(expected, got)) {
+      corrupted++;
+      continue;
+    }
+    ok++;
+    uint64_t gap = responder.txStartCycles() - requestEnd;
+    uint64_t trip = (uint32_t)canloop_cycles - requester.txStartCycles();
+    gapSum += gap;
+    tripSum += trip;
+    if (gap > gapMax) gapMax = gap;
+    if (trip > tripMax) tripMax = trip;
+  }
+  // The responder counts its last response at the end of its EOF
+  for (int poll = 0; poll < 64; poll++) responder.readFrame(seen);
+
+  double mhz = ESP.getCpuFreqMHz();
+  printf("remote frames, %ld bit/s, %u cycles per poll\n", bitrate, canloop_step);
+  printf("frames:     %ld answered, %ld lost, %ld corrupted\n", ok, lost, corrupted);
+  if (ok) {
+    printf("gap:        %.2f bits (%.2f us) average, %.2f bits worst, request EOF to response SOF\n",
+           gapSum / bitCycles / ok, gapSum / mhz / ok, gapMax / bitCycles);
+    printf("round trip: %.1f us average, %.1f us worst, request SOF to response read\n", tripSum / mhz / ok,
+           tripMax / mhz);
+  }
+  printf("responder:  %u responses, TEC %u, REC %u | requester TEC %u, REC %u\n", responder.remoteResponses,
+         responder.tec, responder.rec, requester.tec, requester.rec);
+  return lost || corrupted ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  long frames = 10000;
+  long bitrate = 500000;
+  bool blocking = false;
+  bool precomputed = false;
+  bool remote = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) frames = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) bitrate = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) canloop_step = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-b")) blocking = true;
+    else if (!strcmp(argv[i], "-p")) precomputed = true;
+    else if (!strcmp(argv[i], "-R")) remote = true;
+    else {
+      fprintf(stderr, "usage: canloop [-n frames] [-r bitrate] [-s cycles] [-b] [-p] [-R]\n");
+      return 2;
+    }
+  }
+  if (remote) return runRemote(frames, bitrate);
+
+  ESP_CAN can(0, 1);
+  can.setLoopback(CAN_LOOPBACK_INTERNAL);
+  can.begin(bitrate);
+
+  std::mt19937 rng(1);
+  long ok = 0, lost = 0, corrupted = 0;
+  uint64_t bits = 0;
+  // Generous bound for one frame including the intermission, in polls
+  uint64_t timeoutPolls = 200ULL * ESP.getCpuFreqMHz() * 1000000 / bitrate / canloop_step;
+
+  auto wallStart = std::chrono::steady_clock::now();
+  uint64_t busStart = canloop_cycles;
+
+  for (long n = 0; n < frames; n++) {
+    CAN_Frame sent;
+    sent.id = rng() & 0x7FF;
+    sent.dlc = rng() % 9;
+    for (int i = 0; i < 8; i++) sent.data[i] = rng();
+    bits += 47 + 8 * sent.dlc;  // Unstuffed frame plus intermission
+
+    CAN_PrecomputedFrame encoded = can_precompute(sent);
+
+    CAN_Frame got;
+    bool received = false;
+    if (blocking) {
+      bool sentOk = precomputed ? can.sendPrecomputed(encoded) : can.sendFrame(sent);
+      received = sentOk && can.readFrame(got) == CAN_READ_MSG_OK;
+    } else if (precomputed ? can.startPrecomputed(encoded) : can.startFrame(sent)) {
+      for (uint64_t poll = 0; poll < timeoutPolls && !received; poll++) {
+        received = can.readFrame(got) == CAN_READ_MSG_OK;
+      }
+    }
+
+    if (!received) lost++;
+    else if (!sameFrame(sent, got)) corrupted++;
+    else ok++;
+  }
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double bus = (double)(canloop_cycles - busStart) / (ESP.getCpuFreqMHz() * 1e6);
+
+  const char *api = blocking ? (precomputed ? "sendPrecomputed()" : "sendFrame()")
+                             : (precomputed ? "startPrecomputed()" : "startFrame()");
+  printf("%s, %ld bit/s, %u cycles per poll\n", api, bitrate, canloop_step);
+  printf("frames:    %ld ok, %ld lost, %ld corrupted\n", ok, lost, corrupted);
+  printf("bus time:  %.3f s, %.0f frames/s\n", bus, ok / bus);
+  printf("host time: %.3f s, %.0f frames/s, %.1f ns per bit\n", wall, ok / wall, wall * 1e9 / bits);
+  printf("worst sample lateness: %u cycles, TEC %u, REC %u\n", can.maxSampleLateness, can.tec, can.rec);
+  return lost || corrupted ? 1 : 0;
+}
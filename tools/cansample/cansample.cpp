@@ -0,0 +1,541 @@
+/*
+ * cansample.cpp - Decode and benchmark oversampled RX captures.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -pthread -Ilib -o cansample tools/cansample/cansample.cpp \
+ *       lib/ESP_CAN_SampleDecoder.cpp lib/ESP_CAN_Decoder.cpp
+ * Usage:
+ *   cansample decode capture.bin [-q] [-r bitrate] [-j threads]    candump-style output
+ *   cansample bench  capture.bin [-r bitrate] [-j max_threads]
+ *   cansample gen    capture.bin <frames> [-r bitrate] [-o oversample] [-d drift_ppm] [-g glitches_per_frame]
+ *   cansample check  <frames> [-o oversample] [-d drift_ppm] [-g glitches_per_frame] [-m min_percent]
+ *
+ * decode takes the bit rate from -r, else from the file header. With -r 0,
+ * or a header without one, it is estimated from the run lengths. With -q
+ * only the summary is printed, which is how decode throughput is measured.
+ * The capture is cut at points of bus idle and the pieces are decoded on
+ * -j threads (default: all cores). bench decodes the capture from memory
+ * with 1, 2, 4, ... threads up to -j and prints the throughput of each.
+ * gen writes a synthetic capture of random
+ * frames with a sampling clock off by drift_ppm and optional one-sample
+ * glitches, as a benchmark input and a check of the decoder. check builds
+ * the same capture in memory, decodes it on all cores and matches every
+ * decoded frame against the generated one at the same start of frame. It
+ * exits 1 if fewer than -m percent of the frames (default 100) come back
+ * unchanged, or if a frame that was never sent is decoded.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "ESP_CAN_SampleDecoder.h"
+#include "ESP_CAN_SampleFormat.h"
+#include "ESP_CAN_Stuffing.h"
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+static const size_t CHUNK_WORDS = 1 << 20;   // 8 MB of samples per read
+static const size_t BATCH_WORDS = 1 << 24;   // 128 MB of samples decoded at a time
+
+static int usage() {
+  fprintf(stderr, "usage: cansample decode capture.bin [-q] [-r bitrate] [-j threads]\n"
+                  "       cansample bench capture.bin [-r bitrate] [-j max_threads]\n"
+                  "       cansample gen capture.bin <frames> [-r bitrate] [-o oversample] [-d drift_ppm] [-g glitches]\n"
+                  "       cansample check <frames> [-o oversample] [-d drift_ppm] [-g glitches] [-m percent]\n");
+  return 2;
+}
+
+struct Output {
+  bool quiet;
+  uint32_t sampleRate;
+  std::vector<char> text;
+};
+
+static void printFrame(const CAN_SampleFrame &f, Output &out) {
+  uint64_t us = f.sofSample * 1000000 / out.sampleRate;
+  char line[80];
+  int n = snprintf(line, sizeof(line), "(%llu.%06llu) can0 ", (unsigned long long)(us / 1000000),
+                   (unsigned long long)(us % 1000000));
+  if (f.error != CAN_DECODE_ERROR_NONE) {
+    static const char *names[] = {"", "STUFF", "CRC", "FORM"};
+    n += snprintf(line + n, sizeof(line) - n, "ERROR %s\n", names[f.error]);
+  } else {
+    n += f.extended ? snprintf(line + n, sizeof(line) - n, "%08X#", f.extendedId)
+                    : snprintf(line + n, sizeof(line) - n, "%03X#", f.frame.id);
+    if (f.remote) {
+      line[n++] = 'R';
+    } else {
+      for (int i = 0; i < f.frame.dlc; i++) {
+        line[n++] = HEX_DIGITS[f.frame.data[i] >> 4];
+        line[n++] = HEX_DIGITS[f.frame.data[i] & 0x0F];
+      }
+    }
+    line[n++] = '\n';
+  }
+  out.text.insert(out.text.end(), line, line + n);
+  if (out.text.size() > (1 << 16)) {
+    fwrite(out.text.data(), 1, out.text.size(), stdout);
+    out.text.clear();
+  }
+}
+
+// --- PARALLEL DECODE ---
+
+// A capture is cut into pieces at points of bus idle, and each piece gets
+// its own decoder. A piece starts at a word boundary with at least 9
+// recessive bits before it, so the previous frame's EOF lies in the piece
+// before, and ends before the next start of frame, so the decoder can start
+// in the idle state. Pieces are disjoint and in capture order, so their
+// frame lists concatenate in timestamp order.
+
+struct Piece {
+  size_t first, end;    // Word range
+  bool startsIdle;      // first is a resync point rather than the capture start
+  uint64_t base;        // Sample index of word `first` in the whole capture
+  bool keepFrames;
+  std::vector<CAN_SampleFrame> frames;
+  CAN_SampleDecoder_Stats stats;
+};
+
+static void collectFrame(const CAN_SampleFrame &f, void *arg) {
+  Piece &piece = *static_cast<Piece *>(arg);
+  if (!piece.keepFrames) return;
+  piece.frames.push_back(f);
+  piece.frames.back().sofSample += piece.base;
+}
+
+template <typename F> static void parallelFor(unsigned threads, size_t count, F f) {
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; t++) {
+    pool.emplace_back([&] {
+      for (size_t i; (i = next++) < count;) f(i);
+    });
+  }
+  for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+}
+
+// First word boundary after `from` that is a safe resync point, or `to`.
+static size_t findResync(const uint64_t *words, size_t from, size_t to, double samplesPerBit) {
+  bool level = words[from] & 1;
+  uint64_t runStart = (uint64_t)from * 64;  // The first run may have started earlier
+  for (size_t i = from; i < to; i++) {
+    uint64_t w = words[i];
+    uint64_t x = level ? ~w : w;
+    while (x) {
+      int b = can_ctz64(x);
+      uint64_t edge = (uint64_t)i * 64 + b;
+      if (level) {
+        // A recessive run [runStart, edge) ends with a dominant edge
+        uint64_t cut = ((uint64_t)(runStart + 9 * samplesPerBit) + 63) / 64;
+        if (cut * 64 + samplesPerBit <= edge) return cut;
+      }
+      runStart = edge;
+      level = !level;
+      x = (level ? ~w : w) & (b == 63 ? 0 : ~0ULL << (b + 1));
+    }
+  }
+  return to;
+}
+
+// Decodes words[0, count) on `threads` threads. Unless `final`, the piece
+// after the last resync point is left undecoded, since it may hold the
+// start of a frame that continues in the next batch; its first word is
+// returned. `base` is the sample index of words[0].
+static size_t decodeBatch(const uint64_t *words, size_t count, uint64_t base, bool startsIdle, bool final,
+                          double samplesPerBit, unsigned threads, bool keepFrames, std::vector<Piece> &pieces) {
+  // More pieces than threads evens out the load
+  size_t wanted = threads * 4;
+  std::vector<size_t> cuts(wanted + 1, count);
+  cuts[0] = 0;
+  parallelFor(threads, wanted - 1, [&](size_t k) {
+    cuts[k + 1] = findResync(words, count * (k + 1) / wanted, count, samplesPerBit);
+  });
+  std::sort(cuts.begin(), cuts.end());
+  cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+  // Without any resync point the batch is decoded whole. A frame across
+  // the batch end is then lost, which needs a bus busy for the whole batch.
+  size_t decoded = count;
+  if (!final && cuts.size() > 2) {
+    cuts.pop_back();
+    decoded = cuts.back();
+  }
+
+  pieces.resize(cuts.size() - 1);
+  for (size_t i = 0; i < pieces.size(); i++) {
+    Piece &p = pieces[i];
+    p.first = cuts[i];
+    p.end = cuts[i + 1];
+    p.startsIdle = i > 0 || startsIdle;
+    p.base = base + (uint64_t)p.first * 64;
+    p.keepFrames = keepFrames;
+    p.frames.clear();
+  }
+  parallelFor(threads, pieces.size(), [&](size_t i) {
+    Piece &p = pieces[i];
+    CAN_SampleDecoder decoder;
+    decoder.begin(samplesPerBit, 0.5, p.startsIdle);
+    decoder.onFrame(collectFrame, &p);
+    decoder.feed(words + p.first, p.end - p.first);
+    decoder.finish();
+    p.stats = decoder.stats;
+  });
+  return decoded;
+}
+
+static void addStats(CAN_SampleDecoder_Stats &total, const CAN_SampleDecoder_Stats &s) {
+  total.samples += s.samples;
+  total.edges += s.edges;
+  total.glitches += s.glitches;
+  total.bits += s.bits;
+  total.frames += s.frames;
+  total.stuffErrors += s.stuffErrors;
+  total.crcErrors += s.crcErrors;
+  total.formErrors += s.formErrors;
+  total.errorFrames += s.errorFrames;
+  total.overloadFrames += s.overloadFrames;
+}
+
+static FILE *openCapture(const char *path, CAN_SampleFileHeader &header) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return NULL;
+  }
+  if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, CAN_SAMPLE_MAGIC, 8) != 0 ||
+      header.version != CAN_SAMPLE_VERSION || header.sampleRateHz == 0) {
+    fprintf(stderr, "not a sample capture\n");
+    fclose(in);
+    return NULL;
+  }
+  return in;
+}
+
+// Reads up to `count` words. A trailing half word is padded with recessive
+// samples.
+static size_t readWords(FILE *in, uint64_t *words, size_t count) {
+  size_t bytes = fread(words, 1, count * 8, in);
+  if (bytes % 8) memset((char *)words + bytes, 0xFF, 8 - bytes % 8);
+  return (bytes + 7) / 8;
+}
+
+static double samplesPerBitFor(const CAN_SampleFileHeader &header, long bitrateOverride, const uint64_t *words,
+                               size_t count) {
+  uint32_t bitrate = bitrateOverride >= 0 ? bitrateOverride : header.bitrate;
+  double samplesPerBit = bitrate ? (double)header.sampleRateHz / bitrate
+                                 : CAN_SampleDecoder::estimateSamplesPerBit(words, count < CHUNK_WORDS ? count : CHUNK_WORDS);
+  if (samplesPerBit < 2) fprintf(stderr, "cannot determine the bit rate; pass -r\n");
+  return samplesPerBit;
+}
+
+static int cmdDecode(const char *path, bool quiet, long bitrateOverride, unsigned threads) {
+  CAN_SampleFileHeader header;
+  FILE *in = openCapture(path, header);
+  if (!in) return 1;
+
+  std::vector<uint64_t> batch(BATCH_WORDS);
+  size_t words = readWords(in, batch.data(), BATCH_WORDS);
+  double samplesPerBit = samplesPerBitFor(header, bitrateOverride, batch.data(), words);
+  if (samplesPerBit < 2) {
+    fclose(in);
+    return 1;
+  }
+
+  Output out;
+  out.quiet = quiet;
+  out.sampleRate = header.sampleRateHz;
+  CAN_SampleDecoder_Stats total;
+  memset(&total, 0, sizeof(total));
+  std::vector<Piece> pieces;
+  uint64_t base = 0;
+  bool startsIdle = false;
+  double busy = 0;
+
+  while (words > 0) {
+    bool final = words < BATCH_WORDS || feof(in);
+    auto start = std::chrono::steady_clock::now();
+    size_t decoded = decodeBatch(batch.data(), words, base, startsIdle, final, samplesPerBit, threads, !quiet, pieces);
+    busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (size_t i = 0; i < pieces.size(); i++) {
+      addStats(total, pieces[i].stats);
+      for (size_t k = 0; k < pieces[i].frames.size(); k++) printFrame(pieces[i].frames[k], out);
+    }
+
+    // Carry the undecoded tail to the front of the next batch
+    size_t carry = words - decoded;
+    memmove(batch.data(), batch.data() + decoded, carry * 8);
+    base += (uint64_t)decoded * 64;
+    startsIdle = decoded > 0;
+    size_t more = final ? 0 : readWords(in, batch.data() + carry, BATCH_WORDS - carry);
+    words = carry + more;
+    if (final) break;
+  }
+  fclose(in);
+  fwrite(out.text.data(), 1, out.text.size(), stdout);
+
+  fprintf(stderr, "%.3f samples/bit (%.0f bit/s), %llu samples, %llu edges (%llu glitches), %llu bits\n",
+          samplesPerBit, header.sampleRateHz / samplesPerBit, (unsigned long long)total.samples,
+          (unsigned long long)total.edges, (unsigned long long)total.glitches, (unsigned long long)total.bits);
+  fprintf(stderr, "%llu frames, errors: %llu stuff, %llu CRC, %llu form; %llu error frames, %llu overload frames\n",
+          (unsigned long long)total.frames, (unsigned long long)total.stuffErrors,
+          (unsigned long long)total.crcErrors, (unsigned long long)total.formErrors,
+          (unsigned long long)total.errorFrames, (unsigned long long)total.overloadFrames);
+  fprintf(stderr, "decode: %.3f s on %u threads, %.0f Msamples/s\n", busy, threads,
+          busy > 0 ? total.samples / busy / 1e6 : 0);
+  return 0;
+}
+
+// Decodes the whole capture from memory with 1, 2, 4, ... threads.
+static int cmdBench(const char *path, long bitrateOverride, unsigned maxThreads) {
+  CAN_SampleFileHeader header;
+  FILE *in = openCapture(path, header);
+  if (!in) return 1;
+  std::vector<uint64_t> capture;
+  for (;;) {
+    size_t have = capture.size();
+    capture.resize(have + CHUNK_WORDS);
+    size_t got = readWords(in, capture.data() + have, CHUNK_WORDS);
+    capture.resize(have + got);
+    if (got < CHUNK_WORDS) break;
+  }
+  fclose(in);
+  double samplesPerBit = samplesPerBitFor(header, bitrateOverride, capture.data(), capture.size());
+  if (samplesPerBit < 2) return 1;
+
+  printf("%zu Msamples, %u hardware threads\n", capture.size() * 64 >> 20, std::thread::hardware_concurrency());
+  printf("threads  Msamples/s  speedup  frames\n");
+  double single = 0;
+  uint64_t expected = 0;
+  int status = 0;
+  for (unsigned threads = 1;; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads) {
+    std::vector<Piece> pieces;
+    auto start = std::chrono::steady_clock::now();
+    decodeBatch(capture.data(), capture.size(), 0, false, true, samplesPerBit, threads, false, pieces);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CAN_SampleDecoder_Stats total;
+    memset(&total, 0, sizeof(total));
+    for (size_t i = 0; i < pieces.size(); i++) addStats(total, pieces[i].stats);
+
+    double rate = capture.size() * 64 / seconds / 1e6;
+    if (threads == 1) {
+      single = rate;
+      expected = total.frames;
+    }
+    printf("%7u  %10.0f  %6.2fx  %llu\n", threads, rate, rate / single, (unsigned long long)total.frames);
+    if (total.frames != expected) {
+      fprintf(stderr, "frame count differs from the single-threaded run\n");
+      status = 1;
+    }
+    if (threads >= maxThreads) break;
+  }
+  return status;
+}
+
+// Stuffed bus bits of a data frame with an 11-bit ID, ACK slot dominant,
+// followed by EOF and intermission.
+static void frameBits(const CAN_Frame &f, std::vector<bool> &bus) {
+  bool bits[128];
+  int n = 0;
+  for (int i = 10; i >= 0; i--) bits[n++] = (f.id >> i) & 1;
+  bits[n++] = 0;  // RTR
+  bits[n++] = 0;  // IDE
+  bits[n++] = 0;  // r0
+  for (int i = 3; i >= 0; i--) bits[n++] = (f.dlc >> i) & 1;
+  for (int i = 0; i < f.dlc; i++) {
+    for (int j = 7; j >= 0; j--) bits[n++] = (f.data[i] >> j) & 1;
+  }
+  uint16_t crc = can_crc15(bits, n);
+  for (int i = 14; i >= 0; i--) bits[n++] = (crc >> i) & 1;
+
+  bus.push_back(0);  // SOF
+  int run = 1;
+  bool last = 0;
+  for (int i = 0; i < n; i++) {
+    bus.push_back(bits[i]);
+    run = bits[i] == last ? run + 1 : 1;
+    last = bits[i];
+    if (run == 5) {
+      bus.push_back(!last);
+      last = !last;
+      run = 1;
+    }
+  }
+  bus.push_back(1);  // CRC delimiter
+  bus.push_back(0);  // ACK
+  for (int i = 0; i < 1 + 7 + 3; i++) bus.push_back(1);  // ACK delimiter, EOF, intermission
+}
+
+struct GenFrame {
+  CAN_Frame frame;
+  uint64_t sofSample;  // Sample index of the start of frame
+};
+
+// Synthetic capture of `count` random frames: the transmitter's bit is
+// oversample * (1 + driftPpm / 1e6) samples long, and each frame gets
+// `glitches` one-sample pulses at random places. Returns the sample count.
+static uint64_t generate(long count, int oversample, double driftPpm, int glitches, std::vector<uint64_t> &words,
+                         std::vector<GenFrame> &frames) {
+  double samplesPerBit = oversample * (1 + driftPpm * 1e-6);
+  std::mt19937 rng(1);
+  uint64_t word = 0;
+  int fill = 0;
+  double t = 0;
+  uint64_t written = 0;
+  auto pushSample = [&](bool level) {
+    word |= (uint64_t)level << fill;
+    if (++fill == 64) {
+      words.push_back(word);
+      word = 0;
+      fill = 0;
+    }
+    written++;
+  };
+
+  std::vector<bool> bus(11, true);  // Idle, so the first frame is recognised
+  for (long k = 0; k < count; k++) {
+    GenFrame g;
+    g.frame.id = rng() & 0x7FF;
+    g.frame.dlc = rng() % 9;
+    for (int i = 0; i < 8; i++) g.frame.data[i] = rng();
+    if (k > 0) bus.clear();
+    for (int i = 0; i < (int)(rng() % 20); i++) bus.push_back(1);  // Extra idle
+    size_t sof = bus.size();
+    frameBits(g.frame, bus);
+
+    uint64_t first = written;
+    for (size_t i = 0; i < bus.size(); i++) {
+      if (i == sof) g.sofSample = written;
+      t += samplesPerBit;
+      while ((double)written < t) pushSample(bus[i]);
+    }
+    // One-sample glitches at random places of the frame
+    for (int n = 0; n < glitches; n++) {
+      uint64_t at = first + rng() % (written - first);
+      if (at / 64 < words.size()) words[at / 64] ^= 1ULL << (at % 64);
+      else word ^= 1ULL << (at % 64);
+    }
+    frames.push_back(g);
+  }
+  while (fill) pushSample(1);
+  return written;
+}
+
+static int cmdGen(const char *path, long count, uint32_t bitrate, int oversample, double driftPpm, int glitches) {
+  FILE *out = fopen(path, "wb");
+  if (!out) { fprintf(stderr, "cannot create %s\n", path); return 1; }
+  CAN_SampleFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CAN_SAMPLE_MAGIC, 8);
+  header.version = CAN_SAMPLE_VERSION;
+  header.sampleRateHz = bitrate * oversample;
+  header.bitrate = bitrate;
+  fwrite(&header, sizeof(header), 1, out);
+
+  std::vector<uint64_t> words;
+  std::vector<GenFrame> frames;
+  uint64_t samples = generate(count, oversample, driftPpm, glitches, words, frames);
+  fwrite(words.data(), 8, words.size(), out);
+  fclose(out);
+  printf("%llu samples, %ld frames, %.1f MB\n", (unsigned long long)samples, count, samples / 8e6);
+  return 0;
+}
+
+static int cmdCheck(long count, int oversample, double driftPpm, int glitches, double minPercent) {
+  std::vector<uint64_t> words;
+  std::vector<GenFrame> sent;
+  uint64_t samples = generate(count, oversample, driftPpm, glitches, words, sent);
+
+  std::vector<Piece> pieces;
+  auto start = std::chrono::steady_clock::now();
+  decodeBatch(words.data(), words.size(), 0, false, true, oversample, std::thread::hardware_concurrency(), true,
+              pieces);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Pieces are in capture order, so one pass over the sent frames matches
+  // every decoded frame to the one starting within a bit of it
+  CAN_SampleDecoder_Stats total;
+  memset(&total, 0, sizeof(total));
+  long ok = 0, wrong = 0;
+  size_t next = 0;
+  for (size_t i = 0; i < pieces.size(); i++) {
+    addStats(total, pieces[i].stats);
+    for (size_t k = 0; k < pieces[i].frames.size(); k++) {
+      const CAN_SampleFrame &f = pieces[i].frames[k];
+      if (f.error != CAN_DECODE_ERROR_NONE) continue;
+      while (next < sent.size() && sent[next].sofSample + oversample < f.sofSample) next++;
+      const CAN_Frame &e = sent[next < sent.size() ? next : 0].frame;
+      bool same = next < sent.size() && f.sofSample + oversample >= sent[next].sofSample && !f.extended &&
+                  !f.remote && f.frame.id == e.id && f.frame.dlc == e.dlc &&
+                  memcmp(f.frame.data, e.data, e.dlc) == 0;
+      if (same) {
+        ok++;
+        next++;
+      } else {
+        wrong++;
+      }
+    }
+  }
+
+  double percent = count ? 100.0 * ok / count : 100;
+  printf("%ld frames, %dx oversampling, %+.0f ppm drift, %d glitches per frame\n", count, oversample, driftPpm,
+         glitches);
+  printf("%ld decoded unchanged (%.2f%%), %ld wrong, errors: %llu stuff, %llu CRC, %llu form; %llu glitches "
+         "dropped\n", ok, percent, wrong, (unsigned long long)total.stuffErrors, (unsigned long long)total.crcErrors,
+         (unsigned long long)total.formErrors, (unsigned long long)total.glitches);
+  printf("decode: %llu samples in %.3f s, %.0f Msamples/s\n", (unsigned long long)samples, seconds,
+         samples / seconds / 1e6);
+  bool failed = percent < minPercent || wrong;
+  printf(failed ? "FAILED\n" : "ok\n");
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) return usage();
+  const char *cmd = argv[1];
+  const char *path = argv[2];
+
+  if (!strcmp(cmd, "decode") || !strcmp(cmd, "bench")) {
+    bool quiet = false;
+    long bitrate = -1;
+    unsigned threads = std::thread::hardware_concurrency();
+    for (int i = 3; i < argc; i++) {
+      if (!strcmp(argv[i], "-q")) quiet = true;
+      else if (!strcmp(argv[i], "-r") && i + 1 < argc) bitrate = atol(argv[++i]);
+      else if (!strcmp(argv[i], "-j") && i + 1 < argc) threads = atoi(argv[++i]);
+      else return usage();
+    }
+    if (threads < 1) threads = 1;
+    return cmd[0] == 'd' ? cmdDecode(path, quiet, bitrate, threads) : cmdBench(path, bitrate, threads);
+  }
+
+  // check has no file argument
+  bool check = !strcmp(cmd, "check");
+  if (check || (!strcmp(cmd, "gen") && argc >= 4)) {
+    long frames = atol(argv[check ? 2 : 3]);
+    uint32_t bitrate = 500000;
+    int oversample = 8;
+    double drift = 0;
+    int glitches = 0;
+    double minPercent = 100;
+    for (int i = check ? 3 : 4; i < argc; i++) {
+      if (!check && !strcmp(argv[i], "-r") && i + 1 < argc) bitrate = atol(argv[++i]);
+      else if (!strcmp(argv[i], "-o") && i + 1 < argc) oversample = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-d") && i + 1 < argc) drift = atof(argv[++i]);
+      else if (!strcmp(argv[i], "-g") && i + 1 < argc) glitches = atoi(argv[++i]);
+      else if (check && !strcmp(argv[i], "-m") && i + 1 < argc) minPercent = atof(argv[++i]);
+      else return usage();
+    }
+    if (oversample < 3) return usage();
+    return check ? cmdCheck(frames, oversample, drift, glitches, minPercent)
+                 : cmdGen(path, frames, bitrate, oversample, drift, glitches);
+  }
+  return usage();
+}
@@ -0,0 +1,545 @@
+/*
+ * dbc2can.cpp - Generates typed message structs with constexpr decode() and
+ * encode() for CAN_Frame from a .dbc file.
+ *
+ * Build on the host:  g++ -std=c++11 -O2 -o dbc2can dbc2can.cpp
+ * Usage:              dbc2can input.dbc [-n namespace] [-o output.h [-c check.cpp]]
+ *
+ * The generated header includes "ESP_CAN_Signals.h" (in lib/). All bit
+ * positions are resolved here, so each signal becomes one shift and one mask
+ * on a 64-bit payload word. Extended (29-bit) messages are skipped because
+ * the library only speaks 11-bit identifiers. SG_ lines that cannot be
+ * parsed, and extended multiplexing (mNM), are reported on stderr and the
+ * signal is left out. Signal names that clash with the generated members
+ * get a trailing underscore.
+ *
+ * -c also writes a host program for the generated header. It decodes random
+ * frames with every generated decode() and compares each signal with a slow
+ * bit-by-bit reference decoder. It then checks that encode() gives back the
+ * raw bits of each signal, and benchmarks decode() in signals/s:
+ *   dbc2can vehicle.dbc -o vehicle_dbc.h -c vehicle_check.cpp
+ *   g++ -std=c++11 -O2 -Ilib -I. -o vehicle_check vehicle_check.cpp
+ *   ./vehicle_check [-n frames] [-b frames]
+ * The program exits 1 on any mismatch.
+ */
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Signal {
+  std::string name;
+  int startBit;
+  int length;
+  bool intel;      // @1 = Intel (little endian), @0 = Motorola (big endian)
+  bool isSigned;
+  double scale;
+  double offset;
+  std::string unit;
+  bool isMux;      // "M": this signal selects the multiplexed group
+  int muxValue;    // "mN": only present when the multiplexor equals N, else -1
+  int shift;       // Bit position of the LSB in the little/big endian word
+};
+
+struct Message {
+  uint32_t id;
+  int dlc;
+  std::string name;
+  std::vector<Signal> signals;
+};
+
+static std::string sanitize(const std::string &s) {
+  std::string out;
+  for (char c : s) out += (std::isalnum((unsigned char)c) || c == '_') ? c : '_';
+  if (out.empty() || std::isdigit((unsigned char)out[0])) out = "_" + out;
+  return out;
+}
+
+// Names the generated struct already uses. A signal named like the struct
+// would be taken for a constructor.
+static std::string memberName(const std::string &name, const Message &m, const char *input, int lineNo) {
+  static const std::set<std::string> reserved = {"ID", "DLC", "decode", "encode", "f"};
+  std::string out = name;
+  for (;;) {
+    bool clash = reserved.count(out) || out == m.name;
+    for (const Signal &s : m.signals) clash |= s.name == out;
+    if (!clash) break;
+    out += "_";
+  }
+  if (out != name) {
+    std::fprintf(stderr, "%s:%d: %s: signal %s renamed to %s\n", input, lineNo, m.name.c_str(), name.c_str(), out.c_str());
+  }
+  return out;
+}
+
+static std::string literal(double v, int precision) {
+  std::ostringstream os;
+  os.precision(precision);
+  os << v;
+  std::string s = os.str();
+  if (s.find_first_of(".e") == std::string::npos) s += ".0";
+  return s;
+}
+
+static std::string num(double v) { return literal(v, 9) + "f"; }
+
+// Physical representation of a signal: plain integers when scale/offset are
+// identity, float otherwise (the ESP32 FPU is single precision).
+static std::string fieldType(const Signal &s) {
+  if (s.scale == 1.0 && s.offset == 0.0) {
+    int w = s.length <= 8 ? 8 : s.length <= 16 ? 16 : s.length <= 32 ? 32 : 64;
+    return std::string(s.isSigned ? "int" : "uint") + std::to_string(w) + "_t";
+  }
+  return "float";
+}
+
+static bool resolveShift(Signal &s, std::string &err) {
+  if (s.length < 1 || s.length > 64) { err = "length out of range"; return false; }
+  if (s.intel) {
+    s.shift = s.startBit;
+    if (s.startBit + s.length > 64) { err = "Intel signal exceeds 64 bits"; return false; }
+  } else {
+    // DBC Motorola start bit names the MSB in "sawtooth" numbering; map it to
+    // the big endian word where data[0] is the top byte.
+    int msb = (7 - s.startBit / 8) * 8 + (s.startBit % 8);
+    s.shift = msb - (s.length - 1);
+    if (s.shift < 0) { err = "Motorola signal runs past the last byte"; return false; }
+  }
+  return true;
+}
+
+static std::string rawExpr(const Signal &s) {
+  std::ostringstream os;
+  os << "can_signals::get(can_signals::" << (s.intel ? "wordLE" : "wordBE") << "(f), "
+     << s.shift << ", " << s.length << ")";
+  return os.str();
+}
+
+static std::string decodeExpr(const Signal &s) {
+  std::string raw = rawExpr(s);
+  std::string type = fieldType(s);
+  std::string value;
+  if (s.isSigned) raw = "can_signals::sext(" + raw + ", " + std::to_string(s.length) + ")";
+  if (type == "float") {
+    value = "(float)" + raw + " * " + num(s.scale) + " + " + num(s.offset);
+  } else {
+    value = "(" + type + ")" + raw;
+  }
+  return value;
+}
+
+static std::string encodeExpr(const Signal &s) {
+  std::ostringstream os;
+  os << "can_signals::put(";
+  if (fieldType(s) == "float") {
+    os << "can_signals::toRaw(" << s.name << ", " << num(s.scale) << ", " << num(s.offset) << ", " << s.length << ")";
+  } else {
+    os << "(uint64_t)" << s.name;
+  }
+  os << ", " << s.shift << ", " << s.length << ")";
+  return os.str();
+}
+
+static void emitMessage(std::ostream &out, const Message &m) {
+  const Signal *mux = nullptr;
+  for (const Signal &s : m.signals) if (s.isMux) mux = &s;
+
+  out << "// BO_ " << m.id << " " << m.name << ": " << m.dlc << "\n";
+  out << "struct " << m.name << " {\n";
+  out << "  static constexpr uint32_t ID = 0x" << std::hex << m.id << std::dec << ";\n";
+  out << "  static constexpr uint8_t DLC = " << m.dlc << ";\n\n";
+
+  for (const Signal &s : m.signals) {
+    out << "  " << fieldType(s) << " " << s.name << ";  // " << s.startBit << "|" << s.length
+        << "@" << (s.intel ? 1 : 0) << (s.isSigned ? "-" : "+")
+        << " (" << s.scale << "," << s.offset << ")";
+    if (!s.unit.empty()) out << " \"" << s.unit << "\"";
+    if (s.isMux) out << " multiplexor";
+    if (s.muxValue >= 0) out << " when " << mux->name << " == " << s.muxValue;
+    out << "\n";
+  }
+
+  // decode(): one aggregate initializer, signals in declaration order.
+  out << "\n  static constexpr " << m.name << " decode(const CAN_Frame &f) {\n";
+  out << "    return " << m.name << "{";
+  for (size_t i = 0; i < m.signals.size(); i++) {
+    const Signal &s = m.signals[i];
+    std::string expr = decodeExpr(s);
+    if (s.muxValue >= 0) {
+      expr = rawExpr(*mux) + " == " + std::to_string(s.muxValue) + "u ? " + expr + " : (" + fieldType(s) + ")0";
+    }
+    out << (i ? ",\n      " : "\n      ") << expr;
+  }
+  out << "};\n  }\n";
+
+  // encode(): Intel and Motorola contributions are OR-ed into separate words.
+  out << "\n  constexpr CAN_Frame encode() const {\n";
+  out << "    return can_signals::frame(ID, DLC,";
+  for (int intel = 1; intel >= 0; intel--) {
+    std::vector<std::string> parts;
+    for (const Signal &s : m.signals) {
+      if (s.intel != (bool)intel) continue;
+      std::string expr = encodeExpr(s);
+      if (s.muxValue >= 0) {
+        expr = "(" + mux->name + " == " + std::to_string(s.muxValue) + " ? " + expr + " : 0)";
+      }
+      parts.push_back(expr);
+    }
+    out << "\n        ";
+    if (parts.empty()) out << "0";
+    for (size_t i = 0; i < parts.size(); i++) out << (i ? " |\n        " : "") << parts[i];
+    out << (intel ? "," : ");\n");
+  }
+  out << "  }\n";
+  out << "};\n\n";
+}
+
+// Parts of the -c program that do not depend on the .dbc file.
+static const char CHECK_PRELUDE[] = R"(
+struct RefSignal {
+  const char *name;
+  int startBit;
+  int length;
+  bool intel;
+  bool isSigned;
+  bool isFloat;   // Generated field is float (scale/offset applied)
+  double scale;
+  double offset;
+  int mux;        // Index of the multiplexor in the same table, or -1
+  int muxValue;
+};
+
+// A decoded field: float fields by value, integer fields by their bits.
+struct Value {
+  bool isFloat;
+  double phys;
+  uint64_t bits;
+};
+static Value value(float v) { return Value{true, v, 0}; }
+template <typename T> static Value value(T v) { return Value{false, 0, (uint64_t)v}; }
+
+static inline void clobber(void *p) { __asm__ __volatile__("" : : "r"(p) : "memory"); }
+
+// Reference decoder: walks the signal one bit at a time in DBC numbering,
+// Motorola signals from the MSB down through the sawtooth bit order.
+static uint64_t refRaw(const CAN_Frame &f, const RefSignal &s) {
+  uint64_t raw = 0;
+  int bit = s.startBit;
+  for (int i = 0; i < s.length; i++) {
+    uint64_t b = (f.data[bit / 8] >> (bit % 8)) & 1;
+    if (s.intel) {
+      raw |= b << i;
+      bit++;
+    } else {
+      raw |= b << (s.length - 1 - i);
+      bit = bit % 8 == 0 ? bit + 15 : bit - 1;
+    }
+  }
+  return raw;
+}
+
+static void refPut(CAN_Frame &f, const RefSignal &s, uint64_t raw) {
+  int bit = s.startBit;
+  for (int i = 0; i < s.length; i++) {
+    int from = s.intel ? i : s.length - 1 - i;
+    uint8_t m = (uint8_t)(1 << (bit % 8));
+    f.data[bit / 8] = (uint8_t)(((raw >> from) & 1) ? f.data[bit / 8] | m : f.data[bit / 8] & ~m);
+    bit = s.intel ? bit + 1 : bit % 8 == 0 ? bit + 15 : bit - 1;
+  }
+}
+
+static uint64_t refSigned(uint64_t raw, const RefSignal &s) {
+  if (!s.isSigned || s.length == 64 || !((raw >> (s.length - 1)) & 1)) return raw;
+  return raw | ~(((uint64_t)1 << s.length) - 1);
+}
+
+static double refPhys(uint64_t raw, const RefSignal &s) {
+  double v = s.isSigned ? (double)(int64_t)refSigned(raw, s) : (double)raw;
+  return v * s.scale + s.offset;
+}
+
+static bool refActive(const CAN_Frame &f, const RefSignal *sigs, int i) {
+  return sigs[i].mux < 0 || refRaw(f, sigs[sigs[i].mux]) == (uint64_t)sigs[i].muxValue;
+}
+
+// Random payload; half of the frames select one of the multiplexed groups.
+static CAN_Frame randomFrame(std::mt19937_64 &rng, uint32_t id, uint8_t dlc, const RefSignal *sigs, int n) {
+  CAN_Frame f;
+  f.id = id;
+  f.dlc = dlc;
+  uint64_t r = rng();
+  for (int i = 0; i < 8; i++) f.data[i] = (uint8_t)(r >> (8 * i));
+  int pick = (int)(rng() % (2 * n));
+  if (pick < n && sigs[pick].mux >= 0) refPut(f, sigs[sigs[pick].mux], (uint64_t)sigs[pick].muxValue);
+  return f;
+}
+
+static bool checkValue(const char *msg, const RefSignal &s, const CAN_Frame &f, bool active, Value got) {
+  uint64_t raw = active ? refRaw(f, s) : 0;
+  if (got.isFloat) {
+    double want = active ? refPhys(raw, s) : 0.0;
+    // The generated code works in single precision
+    if (std::fabs(got.phys - want) <= 1e-5 * (std::fabs(want) + std::fabs(s.offset) + std::fabs(s.scale))) return true;
+    fprintf(stderr, "%s.%s: decoded %.9g, reference %.9g (raw 0x%llx)\n", msg, s.name, got.phys, want,
+            (unsigned long long)raw);
+  } else {
+    uint64_t want = refSigned(raw, s);
+    if (got.bits == want) return true;
+    fprintf(stderr, "%s.%s: decoded 0x%llx, reference 0x%llx\n", msg, s.name, (unsigned long long)got.bits,
+            (unsigned long long)want);
+  }
+  return false;
+}
+
+// encode() must give back the raw bits of every signal that decode() saw.
+// Float signals wider than 20 bits cannot hold every raw value exactly.
+static bool checkRoundTrip(const char *msg, const RefSignal *sigs, int n, const CAN_Frame &f, const CAN_Frame &e) {
+  if (e.id != f.id || e.dlc != f.dlc) {
+    fprintf(stderr, "%s: encode() gives ID 0x%x DLC %d\n", msg, (unsigned)e.id, e.dlc);
+    return false;
+  }
+  for (int i = 0; i < n; i++) {
+    if (!refActive(f, sigs, i) || (sigs[i].isFloat && sigs[i].length > 20)) continue;
+    if (refRaw(e, sigs[i]) != refRaw(f, sigs[i])) {
+      fprintf(stderr, "%s.%s: encode() gives raw 0x%llx, was 0x%llx\n", msg, sigs[i].name,
+              (unsigned long long)refRaw(e, sigs[i]), (unsigned long long)refRaw(f, sigs[i]));
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename M>
+static long check(const char *msg, const RefSignal *sigs, int n, void (*values)(const M &, Value *),
+                  std::mt19937_64 &rng, long frames) {
+  Value got[64];
+  long bad = 0;
+  for (long k = 0; k < frames && bad < 10; k++) {
+    CAN_Frame f = randomFrame(rng, M::ID, M::DLC, sigs, n);
+    M m = M::decode(f);
+    values(m, got);
+    for (int i = 0; i < n; i++) bad += !checkValue(msg, sigs[i], f, refActive(f, sigs, i), got[i]);
+    bad += !checkRoundTrip(msg, sigs, n, f, m.encode());
+  }
+  return bad;
+}
+
+struct BenchTotals {
+  double signals;
+  double generatedSeconds;
+  double referenceSeconds;
+};
+
+template <typename M>
+static void bench(const RefSignal *sigs, int n, std::mt19937_64 &rng, long frames, BenchTotals &t) {
+  const int POOL = 1024;
+  std::vector<CAN_Frame> in(POOL);
+  std::vector<M> out(POOL);
+  std::vector<double> ref((size_t)POOL * n);
+  for (int i = 0; i < POOL; i++) in[i] = randomFrame(rng, M::ID, M::DLC, sigs, n);
+  long rounds = frames / POOL + 1;
+
+  auto start = std::chrono::steady_clock::now();
+  for (long r = 0; r < rounds; r++) {
+    for (int i = 0; i < POOL; i++) out[i] = M::decode(in[i]);
+    clobber(out.data());
+  }
+  auto mid = std::chrono::steady_clock::now();
+  for (long r = 0; r < rounds; r++) {
+    for (int i = 0; i < POOL; i++) {
+      for (int k = 0; k < n; k++) ref[(size_t)i * n + k] = refActive(in[i], sigs, k) ? refPhys(refRaw(in[i], sigs[k]), sigs[k]) : 0.0;
+    }
+    clobber(ref.data());
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  t.signals += (double)rounds * POOL * n;
+  t.generatedSeconds += std::chrono::duration<double>(mid - start).count();
+  t.referenceSeconds += std::chrono::duration<double>(end - mid).count();
+}
+)";
+
+static void emitCheck(std::ostream &out, const std::vector<Message> &messages, const std::string &ns,
+                      const std::string &input, const std::string &header) {
+  out << "// Generated by dbc2can from " << input << " - do not edit.\n";
+  out << "//\n// Checks " << header << " against a bit-by-bit reference decoder and\n";
+  out << "// benchmarks it. Usage: check [-n frames] [-b frames]\n\n";
+  out << "#include <chrono>\n#include <cmath>\n#include <cstdio>\n#include <cstdlib>\n#include <cstring>\n"
+         "#include <random>\n#include <vector>\n\n";
+  out << "#include \"" << header << "\"\n";
+  out << CHECK_PRELUDE;
+
+  std::vector<const Message *> checked;
+  for (const Message &m : messages) {
+    if (m.signals.empty()) continue;
+    checked.push_back(&m);
+    int muxIndex = -1;
+    for (size_t i = 0; i < m.signals.size(); i++) if (m.signals[i].isMux) muxIndex = (int)i;
+
+    out << "\nstatic const RefSignal " << m.name << "_signals[] = {\n";
+    for (const Signal &s : m.signals) {
+      out << "  {\"" << s.name << "\", " << s.startBit << ", " << s.length << ", " << (s.intel ? "true" : "false")
+          << ", " << (s.isSigned ? "true" : "false") << ", " << (fieldType(s) == "float" ? "true" : "false") << ", "
+          << literal(s.scale, 17) << ", " << literal(s.offset, 17) << ", " << (s.muxValue >= 0 ? muxIndex : -1) << ", " << s.muxValue << "},\n";
+    }
+    out << "};\n\n";
+    out << "static void " << m.name << "_values(const " << ns << "::" << m.name << " &m, Value *v) {\n";
+    for (size_t i = 0; i < m.signals.size(); i++) {
+      out << "  v[" << i << "] = value(m." << m.signals[i].name << ");\n";
+    }
+    out << "}\n";
+  }
+
+  out << "\nint main(int argc, char **argv) {\n"
+         "  long frames = 100000;\n"
+         "  long benchFrames = 1000000;\n"
+         "  for (int i = 1; i < argc; i++) {\n"
+         "    if (!strcmp(argv[i], \"-n\") && i + 1 < argc) frames = atol(argv[++i]);\n"
+         "    else if (!strcmp(argv[i], \"-b\") && i + 1 < argc) benchFrames = atol(argv[++i]);\n"
+         "    else { fprintf(stderr, \"usage: %s [-n frames] [-b frames]\\n\", argv[0]); return 2; }\n"
+         "  }\n\n"
+         "  std::mt19937_64 rng(1);\n"
+         "  long bad = 0;\n";
+  for (const Message *m : checked) {
+    out << "  bad += check<" << ns << "::" << m->name << ">(\"" << m->name << "\", " << m->name << "_signals, "
+        << m->signals.size() << ", " << m->name << "_values, rng, frames);\n";
+  }
+  out << "  if (bad) {\n"
+         "    fprintf(stderr, \"%ld mismatches\\n\", bad);\n"
+         "    return 1;\n"
+         "  }\n"
+         "  printf(\"check: " << checked.size() << " messages, %ld frames each, decode and encode match the reference\\n\", frames);\n"
+         "  if (benchFrames <= 0) return 0;\n\n"
+         "  BenchTotals t = {0, 0, 0};\n";
+  for (const Message *m : checked) {
+    out << "  bench<" << ns << "::" << m->name << ">(" << m->name << "_signals, " << m->signals.size()
+        << ", rng, benchFrames, t);\n";
+  }
+  out << "  printf(\"bench: generated %.1f M signals/s, reference %.1f M signals/s (x%.1f)\\n\",\n"
+         "         t.signals / t.generatedSeconds / 1e6, t.signals / t.referenceSeconds / 1e6,\n"
+         "         t.referenceSeconds / t.generatedSeconds);\n"
+         "  return 0;\n"
+         "}\n";
+}
+
+int main(int argc, char **argv) {
+  std::string input, output, ns, check;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "-o" && i + 1 < argc) output = argv[++i];
+    else if (a == "-n" && i + 1 < argc) ns = argv[++i];
+    else if (a == "-c" && i + 1 < argc) check = argv[++i];
+    else if (input.empty()) input = a;
+    else { std::fprintf(stderr, "unexpected argument: %s\n", a.c_str()); return 2; }
+  }
+  if (input.empty() || (!check.empty() && output.empty())) {
+    std::fprintf(stderr, "usage: dbc2can input.dbc [-n namespace] [-o output.h [-c check.cpp]]\n");
+    return 2;
+  }
+
+  std::ifstream in(input);
+  if (!in) { std::fprintf(stderr, "cannot open %s\n", input.c_str()); return 1; }
+
+  if (ns.empty()) {
+    std::string base = input.substr(input.find_last_of("/\\") + 1);
+    ns = sanitize(base.substr(0, base.find('.')));
+  }
+
+  static const std::regex boRe(R"(^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+\S+)");
+  static const std::regex sgStart(R"(^\s*SG_\s)");
+  static const std::regex sgRe(
+      R"(^\s+SG_\s+(\w+)\s*(M|m\d+M?)?\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*\(([^,]+),([^)]+)\)\s*\[[^\]]*\]\s*\"([^\"]*)\")");
+
+  std::vector<Message> messages;
+  bool skipping = false;
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    lineNo++;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    std::smatch m;
+    if (std::regex_search(line, m, boRe)) {
+      uint32_t id = (uint32_t)std::strtoul(m[1].str().c_str(), nullptr, 10);
+      skipping = (id & 0x80000000u) || id > 0x7FF;
+      if (skipping) {
+        std::fprintf(stderr, "%s:%d: skipping %s (not an 11-bit identifier)\n", input.c_str(), lineNo, m[2].str().c_str());
+        continue;
+      }
+      int dlc = std::atoi(m[3].str().c_str());
+      messages.push_back(Message{id, dlc > 8 ? 8 : dlc, sanitize(m[2].str()), {}});
+    } else if (std::regex_search(line, m, sgRe)) {
+      if (skipping || messages.empty()) continue;
+      Signal s;
+      std::string muxTag = m[2].str();
+      if (muxTag.size() > 1 && muxTag.back() == 'M') {
+        std::fprintf(stderr, "%s:%d: %s: extended multiplexing is not supported, signal skipped\n", input.c_str(),
+                     lineNo, m[1].str().c_str());
+        continue;
+      }
+      s.name = memberName(sanitize(m[1].str()), messages.back(), input.c_str(), lineNo);
+      s.isMux = (muxTag == "M");
+      s.muxValue = (!muxTag.empty() && muxTag[0] == 'm') ? std::atoi(muxTag.c_str() + 1) : -1;
+      s.startBit = std::atoi(m[3].str().c_str());
+      s.length = std::atoi(m[4].str().c_str());
+      s.intel = (m[5].str() == "1");
+      s.isSigned = (m[6].str() == "-");
+      s.scale = std::atof(m[7].str().c_str());
+      s.offset = std::atof(m[8].str().c_str());
+      s.unit = m[9].str();
+      if (s.scale == 0.0) s.scale = 1.0;
+      std::string err;
+      if (!resolveShift(s, err)) {
+        std::fprintf(stderr, "%s:%d: %s: %s\n", input.c_str(), lineNo, s.name.c_str(), err.c_str());
+        return 1;
+      }
+      messages.back().signals.push_back(s);
+    } else if (std::regex_search(line, sgStart)) {
+      if (skipping) continue;
+      std::fprintf(stderr, "%s:%d: cannot parse signal, skipped: %s\n", input.c_str(), lineNo, line.c_str());
+    }
+  }
+
+  for (const Message &m : messages) {
+    bool hasMux = false;
+    for (const Signal &s : m.signals) hasMux |= s.isMux;
+    for (const Signal &s : m.signals) {
+      if (s.muxValue >= 0 && !hasMux) {
+        std::fprintf(stderr, "%s: %s uses m%d but has no multiplexor signal\n", m.name.c_str(), s.name.c_str(), s.muxValue);
+        return 1;
+      }
+    }
+  }
+
+  std::ofstream file;
+  if (!output.empty()) {
+    file.open(output);
+    if (!file) { std::fprintf(stderr, "cannot write %s\n", output.c_str()); return 1; }
+  }
+  std::ostream &out = output.empty() ? std::cout : file;
+
+  std::string guard = ns;
+  for (char &c : guard) c = (char)std::toupper((unsigned char)c);
+  guard += "_DBC_H";
+
+  out << "// Generated by dbc2can from " << input << " - do not edit.\n\n";
+  out << "#ifndef " << guard << "\n#define " << guard << "\n\n";
+  out << "#include \"ESP_CAN_Signals.h\"\n\n";
+  out << "namespace " << ns << " {\n\n";
+  for (const Message &m : messages) emitMessage(out, m);
+  out << "} // namespace " << ns << "\n\n";
+  out << "#endif // " << guard << "\n";
+
+  if (!check.empty()) {
+    std::ofstream checkFile(check);
+    if (!checkFile) { std::fprintf(stderr, "cannot write %s\n", check.c_str()); return 1; }
+    emitCheck(checkFile, messages, ns, input, output.substr(output.find_last_of("/\\") + 1));
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * enginecheck.cpp - Runs ESP_CAN_Engine in its host thread against canloop's bus.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -pthread -Itools/canloop -Ilib -o enginecheck tools/enginecheck/enginecheck.cpp
+ * Usage:
+ *   enginecheck [-n frames] [-r bitrate] [-s cycles] [-p]
+ *
+ * Without ESP_PLATFORM the engine is a std::thread, which owns the ESP_CAN
+ * instance and canloop's virtual cycle counter while it runs; this thread
+ * only touches the two queues. The node is in internal loopback, so every
+ * request sent is also received. Random frames are queued whenever the TX
+ * queue has room, and each must come back as one TX_OK and one RX result,
+ * in order and unchanged. -p receives through a CAN_FramePool and
+ * receiveHandle() instead. Each engine pass reads the cycle counter three
+ * times, so the node is polled every 3 x -s cycles. Prints the worst sample
+ * lateness and exits 1 if a frame is lost, corrupted or reported twice.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "ESP_CAN.cpp"
+#include "ESP_CAN_BitTiming.cpp"
+#include "ESP_CAN_Decoder.cpp"
+#include "ESP_CAN_Engine.cpp"
+
+uint64_t canloop_cycles = 0;
+uint32_t canloop_step = 40;
+uint32_t canloop_mhz = 240;
+uint64_t canloop_dominant = 0;
+EspClass ESP;
+
+static bool sameFrame(const CAN_Frame &a, const CAN_Frame &b) {
+  return a.id == b.id && a.dlc == b.dlc && memcmp(a.data, b.data, a.dlc) == 0;
+}
+
+int main(int argc, char **argv) {
+  long frames = 1000;
+  long bitrate = 500000;
+  bool pooled = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) frames = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) bitrate = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) canloop_step = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-p")) pooled = true;
+    else {
+      fprintf(stderr, "usage: enginecheck [-n frames] [-r bitrate] [-s cycles] [-p]\n");
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(1);
+  std::vector<CAN_Frame> sent(frames);
+  for (long n = 0; n < frames; n++) {
+    sent[n].id = rng() & 0x7FF;
+    sent[n].dlc = rng() % 9;
+    for (int i = 0; i < 8; i++) sent[n].data[i] = rng();
+  }
+
+  ESP_CAN can(0, 1);
+  can.setLoopback(CAN_LOOPBACK_INTERNAL);
+  can.begin(bitrate);
+  ESP_CAN_Engine engine(can);
+  static CAN_FramePool pool;
+  if (pooled) engine.setFramePool(&pool);
+  engine.start();
+
+  long queued = 0, txOk = 0, txFailed = 0, received = 0, corrupted = 0, rxErrors = 0;
+  // Far more than the bus time of the frames at any poll spacing
+  auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  while ((txOk + txFailed < frames || received < txOk) && std::chrono::steady_clock::now() < giveUp) {
+    while (queued < frames && engine.send(sent[queued])) queued++;
+
+    CAN_Engine_Result r;
+    while (engine.receive(r)) {
+      if (r.type == CAN_ENGINE_TX_OK || r.type == CAN_ENGINE_TX_FAILED) {
+        if (!sameFrame(r.frame, sent[txOk + txFailed])) corrupted++;
+        (r.type == CAN_ENGINE_TX_OK ? txOk : txFailed)++;
+      } else if (r.type == CAN_ENGINE_RX) {
+        if (received >= frames || !sameFrame(r.frame, sent[received])) corrupted++;
+        received++;
+      } else if (r.type == CAN_ENGINE_RX_ERROR) {
+        rxErrors++;
+      }
+    }
+    CAN_FrameHandle handle;
+    while (engine.receiveHandle(handle)) {
+      if (received >= frames || !sameFrame(pool[handle], sent[received])) corrupted++;
+      received++;
+      pool.release(handle);
+    }
+    std::this_thread::yield();
+  }
+  engine.stop();
+
+  double bus = (double)canloop_cycles / (canloop_mhz * 1e6);
+  printf("%ld bit/s, %u cycles per poll, %s\n", bitrate, canloop_step, pooled ? "frame pool" : "receive()");
+  printf("frames:    %ld sent, %ld TX ok, %ld TX failed, %ld received, %ld corrupted, %ld RX errors\n", frames,
+         txOk, txFailed, received, corrupted, rxErrors);
+  printf("bus time:  %.3f s, utilization %.0f%%, %u results dropped\n", bus, engine.utilization() * 100,
+         engine.resultsDropped);
+  printf("worst sample lateness: %u cycles (%.2f us)\n", engine.worstLatenessCycles(), engine.worstLatenessUs());
+  if (pooled) printf("pool:      %u in use, high water %u\n", pool.inUse(), pool.highWater());
+
+  bool failed = txOk != frames || received != frames || corrupted || rxErrors || engine.resultsDropped;
+  printf(failed ? "FAILED\n" : "ok\n");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * gatewaysim.cpp - ESP_CAN_Gateway between two fully loaded simulated buses.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -Itools/canloop -Ilib -o gatewaysim tools/gatewaysim/gatewaysim.cpp
+ * Usage:
+ *   gatewaysim [-n frames] [-r bitrate] [-s cycles] [-w window]
+ *
+ * canloop pins 0-7 and 8-15 are two separate wired-AND buses. The gateway
+ * has a node on each, polled through one ESP_CAN_MultiBus. Each bus also
+ * has a source node. Bus 0 sources IDs 0x700-0x707 and bus 1 IDs
+ * 0x708-0x70F; the gateway forwards each ID to the other bus as
+ * 0x000-0x00F, which wins arbitration over the local source. A source keeps
+ * a frame waiting as long as fewer than -w of its frames are still on their
+ * way to the far bus (without the window, whichever source got ahead would
+ * fill the other bus with forwarded frames and starve its source). With the
+ * default window of 4 both buses run at full line rate, half local and half
+ * forwarded traffic. The source on the far bus checks that each forwarded
+ * frame arrives in order and unchanged. Every node is polled once per pass,
+ * every 3 x -s cycles. Exits 1 if a frame is lost, corrupted or reordered,
+ * a queue overflows, a bus is less than 95% loaded, or a frame waits longer
+ * than the window allows.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+
+#include "ESP_CAN.cpp"
+#include "ESP_CAN_BitTiming.cpp"
+#include "ESP_CAN_Decoder.cpp"
+#include "ESP_CAN_Gateway.cpp"
+#include "ESP_CAN_MultiBus.cpp"
+
+uint64_t canloop_cycles = 0;
+uint32_t canloop_step = 20;
+uint32_t canloop_mhz = 240;
+uint64_t canloop_dominant = 0;
+EspClass ESP;
+
+static const uint32_t MAX_FRAME_BITS = 160;  // Longest stuffed frame plus intermission
+static const uint32_t SOURCE_ID[2] = {0x700, 0x708};
+
+struct Source {
+  ESP_CAN node;
+  std::deque<CAN_Frame> inFlight;  // Sent here, not yet seen on the far bus
+  CAN_Frame current;
+  long sent;       // Acknowledged on this bus
+  long received;   // Forwarded frames seen here
+  long corrupted;  // Wrong or out-of-order forwarded frames
+  uint64_t bits;   // Bus time of every frame on this bus, in bits
+
+  Source(int rx, int tx) : node(rx, tx), sent(0), received(0), corrupted(0), bits(0) {}
+};
+
+// Stuffed frame plus CRC delimiter, ACK slot and delimiter, EOF and
+// intermission
+static uint32_t busBits(const CAN_Frame &frame) {
+  return can_encode_waveform(frame).length + 1 + 2 + 7 + 3;
+}
+
+static bool sameFrame(const CAN_Frame &a, const CAN_Frame &b) {
+  return a.id == b.id && a.dlc == b.dlc && memcmp(a.data, b.data, a.dlc) == 0;
+}
+
+int main(int argc, char **argv) {
+  long frames = 2000;
+  long bitrate = 500000;
+  size_t window = 4;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) frames = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) bitrate = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) canloop_step = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-w") && i + 1 < argc) window = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: gatewaysim [-n frames] [-r bitrate] [-s cycles] [-w window]\n");
+      return 2;
+    }
+  }
+
+  ESP_CAN gw0(0, 1), gw1(8, 9);
+  ESP_CAN_MultiBus buses;
+  buses.addBus(gw0);
+  buses.addBus(gw1);
+  buses.begin(bitrate);
+  ESP_CAN_Gateway gateway(buses);
+  for (int bus = 0; bus < 2; bus++) {
+    for (uint32_t k = 0; k < 8; k++) {
+      uint32_t id = SOURCE_ID[bus] + k;
+      gateway.addRoute({(uint8_t)bus, id, 0x7FF, (uint8_t)(1 << (1 - bus)), id & 0xF, 0});
+    }
+  }
+  gateway.compile();
+
+  Source *sources[2] = {new Source(2, 3), new Source(10, 11)};
+  for (Source *s : sources) s->node.begin(bitrate);
+
+  std::mt19937 rng(1);
+  uint64_t bitCycles = (uint64_t)canloop_mhz * 1000000 / bitrate;
+  uint64_t limit = canloop_cycles + (uint64_t)frames * 2 * 200 * bitCycles;
+  uint64_t start = canloop_cycles;
+  bool waiting[2] = {false, false};
+
+  while ((sources[0]->received < frames || sources[1]->received < frames) && canloop_cycles < limit) {
+    for (int bus = 0; bus < 2; bus++) {
+      Source &s = *sources[bus];
+      CAN_Tx_State tx = s.node.txState();
+      if (waiting[bus] && tx == CAN_TX_DONE) {
+        s.inFlight.push_back(s.current);
+        s.sent++;
+        s.bits += busBits(s.current);
+        waiting[bus] = false;
+      }
+      if (tx == CAN_TX_WAITING || tx == CAN_TX_SENDING) continue;
+      // Lost arbitration: the same frame goes again
+      if (!waiting[bus] && s.inFlight.size() >= window) continue;
+      if (!waiting[bus] && s.sent < frames) {
+        s.current.id = SOURCE_ID[bus] + rng() % 8;
+        s.current.dlc = rng() % 9;
+        for (int k = 0; k < 8; k++) s.current.data[k] = rng();
+      }
+      if (s.sent < frames || waiting[bus]) waiting[bus] = s.node.startFrame(s.current);
+    }
+
+    gateway.poll();
+    for (int bus = 0; bus < 2; bus++) {
+      Source &s = *sources[bus];
+      Source &far = *sources[1 - bus];
+      CAN_Frame got;
+      if (s.node.readFrame(got) != CAN_READ_MSG_OK || got.id >= 0x10) continue;
+      s.received++;
+      s.bits += busBits(got);
+      CAN_Frame expected = far.inFlight.empty() ? CAN_Frame() : far.inFlight.front();
+      expected.id &= 0xF;
+      if (far.inFlight.empty() || !sameFrame(got, expected)) s.corrupted++;
+      if (!far.inFlight.empty()) far.inFlight.pop_front();
+    }
+  }
+
+  double elapsedBits = (double)(canloop_cycles - start) / bitCycles;
+  // Let the gateway see the end of its last transmissions
+  for (uint64_t until = canloop_cycles + 20 * bitCycles; canloop_cycles < until;) gateway.poll();
+  int failures = 0;
+  printf("%ld frames each way, %ld bit/s, %u cycles per poll, window %zu\n", frames, bitrate, canloop_step,
+         window);
+  for (int bus = 0; bus < 2; bus++) {
+    Source &s = *sources[bus];
+    double load = s.bits / elapsedBits;
+    printf("bus %d: %ld sent, %ld forwarded here, %ld corrupted, load %.1f%%\n", bus, s.sent, s.received,
+           s.corrupted, load * 100);
+    if (s.sent != frames || s.received != frames || s.corrupted || load < 0.95) failures++;
+  }
+  const CAN_Gateway_Stats &st = gateway.stats;
+  printf("gateway: %u received, %u forwarded, %u unrouted, %u queue full, %u retries, %u failed\n", st.received,
+         st.forwarded, st.unrouted, st.queueFull, st.txRetries, st.txFailed);
+  printf("latency: %.1f us average, %.1f us max\n", gateway.averageLatencyUs(), gateway.maxLatencyUs());
+  if (st.forwarded != 2 * frames || st.queueFull || st.txFailed) failures++;
+  // A forwarded frame waits for at most the frame on the bus and the window
+  // ahead of it
+  if (gateway.maxLatencyUs() > (window + 1) * MAX_FRAME_BITS * 1e6 / bitrate) failures++;
+  printf(failures ? "FAILED\n" : "ok\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * multibench.cpp - Cost of each additional bus in ESP_CAN_MultiBus::poll().
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -Itools/canloop -Ilib -o multibench tools/multibench/multibench.cpp
+ * Usage:
+ *   multibench [-n frames] [-r bitrate] [-s cycles] [-m buses]
+ *
+ * Bus i is its own wired-AND bus on canloop pins 8i (RX) and 8i+1 (TX),
+ * with one node in external loopback that sends random frames back to back
+ * and acknowledges them itself. The buses start at different instants, so
+ * their bit grids are offset. poll() reads all RX levels through the
+ * shim's GPIO_IN_REG, as it reads the port register on the ESP32. For 1 to
+ * -m buses, -n frames per bus are sent and the host time per poll() is
+ * measured. Prints the cost of each additional bus and exits 1 if a frame
+ * is lost or corrupted on any bus.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "ESP_CAN.cpp"
+#include "ESP_CAN_BitTiming.cpp"
+#include "ESP_CAN_Decoder.cpp"
+#include "ESP_CAN_MultiBus.cpp"
+
+uint64_t canloop_cycles = 0;
+uint32_t canloop_step = 40;
+uint32_t canloop_mhz = 240;
+uint64_t canloop_dominant = 0;
+EspClass ESP;
+
+static bool sameFrame(const CAN_Frame &a, const CAN_Frame &b) {
+  return a.id == b.id && a.dlc == b.dlc && memcmp(a.data, b.data, a.dlc) == 0;
+}
+
+struct Result {
+  long ok, lost, corrupted;
+  uint64_t polls;
+  double ns;  // Host time per poll()
+};
+
+static Result run(int count, long frames, long bitrate) {
+  canloop_dominant = 0;
+  ESP_CAN *nodes[CAN_MULTIBUS_MAX];
+  ESP_CAN_MultiBus buses;
+  for (int i = 0; i < count; i++) {
+    nodes[i] = new ESP_CAN(8 * i, 8 * i + 1);
+    nodes[i]->setLoopback(CAN_LOOPBACK_EXTERNAL);
+    buses.addBus(*nodes[i]);
+  }
+  buses.begin(bitrate);
+
+  std::mt19937 rng(count);
+  CAN_Frame sent[CAN_MULTIBUS_MAX];
+  long started[CAN_MULTIBUS_MAX] = {};
+  bool pending[CAN_MULTIBUS_MAX] = {};
+  Result r = {0, 0, 0, 0, 0};
+  uint64_t bitCycles = (uint64_t)canloop_mhz * 1000000 / bitrate;
+  // Bus i waits i * 7.3 bits before its first frame
+  uint64_t firstStart = canloop_cycles;
+  uint64_t limit = canloop_cycles + (uint64_t)(frames + 10) * 200 * bitCycles;
+
+  auto wallStart = std::chrono::steady_clock::now();
+  while (canloop_cycles < limit) {
+    bool done = true;
+    for (int i = 0; i < count; i++) {
+      ESP_CAN &can = *nodes[i];
+      CAN_Tx_State tx = can.txState();
+      if (!pending[i] && started[i] < frames && canloop_cycles - firstStart >= i * 73 * bitCycles / 10 &&
+          tx != CAN_TX_WAITING && tx != CAN_TX_SENDING) {
+        sent[i].id = rng() & 0x7FF;
+        sent[i].dlc = rng() % 9;
+        for (int k = 0; k < 8; k++) sent[i].data[k] = rng();
+        pending[i] = can.startFrame(sent[i]);
+        started[i]++;
+      }
+      done = done && started[i] == frames && !pending[i];
+    }
+    if (done) break;
+
+    uint32_t ready = buses.poll();
+    r.polls++;
+    for (int i = 0; ready; i++, ready >>= 1) {
+      CAN_Frame got;
+      if (!(ready & 1) || buses.result(i, got) != CAN_READ_MSG_OK) continue;
+      if (!pending[i] || !sameFrame(got, sent[i])) r.corrupted++;
+      else r.ok++;
+      pending[i] = false;
+    }
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  r.ns = wall * 1e9 / r.polls;
+  r.lost = frames * count - r.ok - r.corrupted;
+  for (int i = 0; i < count; i++) delete nodes[i];
+  return r;
+}
+
+int main(int argc, char **argv) {
+  long frames = 300;
+  long bitrate = 500000;
+  int maxBuses = CAN_MULTIBUS_MAX;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) frames = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) bitrate = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) canloop_step = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-m") && i + 1 < argc) maxBuses = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: multibench [-n frames] [-r bitrate] [-s cycles] [-m buses]\n");
+      return 2;
+    }
+  }
+  if (maxBuses < 1 || maxBuses > CAN_MULTIBUS_MAX) {
+    fprintf(stderr, "-m must be 1 to %d\n", CAN_MULTIBUS_MAX);
+    return 2;
+  }
+
+  printf("%ld frames per bus, %ld bit/s, %u cycles per poll\n", frames, bitrate, canloop_step);
+  printf("buses  frames ok  lost  corrupted  ns/poll  +ns for this bus\n");
+  int failures = 0;
+  double previous = 0, first = 0;
+  for (int count = 1; count <= maxBuses; count++) {
+    Result r = run(count, frames, bitrate);
+    printf("%5d  %9ld  %4ld  %9ld  %7.1f  %+8.1f\n", count, r.ok, r.lost, r.corrupted, r.ns,
+           count > 1 ? r.ns - previous : r.ns);
+    if (count == 1) first = r.ns;
+    previous = r.ns;
+    if (r.lost || r.corrupted) failures++;
+  }
+  if (maxBuses > 1) printf("about %.1f ns per additional bus\n", (previous - first) / (maxBuses - 1));
+  return failures ? 1 : 0;
+}
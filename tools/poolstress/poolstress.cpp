@@ -0,0 +1,185 @@
+/*
+ * poolstress.cpp - Hammers CAN_FramePool from several threads at once.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -pthread -Ilib -o poolstress tools/poolstress/poolstress.cpp
+ * Usage:
+ *   poolstress [-t threads] [-n operations per thread]
+ *
+ * Each thread keeps a few handles and at random allocates a slot and
+ * writes a pattern into it, retains a handle it holds, releases one
+ * owner, or retains a handle and posts it to the next thread's mailbox,
+ * which checks and releases it. A pattern is the writer's thread and
+ * sequence number, and every holder checks it on each step, so a slot
+ * handed out twice shows up as a changed frame. At the end every handle
+ * is released; the pool must be empty, and alloc() must then return each
+ * of the CAN_FRAME_POOL_SIZE slots exactly once. Exits 1 on a corrupted
+ * frame or a lost or duplicated slot.
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "ESP_CAN_FramePool.h"
+
+static const int MAX_THREADS = 16;
+static const int MAX_HELD = 8;  // Handles per thread: 4 threads can empty the pool
+
+static CAN_FramePool pool;
+static std::atomic<uint16_t> mailbox[MAX_THREADS];
+
+struct Held {
+  CAN_FrameHandle handle;
+  uint32_t pattern;
+};
+
+struct Counts {
+  long allocs, emptyPool, retains, releases, posted, taken, corrupted;
+};
+
+static void fill(CAN_Frame &f, uint32_t pattern) {
+  f.id = pattern & 0x7FF;
+  f.dlc = 8;
+  memcpy(f.data, &pattern, 4);
+  for (int i = 0; i < 4; i++) f.data[4 + i] = ~f.data[i];
+}
+
+static bool intact(const CAN_Frame &f, uint32_t pattern) {
+  CAN_Frame expected;
+  fill(expected, pattern);
+  return f.id == expected.id && f.dlc == expected.dlc && memcmp(f.data, expected.data, 8) == 0;
+}
+
+// The pattern a posted frame was written with, if it was not overwritten
+static bool patternOf(const CAN_Frame &f, uint32_t &pattern) {
+  memcpy(&pattern, f.data, 4);
+  return intact(f, pattern);
+}
+
+static void worker(int self, int threads, long operations, Counts &c) {
+  std::mt19937 rng(self + 1);
+  Held held[MAX_HELD];
+  int count = 0;
+  uint32_t sequence = 0;
+  for (long op = 0; op < operations; op++) {
+    // Hands the core over often, so that threads interleave even on a
+    // single-core host
+    if (op % 16 == 0) std::this_thread::yield();
+    CAN_FrameHandle posted = mailbox[self].exchange(CAN_FRAME_HANDLE_NONE);
+    if (posted != CAN_FRAME_HANDLE_NONE) {
+      uint32_t pattern;
+      if (!patternOf(pool[posted], pattern)) c.corrupted++;
+      pool.release(posted);
+      c.taken++;
+    }
+
+    switch (rng() % 4) {
+    case 0:
+      if (count < MAX_HELD) {
+        CAN_FrameHandle h = pool.alloc();
+        if (h == CAN_FRAME_HANDLE_NONE) {
+          c.emptyPool++;
+          break;
+        }
+        uint32_t pattern = (uint32_t)self << 24 | (++sequence & 0xFFFFFF);
+        fill(pool[h], pattern);
+        held[count++] = {h, pattern};
+        c.allocs++;
+      }
+      break;
+    case 1:
+      // A second owner in this thread: both are released in turn
+      if (count > 0 && count < MAX_HELD) {
+        held[count] = held[rng() % count];
+        pool.retain(held[count++].handle);
+        c.retains++;
+      }
+      break;
+    case 2:
+      if (count > 0) {
+        int k = rng() % count;
+        pool.release(held[k].handle);
+        held[k] = held[--count];
+        c.releases++;
+      }
+      break;
+    case 3:
+      if (count > 0) {
+        Held &h = held[rng() % count];
+        CAN_FrameHandle none = CAN_FRAME_HANDLE_NONE;
+        pool.retain(h.handle);
+        if (mailbox[(self + 1) % threads].compare_exchange_strong(none, h.handle)) c.posted++;
+        else pool.release(h.handle);
+      }
+      break;
+    }
+
+    for (int k = 0; k < count; k++) {
+      if (!intact(pool[held[k].handle], held[k].pattern)) c.corrupted++;
+    }
+  }
+  for (int k = 0; k < count; k++) pool.release(held[k].handle);
+}
+
+int main(int argc, char **argv) {
+  int threads = 4;
+  long operations = 2000000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-t") && i + 1 < argc) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc) operations = atol(argv[++i]);
+    else {
+      fprintf(stderr, "usage: poolstress [-t threads] [-n operations]\n");
+      return 2;
+    }
+  }
+  if (threads < 1 || threads > MAX_THREADS) {
+    fprintf(stderr, "-t must be 1 to %d\n", MAX_THREADS);
+    return 2;
+  }
+
+  for (int i = 0; i < threads; i++) mailbox[i].store(CAN_FRAME_HANDLE_NONE);
+  std::vector<Counts> counts(threads, Counts());
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++) workers.emplace_back(worker, i, threads, operations, std::ref(counts[i]));
+  for (int i = 0; i < threads; i++) workers[i].join();
+  // Frames posted after their receiver finished
+  for (int i = 0; i < threads; i++) pool.release(mailbox[i].exchange(CAN_FRAME_HANDLE_NONE));
+
+  Counts total = Counts();
+  for (int i = 0; i < threads; i++) {
+    total.allocs += counts[i].allocs;
+    total.emptyPool += counts[i].emptyPool;
+    total.retains += counts[i].retains;
+    total.releases += counts[i].releases;
+    total.posted += counts[i].posted;
+    total.taken += counts[i].taken;
+    total.corrupted += counts[i].corrupted;
+  }
+  printf("%d threads, %ld operations each, %u slots\n", threads, operations, CAN_FramePool::capacity());
+  printf("%ld allocs (%ld found the pool empty), %ld retains, %ld releases, %ld posted, %ld taken\n", total.allocs,
+         total.emptyPool, total.retains, total.releases, total.posted, total.taken);
+  printf("%ld corrupted frames, %u in use at the end, high water %u\n", total.corrupted, pool.inUse(),
+         pool.highWater());
+
+  // Every slot must be free exactly once
+  int failures = total.corrupted || pool.inUse() != 0;
+  std::vector<bool> seen(CAN_FramePool::capacity(), false);
+  uint32_t returned = 0;
+  for (CAN_FrameHandle h; (h = pool.alloc()) != CAN_FRAME_HANDLE_NONE;) {
+    if (h >= CAN_FramePool::capacity() || seen[h] || returned == CAN_FramePool::capacity()) {
+      failures++;
+      break;
+    }
+    seen[h] = true;
+    returned++;
+  }
+  printf("%u of %u slots returned\n", returned, CAN_FramePool::capacity());
+  if (returned != CAN_FramePool::capacity()) failures++;
+  printf(failures ? "FAILED\n" : "ok\n");
+  return failures ? 1 : 0;
+}
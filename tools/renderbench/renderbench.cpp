@@ -0,0 +1,199 @@
+/*
+ * renderbench.cpp - Verifies and benchmarks the oversampled burst renderer.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -Ilib -o renderbench tools/renderbench/renderbench.cpp \
+ *       lib/ESP_CAN_SampleDecoder.cpp lib/ESP_CAN_Decoder.cpp
+ * Usage:
+ *   renderbench [-n bursts]
+ *
+ * For 4, 8, 16 and 32 samples per bit and both bit orders, random bursts
+ * of frames and idle gaps are rendered and every sample is compared with
+ * the expected bus level. The bit 0 first renders are also run through
+ * CAN_SampleDecoder, which must return every frame of the burst. Then
+ * prints render throughput against a sample-at-a-time loop. Exits 1 on
+ * any mismatch.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "ESP_CAN_Render.h"
+#include "ESP_CAN_SampleDecoder.h"
+
+static const int MAX_FRAMES = 32;
+static const size_t BUFFER_WORDS = 64 * 1024;
+
+struct Burst {
+  std::vector<CAN_Frame> frames;
+  std::vector<int> gaps;  // Idle bits before each frame
+};
+
+static CAN_Frame randomFrame(std::mt19937 &rng) {
+  CAN_Frame f;
+  f.id = rng() & 0x7FF;
+  f.dlc = rng() % 9;
+  // Mostly zero or all-ones bytes, so long runs and stuffing are common
+  for (int i = 0; i < 8; i++) f.data[i] = rng() % 3 == 0 ? rng() : (rng() & 1) * 0xFF;
+  return f;
+}
+
+static Burst randomBurst(std::mt19937 &rng) {
+  Burst b;
+  int n = 1 + rng() % MAX_FRAMES;
+  for (int i = 0; i < n; i++) {
+    b.frames.push_back(randomFrame(rng));
+    b.gaps.push_back(rng() % 4 == 0 ? rng() % 50 : 0);
+  }
+  return b;
+}
+
+// Bus levels of the burst, one per bit, as the renderer should play them
+static std::vector<bool> busBits(const Burst &b) {
+  std::vector<bool> bits;
+  for (size_t i = 0; i < b.frames.size(); i++) {
+    bits.insert(bits.end(), b.gaps[i], true);
+    CAN_Waveform wave = can_encode_waveform(b.frames[i]);
+    for (int k = 0; k < wave.length; k++) bits.push_back(wave.bit(k));
+    bits.insert(bits.end(), CAN_RENDER_TAIL_BITS + CAN_RENDER_INTERMISSION_BITS, true);
+  }
+  while (bits.size() % 8) bits.push_back(true);
+  return bits;
+}
+
+template <uint8_t O> static size_t render(CAN_BurstRenderer<O> &r, const Burst &b, uint32_t *out) {
+  r.start(out, BUFFER_WORDS);
+  for (size_t i = 0; i < b.frames.size(); i++) {
+    if (!r.idle(b.gaps[i]) || !r.frame(b.frames[i])) return 0;
+  }
+  return r.finish();
+}
+
+static void collect(const CAN_SampleFrame &f, void *arg) {
+  static_cast<std::vector<CAN_SampleFrame> *>(arg)->push_back(f);
+}
+
+static bool sameFrame(const CAN_Frame &a, const CAN_Frame &b) {
+  return a.id == b.id && a.dlc == b.dlc && memcmp(a.data, b.data, a.dlc) == 0;
+}
+
+template <uint8_t O> static bool check(std::mt19937 &rng, long bursts, bool msbFirst) {
+  CAN_BurstRenderer<O> r(msbFirst);
+  static uint32_t out[BUFFER_WORDS + 1];
+  for (long n = 0; n < bursts; n++) {
+    Burst b = randomBurst(rng);
+    std::vector<bool> bits = busBits(b);
+    size_t words = render(r, b, out);
+    if (words != bits.size() * O / 32) {
+      fprintf(stderr, "%u samples/bit: %zu words for %zu bits\n", O, words, bits.size());
+      return false;
+    }
+    for (size_t s = 0; s < words * 32; s++) {
+      bool level = (out[s / 32] >> (msbFirst ? 31 - s % 32 : s % 32)) & 1;
+      if (level != bits[s / O]) {
+        fprintf(stderr, "%u samples/bit, %s first: sample %zu is %d\n", O, msbFirst ? "msb" : "lsb", s, level);
+        return false;
+      }
+    }
+    if (msbFirst) continue;
+
+    // Two bit 0 first words read as one little-endian uint64_t
+    if (words % 2) out[words++] = 0xFFFFFFFF;
+    std::vector<CAN_SampleFrame> got;
+    CAN_SampleDecoder decoder;
+    decoder.begin(O, 0.5, true);
+    decoder.onFrame(collect, &got);
+    decoder.feed(reinterpret_cast<const uint64_t *>(out), words / 2);
+    decoder.finish();
+    bool ok = got.size() == b.frames.size();
+    for (size_t i = 0; ok && i < got.size(); i++) {
+      ok = got[i].error == CAN_DECODE_ERROR_NONE && sameFrame(got[i].frame, b.frames[i]);
+    }
+    if (!ok) {
+      fprintf(stderr, "%u samples/bit: decoded %zu of %zu frames\n", O, got.size(), b.frames.size());
+      return false;
+    }
+  }
+  return true;
+}
+
+// Sample-at-a-time reference, for the benchmark
+template <uint8_t O> static size_t renderNaive(const std::vector<CAN_Waveform> &waves, uint32_t *out) {
+  size_t s = 0;
+  for (size_t i = 0; i < waves.size(); i++) {
+    int total = waves[i].length + CAN_RENDER_TAIL_BITS + CAN_RENDER_INTERMISSION_BITS;
+    for (int k = 0; k < total; k++) {
+      bool level = k < waves[i].length ? waves[i].bit(k) : true;
+      for (int j = 0; j < O; j++, s++) {
+        uint32_t mask = (uint32_t)1 << (31 - s % 32);
+        out[s / 32] = level ? out[s / 32] | mask : out[s / 32] & ~mask;
+      }
+    }
+  }
+  return (s + 31) / 32;
+}
+
+template <typename F> static double bestOf(F run) {
+  double best = 1e9;
+  for (int pass = 0; pass < 7; pass++) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+template <uint8_t O> static void bench(const std::vector<CAN_Waveform> &waves, size_t bits) {
+  static CAN_BurstRenderer<O> r;
+  static uint32_t out[BUFFER_WORDS];
+  size_t words = 0;
+  double fast = bestOf([&] {
+    r.start(out, BUFFER_WORDS);
+    for (size_t i = 0; i < waves.size(); i++) r.frame(waves[i]);
+    words = r.finish();
+  });
+  double naive = bestOf([&] { renderNaive<O>(waves, out); });
+  printf("%5u  %8.0f  %7.0f  %8.0f  %6.1fx\n", O, bits / fast / 1e6, words * 4 / fast / 1e6,
+         fast * 1e9 / waves.size(), naive / fast);
+}
+
+int main(int argc, char **argv) {
+  long bursts = 2000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) bursts = atol(argv[++i]);
+    else {
+      fprintf(stderr, "usage: renderbench [-n bursts]\n");
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(1);
+  for (int msb = 0; msb < 2; msb++) {
+    if (!check<4>(rng, bursts, msb) || !check<8>(rng, bursts, msb) || !check<16>(rng, bursts, msb) ||
+        !check<32>(rng, bursts, msb)) {
+      return 1;
+    }
+  }
+  printf("%ld bursts verified at 4, 8, 16 and 32 samples/bit, both bit orders\n", bursts * 8);
+
+  // As many frames as fit the buffer at 32 samples per bit
+  std::vector<CAN_Waveform> waves;
+  size_t bits = 0;
+  while (CAN_BurstRenderer<32>::wordsFor(bits + 128 + CAN_RENDER_TAIL_BITS + CAN_RENDER_INTERMISSION_BITS) <=
+         BUFFER_WORDS) {
+    waves.push_back(can_encode_waveform(randomFrame(rng)));
+    bits += waves.back().length + CAN_RENDER_TAIL_BITS + CAN_RENDER_INTERMISSION_BITS;
+  }
+  printf("burst of %zu frames, %zu bus bits\n", waves.size(), bits);
+  printf("s/bit  Mbit/s in  MB/s out  ns/frame  vs naive\n");
+  bench<4>(waves, bits);
+  bench<8>(waves, bits);
+  bench<16>(waves, bits);
+  bench<32>(waves, bits);
+  return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * replaycheck.cpp - Replays a candump log that arrives in chunks, as from a
+ * serial port or socket.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -Itools/canloop -Ilib -o replaycheck tools/replaycheck/replaycheck.cpp
+ * Usage:
+ *   replaycheck [-n frames] [-r bitrate] [-c chunk_bytes] [-g gap_ms] [-i]
+ *
+ * A log of random frames 1 ms apart is handed to ESP_CAN_Replay through a
+ * Stream that releases -c bytes every -g ms (default 80 bytes every 2 ms,
+ * a little faster than the log needs, so the stream is often empty between
+ * chunks). With the TRANSMIT target
+ * the replaying node sends on canloop's wired-AND bus and a second node
+ * must receive every frame, in order and unchanged. With -i the frames are
+ * injected and read back from the replaying node. The replay must not
+ * stop while the stream is only waiting for its next chunk, no poll() call
+ * may take as long as a bit, and once finish() is called and the last
+ * frame is out the replay must end at once. Prints the worst lateness and exits 1 on any deviation.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ESP_CAN.cpp"
+#include "ESP_CAN_BitTiming.cpp"
+#include "ESP_CAN_Decoder.cpp"
+#include "ESP_CAN_Replay.cpp"
+
+uint64_t canloop_cycles = 0;
+uint32_t canloop_step = 40;
+uint32_t canloop_mhz = 240;
+uint64_t canloop_dominant = 0;
+EspClass ESP;
+
+// The log text, released `chunk` bytes at a time every `gapMs`
+class ChunkStream : public Stream {
+public:
+  std::string text;
+  size_t released, pos, chunk;
+  unsigned long gapMs, nextMs;
+
+  ChunkStream(size_t chunkBytes, unsigned long gap)
+      : released(0), pos(0), chunk(chunkBytes), gapMs(gap), nextMs(0) {}
+
+  int available() override {
+    if (millis() >= nextMs && released < text.size()) {
+      released = released + chunk < text.size() ? released + chunk : text.size();
+      nextMs = millis() + gapMs;
+    }
+    return (int)(released - pos);
+  }
+  int read() override { return pos < released ? (unsigned char)text[pos++] : -1; }
+  bool drained() const { return pos == text.size(); }
+};
+
+static bool sameFrame(const CAN_Frame &a, const CAN_Frame &b) {
+  return a.id == b.id && a.dlc == b.dlc && memcmp(a.data, b.data, a.dlc) == 0;
+}
+
+int main(int argc, char **argv) {
+  long frames = 500;
+  long bitrate = 500000;
+  size_t chunk = 80;
+  unsigned long gapMs = 2;
+  bool inject = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) frames = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) bitrate = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc) chunk = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-g") && i + 1 < argc) gapMs = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-i")) inject = true;
+    else {
+      fprintf(stderr, "usage: replaycheck [-n frames] [-r bitrate] [-c chunk_bytes] [-g gap_ms] [-i]\n");
+      return 2;
+    }
+  }
+  if (chunk < 1) chunk = 1;
+
+  ChunkStream log(chunk, gapMs);
+  std::vector<CAN_Frame> sent(frames);
+  std::mt19937 rng(1);
+  for (long n = 0; n < frames; n++) {
+    CAN_Frame &f = sent[n];
+    f.id = rng() & 0x7FF;
+    f.dlc = rng() % 9;
+    for (int i = 0; i < 8; i++) f.data[i] = rng();
+    char line[64];
+    int len = snprintf(line, sizeof(line), "(%ld.%06ld) can0 %03X#", 1000 + n / 1000, n % 1000 * 1000,
+                       (unsigned)f.id);
+    for (int i = 0; i < f.dlc; i++) len += snprintf(line + len, sizeof(line) - len, "%02X", f.data[i]);
+    log.text.append(line, len);
+    log.text += '\n';
+  }
+
+  ESP_CAN node(0, 1), peer(2, 3);
+  if (inject) node.setLoopback(CAN_LOOPBACK_INTERNAL);
+  node.begin(bitrate);
+  peer.begin(bitrate);
+  ESP_CAN_Replay replay(node, log);
+  replay.begin(inject ? CAN_REPLAY_INJECT : CAN_REPLAY_TRANSMIT, CAN_REPLAY_ORIGINAL);
+
+  uint64_t bitCycles = (uint64_t)canloop_mhz * 1000000 / bitrate;
+  uint64_t longestPoll = 0;
+  long received = 0, corrupted = 0;
+  bool finished = false, endedEarly = false, running = true;
+  uint64_t finishedAt = 0, lastSentAt = 0;
+  // The log span or the time the stream takes to deliver it, plus a second
+  uint64_t streamMs = log.text.size() / chunk * gapMs;
+  uint64_t limit = canloop_cycles + ((uint64_t)frames + streamMs + 1000) * 1000 * canloop_mhz;
+  while (running && canloop_cycles < limit) {
+    uint64_t before = canloop_cycles;
+    running = replay.poll();
+    if (canloop_cycles - before > longestPoll) longestPoll = canloop_cycles - before;
+    if (!running && !finished) endedEarly = true;
+    if (!lastSentAt && (long)replay.stats.framesSent == frames) lastSentAt = canloop_cycles;
+
+    CAN_Frame got;
+    ESP_CAN &reader = inject ? node : peer;
+    if (reader.readFrame(got) == CAN_READ_MSG_OK) {
+      if (received >= frames || !sameFrame(got, sent[received])) corrupted++;
+      received++;
+    }
+    if (!finished && log.drained()) {
+      replay.finish();
+      finished = true;
+      finishedAt = canloop_cycles;
+    }
+  }
+  uint64_t endedAt = canloop_cycles;
+  // The peer still has to see the end of the last frame
+  for (uint64_t until = canloop_cycles + 200 * bitCycles; !inject && canloop_cycles < until;) {
+    CAN_Frame got;
+    if (peer.readFrame(got) == CAN_READ_MSG_OK) {
+      if (received >= frames || !sameFrame(got, sent[received])) corrupted++;
+      received++;
+    }
+  }
+
+  const CAN_Replay_Stats &st = replay.stats;
+  printf("%ld frames, %s, %zu bytes every %lu ms, %ld bit/s\n", frames, inject ? "inject" : "transmit", chunk, gapMs,
+         bitrate);
+  printf("%u sent, %u failed, %u skipped lines, %ld received, %ld corrupted\n", st.framesSent, st.framesFailed,
+         st.linesSkipped, received, corrupted);
+  printf("worst lateness %u us, longest poll() %.2f bits, log span %.3f s\n", st.maxLatenessUs,
+         (double)longestPoll / bitCycles, st.logSpanUs / 1e6);
+  bool failed = false;
+  if (endedEarly || running) {
+    printf(endedEarly ? "replay ended before the log was complete\n" : "replay did not end after finish()\n");
+    failed = true;
+  }
+  uint64_t endFrom = finishedAt > lastSentAt ? finishedAt : lastSentAt;
+  if (finished && !running && endedAt - endFrom > 300 * bitCycles) {
+    printf("replay took too long to end after finish()\n");
+    failed = true;
+  }
+  if ((long)st.framesSent != frames || received != frames || corrupted || longestPoll >= bitCycles) failed = true;
+  printf(failed ? "FAILED\n" : "ok\n");
+  return failed ? 1 : 0;
+}
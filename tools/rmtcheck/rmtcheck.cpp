@@ -0,0 +1,111 @@
+/*
+ * rmtcheck.cpp - Verifies and benchmarks the RMT symbol encoder.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -Ilib -o rmtcheck tools/rmtcheck/rmtcheck.cpp lib/ESP_CAN_Decoder.cpp
+ * Usage:
+ *   rmtcheck [-n frames]
+ *
+ * For each bit rate from 10 kbit/s to 1 Mbit/s, random frames are encoded
+ * into RMT symbols and played back with can_rmt_to_bits(). The bits must
+ * match the waveform plus the recessive tail, the total duration must
+ * match the bit count, and CAN_BitDecoder must decode the original frame.
+ * Prints symbols per frame and encode time, and exits 1 on any mismatch.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "ESP_CAN_Rmt.h"
+
+static const uint32_t BITRATES[] = {10000, 20000, 50000, 83333, 100000, 125000, 250000, 500000, 800000, 1000000};
+static const uint32_t RESOLUTIONS[] = {20000000, 80000000, 1000000};
+
+static CAN_Frame randomFrame(std::mt19937 &rng) {
+  CAN_Frame f;
+  f.id = rng() & 0x7FF;
+  f.dlc = rng() % 9;
+  // Mostly zero or all-ones bytes, so long runs and stuffing are common
+  for (int i = 0; i < 8; i++) f.data[i] = rng() % 3 == 0 ? rng() : (rng() & 1) * 0xFF;
+  return f;
+}
+
+static bool check(const CAN_Frame &f, uint32_t resolution, uint32_t bitrate, int &symbols) {
+  CAN_Waveform wave = can_encode_waveform(f);
+  CAN_RmtSymbol out[CAN_RMT_MAX_SYMBOLS];
+  int count = can_rmt_encode(wave, resolution, bitrate, out, CAN_RMT_MAX_SYMBOLS);
+  if (count == 0) return false;
+  symbols = count;
+
+  int total = wave.length + CAN_RMT_TAIL_BITS;
+  uint32_t duration = 0;
+  for (int i = 0; i < count; i++) duration += out[i].duration0 + out[i].duration1;
+  if (duration != can_rmt_edge(total, resolution, bitrate)) return false;
+
+  bool bits[160];
+  int n = can_rmt_to_bits(out, count, resolution, bitrate, bits, 160);
+  if (n != total) return false;
+  for (int i = 0; i < n; i++) {
+    if (bits[i] != (i < wave.length ? wave.bit(i) : true)) return false;
+  }
+
+  CAN_BitDecoder decoder;
+  decoder.resetToIdle();
+  CAN_Decode_Event event = CAN_DECODE_NONE;
+  for (int i = 0; i < n && event != CAN_DECODE_FRAME_OK && event != CAN_DECODE_ERROR; i++) event = decoder.feed(bits[i]);
+  return event == CAN_DECODE_FRAME_OK && decoder.frame().id == f.id && decoder.frame().dlc == f.dlc &&
+         memcmp(decoder.frame().data, f.data, f.dlc) == 0;
+}
+
+int main(int argc, char **argv) {
+  long frames = 20000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) frames = atol(argv[++i]);
+    else {
+      fprintf(stderr, "usage: rmtcheck [-n frames]\n");
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(1);
+  long checked = 0;
+  for (uint32_t resolution : RESOLUTIONS) {
+    for (uint32_t bitrate : BITRATES) {
+      if (resolution / bitrate < 8) continue;  // Too coarse to place edges
+      int maxSymbols = 0;
+      long symbolTotal = 0;
+      for (long k = 0; k < frames; k++) {
+        CAN_Frame f = randomFrame(rng);
+        int symbols = 0;
+        if (!check(f, resolution, bitrate, symbols)) {
+          fprintf(stderr, "mismatch: %u Hz ticks, %u bit/s, id %03X dlc %u\n", resolution, bitrate, f.id, f.dlc);
+          return 1;
+        }
+        symbolTotal += symbols;
+        if (symbols > maxSymbols) maxSymbols = symbols;
+        checked++;
+      }
+      printf("%8u Hz ticks, %7u bit/s: %.1f ticks/bit, %.1f symbols/frame (max %d)\n", resolution, bitrate,
+             (double)resolution / bitrate, (double)symbolTotal / frames, maxSymbols);
+    }
+  }
+
+  // Encode cost, waveform included
+  std::vector<CAN_Frame> set;
+  for (int i = 0; i < 4096; i++) set.push_back(randomFrame(rng));
+  CAN_RmtSymbol out[CAN_RMT_MAX_SYMBOLS];
+  uint32_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < 100; pass++) {
+    for (size_t i = 0; i < set.size(); i++) {
+      sink += can_rmt_encode(can_encode_waveform(set[i]), 20000000, 500000, out, CAN_RMT_MAX_SYMBOLS);
+    }
+  }
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%ld frames verified; encode %.0f ns/frame (%u symbols)\n", checked, s * 1e9 / (100.0 * set.size()), sink);
+  return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * schedcheck.cpp - ESP_CAN_Scheduler on a simulated bus: EDF order, expiry
+ * of stale copies, jitter and missed deadlines.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -Itools/canloop -Ilib -o schedcheck tools/schedcheck/schedcheck.cpp
+ * Usage:
+ *   schedcheck [-r bitrate] [-s cycles] [-t seconds]
+ *
+ * The scheduler's node shares canloop's wired-AND bus with a peer that
+ * receives and timestamps every frame, and in some phases with a third
+ * node that sends a competing frame. Each producer writes the release time
+ * into the first four data bytes, so the peer knows which release every
+ * frame belongs to.
+ *
+ * edf:     four messages at offset 0 whose IDs rise as their periods get
+ *          shorter, so lowest ID first and earliest deadline first differ.
+ *          Frames of the same release must reach the bus in order of
+ *          deadline, then ID.
+ * expiry:  a 4-byte message every 75 bit times (150 us at 500 kbit/s),
+ *          less than the bus needs for it, plus a higher-priority 8-byte
+ *          frame from the third node every 2 ms. Copies that miss their
+ *          deadline must expire: no frame may start on the bus after its
+ *          release plus its period, and every release must be either sent
+ *          or counted as a missed deadline.
+ * jitter:  eight messages from 1 ms to 100 ms for -t seconds (default 1),
+ *          once with automatic offsets (in slots of one 8-byte frame) and
+ *          once with all offsets 0. Below 500 kbit/s the periods grow with
+ *          the bit time, so the set still fits on the bus (about half its
+ *          capacity). No deadline may be missed; the release-to-SOF jitter
+ *          is printed for each message.
+ *
+ * Exits 1 on any deviation.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "ESP_CAN.cpp"
+#include "ESP_CAN_BitTiming.cpp"
+#include "ESP_CAN_Decoder.cpp"
+#include "ESP_CAN_Scheduler.cpp"
+
+uint64_t canloop_cycles = 0;
+uint32_t canloop_step = 40;
+uint32_t canloop_mhz = 240;
+uint64_t canloop_dominant = 0;
+EspClass ESP;
+
+struct Seen {
+  uint32_t id;
+  uint32_t released;  // From the payload
+  uint32_t sofUs;
+};
+
+struct Spec {
+  uint32_t id;
+  uint8_t dlc;
+  uint32_t periodUs;
+};
+
+// The release time, as the producer sees it
+static bool stampRelease(CAN_Frame &frame, void *) {
+  uint32_t now = micros();
+  memcpy(frame.data, &now, 4);
+  return true;
+}
+
+struct Result {
+  std::vector<Seen> seen;  // Scheduled frames, in bus order
+  std::vector<CAN_Periodic_Stats> stats;
+  std::vector<uint32_t> offsets;
+  std::vector<float> averageJitterUs;
+};
+
+// Runs `specs` for `durationUs`. With `competingUs` a third node sends ID
+// 0x050 with 8 bytes that often.
+static Result run(const std::vector<Spec> &specs, bool autoOffsets, long bitrate, uint32_t durationUs,
+                  uint32_t competingUs) {
+  canloop_cycles = 0;
+  canloop_dominant = 0;
+  ESP_CAN node(0, 1), peer(2, 3), competitor(4, 5);
+  node.begin(bitrate);
+  peer.begin(bitrate);
+  competitor.begin(bitrate);
+
+  ESP_CAN_Scheduler scheduler(node);
+  // Automatic offsets one 8-byte frame apart
+  scheduler.setStaggerSlot((uint32_t)(135000000LL / bitrate));
+  for (const Spec &s : specs) {
+    CAN_Frame f = {s.id, s.dlc, {0}};
+    scheduler.add(f, s.periodUs, autoOffsets ? CAN_SCHEDULER_AUTO_OFFSET : 0, stampRelease);
+  }
+  CAN_Frame competing = {0x050, 8, {0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55}};
+  uint32_t nextCompeting = competingUs;
+  scheduler.begin();
+
+  Result r;
+  CAN_Frame frame;
+  while (micros() < durationUs) {
+    scheduler.poll(frame);
+    if (peer.readFrame(frame) == CAN_READ_MSG_OK && frame.id != competing.id) {
+      Seen s;
+      s.id = frame.id;
+      memcpy(&s.released, frame.data, 4);
+      s.sofUs = peer.rxStartCycles() / canloop_mhz;
+      r.seen.push_back(s);
+    }
+    competitor.readFrame(frame);
+    if (competingUs && micros() >= nextCompeting) {
+      competitor.startFrame(competing);
+      nextCompeting += competingUs;
+    }
+  }
+  for (int i = 0; i < scheduler.count(); i++) {
+    r.stats.push_back(scheduler.stats(i));
+    r.offsets.push_back(scheduler.offset(i));
+    r.averageJitterUs.push_back(scheduler.averageJitterUs(i));
+  }
+  return r;
+}
+
+static const Spec *specOf(const std::vector<Spec> &specs, uint32_t id) {
+  for (const Spec &s : specs) {
+    if (s.id == id) return &s;
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  long bitrate = 500000;
+  double seconds = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-r") && i + 1 < argc) bitrate = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) canloop_step = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc) seconds = atof(argv[++i]);
+    else {
+      fprintf(stderr, "usage: schedcheck [-r bitrate] [-s cycles] [-t seconds]\n");
+      return 2;
+    }
+  }
+  // The SOF times come from a 32-bit cycle count, which wraps after
+  // about 17.9 s at 240 MHz
+  if (seconds <= 0 || seconds > 15) {
+    fprintf(stderr, "-t must be above 0 and at most 15\n");
+    return 2;
+  }
+
+  int failures = 0;
+  printf("%ld bit/s, %u cycles per poll\n", bitrate, canloop_step);
+
+  // --- EDF order ---
+  std::vector<Spec> edf = {{0x100, 8, 20000}, {0x200, 8, 10000}, {0x300, 8, 5000}, {0x400, 8, 2500}};
+  std::vector<Seen> seen = run(edf, false, bitrate, 100000, 0).seen;
+  long groups = 0, misordered = 0;
+  for (size_t k = 1; k < seen.size(); k++) {
+    if (seen[k].released != seen[k - 1].released) continue;
+    if (k == 1 || seen[k - 1].released != seen[k - 2].released) groups++;
+    const Spec *a = specOf(edf, seen[k - 1].id), *b = specOf(edf, seen[k].id);
+    if (a->periodUs < b->periodUs || (a->periodUs == b->periodUs && a->id < b->id)) continue;
+    misordered++;
+  }
+  printf("edf:     %zu frames, %ld simultaneous releases, %ld out of deadline order\n", seen.size(), groups,
+         misordered);
+  if (misordered || groups == 0) failures++;
+
+  // --- Expiry ---
+  std::vector<Spec> overload = {{0x100, 4, (uint32_t)(75000000 / bitrate)}};
+  Result r = run(overload, false, bitrate, 200000, 2000);
+  long late = 0;
+  for (const Seen &s : r.seen) {
+    if ((int32_t)(s.sofUs - (s.released + overload[0].periodUs)) >= 0) late++;
+  }
+  const CAN_Periodic_Stats &o = r.stats[0];
+  printf("expiry:  %u releases, %u sent, %u missed deadlines, %ld started after their deadline\n", o.releases,
+         o.sent, o.missedDeadlines, late);
+  // At the end one copy may still be on the bus and the next release ready
+  if (late || o.missedDeadlines == 0 || o.sent + o.missedDeadlines + 2 < o.releases) failures++;
+
+  // --- Jitter and misses ---
+  std::vector<Spec> set = {{0x080, 8, 1000},  {0x100, 8, 2000},  {0x180, 4, 5000},  {0x200, 8, 10000},
+                           {0x280, 2, 10000}, {0x300, 8, 20000}, {0x380, 8, 50000}, {0x400, 8, 100000}};
+  if (bitrate < 500000) {
+    for (Spec &m : set) m.periodUs = (uint32_t)((uint64_t)m.periodUs * 500000 / bitrate);
+  }
+  uint32_t durationUs = (uint32_t)(seconds * 1e6);
+  for (int autoOffsets = 1; autoOffsets >= 0; autoOffsets--) {
+    r = run(set, autoOffsets, bitrate, durationUs, 0);
+    printf("jitter:  %s\n", autoOffsets ? "automatic offsets" : "all offsets 0");
+    printf("  id   period  offset  releases   sent  missed  avg us  max us\n");
+    for (size_t i = 0; i < set.size(); i++) {
+      const CAN_Periodic_Stats &s = r.stats[i];
+      printf("  %03X %7u %7u %9u %6u %7u %7.1f %7u\n", (unsigned)set[i].id, set[i].periodUs, r.offsets[i],
+             s.releases, s.sent, s.missedDeadlines, r.averageJitterUs[i], s.maxJitterUs);
+      if (s.missedDeadlines || s.sent + 1 < s.releases) failures++;
+    }
+  }
+
+  printf(failures ? "FAILED\n" : "ok\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * slcan_decode.cpp - Host decoder for the SLCAN bridge's binary batch mode.
+ *
+ * Build on the host:  g++ -std=c++11 -O2 -I../../lib -o slcan_decode slcan_decode.cpp
+ * Usage:              slcan_decode [-q] [capture.bin]    (reads stdin without a file)
+ *
+ * Prints frames in candump format ("(seconds) can0 123#DEADBEEF"). With -q
+ * only the summary is printed, which is how decode throughput is measured.
+ * Batches are located by their 0x00 delimiter and decoded in place, so the
+ * stream is processed in large chunks without per-frame allocation.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "ESP_CAN_BatchFormat.h"
+
+struct Stats {
+  unsigned long long bytes = 0;
+  unsigned long long batches = 0;
+  unsigned long long frames = 0;
+  unsigned long long errorFrames = 0;
+  unsigned long long badBlocks = 0;
+  unsigned long long lostBatches = 0;
+  uint32_t dropped = 0;
+  bool haveSequence = false;
+  uint16_t lastSequence = 0;
+};
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static void printRecord(const CAN_BatchRecord &r, std::vector<char> &out) {
+  char line[64];
+  int n = snprintf(line, sizeof(line), "(%lu.%06lu) can0 %03X#",
+                   (unsigned long)(r.timestampUs / 1000000), (unsigned long)(r.timestampUs % 1000000), r.id);
+  int dlc = r.dlc > 8 ? 8 : r.dlc;
+  if (r.flags & CAN_BATCH_FLAG_REMOTE) {
+    // candump notation: R and the requested length
+    line[n++] = 'R';
+    if (dlc > 0) line[n++] = HEX_DIGITS[dlc];
+    dlc = 0;
+  }
+  for (int i = 0; i < dlc; i++) {
+    line[n++] = HEX_DIGITS[r.data[i] >> 4];
+    line[n++] = HEX_DIGITS[r.data[i] & 0x0F];
+  }
+  if (r.flags & CAN_BATCH_FLAG_ERROR) {
+    memcpy(line + n, " ERROR", 6);
+    n += 6;
+  }
+  line[n++] = '\n';
+  out.insert(out.end(), line, line + n);
+}
+
+static void handleBlock(uint8_t *block, size_t len, Stats &stats, bool quiet, std::vector<char> &out) {
+  size_t decoded = can_cobs_decode(block, len, block);
+  if (decoded < sizeof(CAN_BatchHeader)) { stats.badBlocks++; return; }
+
+  CAN_BatchHeader header;
+  memcpy(&header, block, sizeof(header));
+  if (header.magic != CAN_BATCH_MAGIC || header.count == 0 || header.count > CAN_BATCH_MAX_RECORDS ||
+      decoded != sizeof(header) + header.count * sizeof(CAN_BatchRecord)) {
+    stats.badBlocks++;
+    return;
+  }
+
+  if (stats.haveSequence) stats.lostBatches += (uint16_t)(header.sequence - stats.lastSequence - 1);
+  stats.haveSequence = true;
+  stats.lastSequence = header.sequence;
+  stats.dropped = header.dropped;
+  stats.batches++;
+  stats.frames += header.count;
+
+  const uint8_t *records = block + sizeof(header);
+  for (int i = 0; i < header.count; i++) {
+    CAN_BatchRecord r;
+    memcpy(&r, records + i * sizeof(CAN_BatchRecord), sizeof(r));
+    if (r.flags & CAN_BATCH_FLAG_ERROR) stats.errorFrames++;
+    if (!quiet) printRecord(r, out);
+  }
+}
+
+int main(int argc, char **argv) {
+  bool quiet = false;
+  const char *path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-q") == 0) quiet = true;
+    else path = argv[i];
+  }
+
+  FILE *in = path ? fopen(path, "rb") : stdin;
+  if (!in) { fprintf(stderr, "cannot open %s\n", path); return 1; }
+
+  const size_t CHUNK = 1 << 20;
+  std::vector<uint8_t> buffer(CHUNK + CAN_BATCH_MAX_ENCODED);
+  std::vector<char> out;
+  out.reserve(1 << 20);
+  size_t pending = 0; // Bytes of an unterminated block carried over from the previous read
+  Stats stats;
+
+  auto start = std::chrono::steady_clock::now();
+  size_t n;
+  while ((n = fread(buffer.data() + pending, 1, CHUNK, in)) > 0) {
+    stats.bytes += n;
+    size_t end = pending + n;
+    size_t blockStart = 0;
+    uint8_t *delim;
+    while ((delim = (uint8_t *)memchr(buffer.data() + blockStart, 0, end - blockStart)) != nullptr) {
+      size_t blockEnd = delim - buffer.data();
+      if (blockEnd > blockStart) handleBlock(buffer.data() + blockStart, blockEnd - blockStart, stats, quiet, out);
+      blockStart = blockEnd + 1;
+    }
+    pending = end - blockStart;
+    if (pending > CAN_BATCH_MAX_ENCODED) { // Garbage without a delimiter, resync
+      stats.badBlocks++;
+      pending = 0;
+    }
+    memmove(buffer.data(), buffer.data() + blockStart, pending);
+    if (!out.empty()) {
+      fwrite(out.data(), 1, out.size(), stdout);
+      out.clear();
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (path) fclose(in);
+
+  fprintf(stderr, "%llu bytes, %llu batches, %llu frames (%llu errors), %llu bad blocks, "
+                  "%llu lost batches, %lu frames dropped on device\n",
+          stats.bytes, stats.batches, stats.frames, stats.errorFrames, stats.badBlocks,
+          stats.lostBatches, (unsigned long)stats.dropped);
+  if (seconds > 0) {
+    fprintf(stderr, "%.1f MB/s, %.1f Mframes/s\n", stats.bytes / seconds / 1e6, stats.frames / seconds / 1e6);
+  }
+  return 0;
+}
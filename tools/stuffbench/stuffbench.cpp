@@ -0,0 +1,141 @@
+/*
+ * stuffbench.cpp - Checks and benchmarks the word-parallel stuffing kernel.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -Ilib -o stuffbench tools/stuffbench/stuffbench.cpp
+ *   (add -mbmi2 or -march=native for the PEXT/PDEP path)
+ * Usage:
+ *   stuffbench [-n fuzz_cases] [-m megabits]
+ *
+ * The fuzz pass compares can_stuff_bits and can_destuff_bits bit for bit
+ * against the scalar reference, on random streams with a bias towards long
+ * runs, including stuff errors. It also checks that stuffing then
+ * destuffing gives back the input. The benchmark then times both kernels
+ * and the reference on a large stream. Exits 1 on any mismatch.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "ESP_CAN_Stuffing.h"
+
+static int usage() {
+  fprintf(stderr, "usage: stuffbench [-n fuzz_cases] [-m megabits]\n");
+  return 2;
+}
+
+static size_t wordsFor(size_t bits) { return bits / 64 + 2; }
+
+// Random bits with runs of 1..12, so stuffing triggers often
+static void randomBits(std::mt19937_64 &rng, std::vector<uint64_t> &bits, size_t n) {
+  bits.assign(wordsFor(n), 0);
+  bool level = rng() & 1;
+  size_t i = 0;
+  while (i < n) {
+    size_t run = 1 + (rng() % 4 == 0 ? rng() % 12 : rng() % 3);
+    for (size_t k = 0; k < run && i < n; k++, i++) can_set_bit(bits.data(), i, level);
+    level = !level;
+  }
+}
+
+static bool sameBits(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (can_get_bit(a.data(), i) != can_get_bit(b.data(), i)) return false;
+  }
+  return true;
+}
+
+static int fuzz(long cases) {
+  std::mt19937_64 rng(1);
+  std::vector<uint64_t> data, stuffed, stuffedRef, destuffed, destuffedRef;
+  long errorsFound = 0;
+  for (long c = 0; c < cases; c++) {
+    size_t n = 1 + rng() % 700;
+    randomBits(rng, data, n);
+
+    stuffed.assign(wordsFor(n + n / 4), 0);
+    stuffedRef.assign(wordsFor(n + n / 4), 0);
+    size_t s = can_stuff_bits(data.data(), n, stuffed.data());
+    size_t sRef = can_stuff_bits_scalar(data.data(), n, stuffedRef.data());
+    if (s != sRef || !sameBits(stuffed, stuffedRef, s)) {
+      fprintf(stderr, "stuff mismatch: case %ld, %zu bits -> %zu, reference %zu\n", c, n, s, sRef);
+      return 1;
+    }
+
+    // Round trip, then the stream with one bit forced, or replaced by random bits
+    for (int pass = 0; pass < 2; pass++) {
+      if (pass == 1) {
+        if (rng() % 2) can_set_bit(stuffed.data(), rng() % s, rng() & 1);
+        else randomBits(rng, stuffed, s);
+      }
+      destuffed.assign(wordsFor(s), 0);
+      destuffedRef.assign(wordsFor(s), 0);
+      size_t errorAt, errorAtRef;
+      size_t d = can_destuff_bits(stuffed.data(), s, destuffed.data(), &errorAt);
+      size_t dRef = can_destuff_bits_scalar(stuffed.data(), s, destuffedRef.data(), &errorAtRef);
+      if (d != dRef || errorAt != errorAtRef || !sameBits(destuffed, destuffedRef, d)) {
+        fprintf(stderr, "destuff mismatch: case %ld pass %d, %zu bits -> %zu (error %zu), reference %zu (error %zu)\n",
+                c, pass, s, d, errorAt, dRef, errorAtRef);
+        return 1;
+      }
+      if (pass == 0 && (d != n || errorAt != s || !sameBits(destuffed, data, n))) {
+        fprintf(stderr, "round trip failed: case %ld, %zu bits\n", c, n);
+        return 1;
+      }
+      if (errorAt != s) errorsFound++;
+    }
+  }
+  printf("fuzz: %ld cases bit-exact, %ld stuff errors located\n", cases, errorsFound);
+  return 0;
+}
+
+template <typename F> static double gbits(size_t bits, F f) {
+  double best = 1e9;
+  for (int i = 0; i < 5; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return bits / best / 1e9;
+}
+
+static void bench(size_t n) {
+  std::mt19937_64 rng(2);
+  std::vector<uint64_t> data(wordsFor(n));
+  for (size_t i = 0; i < data.size(); i++) data[i] = rng();  // Typical traffic: few stuff bits
+  std::vector<uint64_t> stuffed(wordsFor(n + n / 4)), destuffed(wordsFor(n + n / 4));
+  size_t s = 0, d = 0, errorAt;
+
+  double stuff = gbits(n, [&] { s = can_stuff_bits(data.data(), n, stuffed.data()); });
+  double stuffRef = gbits(n, [&] { s = can_stuff_bits_scalar(data.data(), n, stuffed.data()); });
+  double destuff = gbits(s, [&] { d = can_destuff_bits(stuffed.data(), s, destuffed.data(), &errorAt); });
+  double destuffRef = gbits(s, [&] { d = can_destuff_bits_scalar(stuffed.data(), s, destuffed.data(), &errorAt); });
+
+#if defined(__BMI2__)
+  const char *path = "PEXT/PDEP";
+#else
+  const char *path = "mask fallback";
+#endif
+  printf("bench: %zu Mbit, %zu stuff bits (%s)\n", n >> 20, s - n, path);
+  printf("  stuff:   %6.2f Gbit/s  (scalar %5.2f, x%.1f)\n", stuff, stuffRef, stuff / stuffRef);
+  printf("  destuff: %6.2f Gbit/s  (scalar %5.2f, x%.1f)\n", destuff, destuffRef, destuff / destuffRef);
+  if (d != n) printf("  destuff returned %zu bits\n", d);
+}
+
+int main(int argc, char **argv) {
+  long cases = 200000;
+  long megabits = 64;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) cases = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-m") && i + 1 < argc) megabits = atol(argv[++i]);
+    else return usage();
+  }
+  if (fuzz(cases)) return 1;
+  if (megabits > 0) bench((size_t)megabits << 20);
+  return 0;
+}
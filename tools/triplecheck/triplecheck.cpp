@@ -0,0 +1,179 @@
+/*
+ * triplecheck.cpp - Frames recovered by triple sampling on a spiky bus, and
+ * what it costs per poll.
+ *
+ * Build on the host:
+ *   g++ -std=c++11 -O2 -Itools/canloop -Ilib -o triplecheck tools/triplecheck/triplecheck.cpp
+ * Usage:
+ *   triplecheck [-n frames] [-r bitrate] [-s cycles] [-i spike_interval_us] [-w spike_cycles] [-t spacing_tq]
+ *
+ * A sender and a receiver share canloop's wired-AND bus. Dominant spikes of
+ * -w CPU cycles (default 100) hit the receiver's RX line at random
+ * intervals averaging -i us (default 300); the sender does not see them.
+ * The same frames and the same spikes are run with single sampling and
+ * then with triple sampling on the receiver, -t time quanta apart (default
+ * 2). A frame counts as recovered when the receiver reads it unchanged; the
+ * sender sends each frame once. For each run the tool prints the frames
+ * recovered, the bits outvoted (votesCorrected), and the host time and, on
+ * x86, the TSC cycles for one poll of each node, the best of three runs.
+ * The difference is the added cost of triple sampling per receiver poll.
+ *
+ * A spike no longer than the gap between two polls is mostly harmless even
+ * with single sampling: its edge resynchronizes the receiver, which moves
+ * the sample point past it. Triple sampling helps against longer spikes,
+ * but only while the spacing is longer than a spike plus the poll
+ * interval; otherwise one spike takes two of the three reads. Exits 1 if
+ * triple sampling recovers fewer frames than single sampling, or if any
+ * frame is lost with -i 0.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRIPLECHECK_TSC 1
+#endif
+
+#include "ESP_CAN.cpp"
+#include "ESP_CAN_BitTiming.cpp"
+#include "ESP_CAN_Decoder.cpp"
+
+uint64_t canloop_cycles = 0;
+uint32_t canloop_step = 40;
+uint32_t canloop_mhz = 240;
+uint64_t canloop_dominant = 0;
+EspClass ESP;
+
+static const int NOISE_PIN = 7;  // On bus 0, with both nodes
+
+struct RunResult {
+  long recovered, corrupted;
+  uint32_t votesCorrected;
+  uint64_t polls;
+  double ns;
+  uint64_t tsc;
+};
+
+static bool sameFrame(const CAN_Frame &a, const CAN_Frame &b) {
+  return a.id == b.id && a.dlc == b.dlc && memcmp(a.data, b.data, a.dlc) == 0;
+}
+
+static RunResult run(const std::vector<CAN_Frame> &frames, long bitrate, bool triple, uint8_t spacingTq,
+                     uint32_t intervalUs, uint32_t spikeCycles) {
+  canloop_cycles = 0;
+  canloop_dominant = 0;
+  ESP_CAN sender(0, 1), receiver(2, 3);
+  sender.begin(bitrate);
+  receiver.begin(bitrate);
+  receiver.setTripleSampling(triple, spacingTq);
+
+  // The same spike times in both runs
+  std::mt19937 rng(2);
+  uint64_t intervalCycles = (uint64_t)intervalUs * canloop_mhz;
+  uint64_t spikeAt = intervalCycles ? intervalCycles / 2 + rng() % intervalCycles : ~0ULL;
+
+  uint64_t timeoutPolls = 200ULL * canloop_mhz * 1000000 / bitrate / canloop_step;
+  RunResult r = RunResult();
+  auto wallStart = std::chrono::steady_clock::now();
+#ifdef TRIPLECHECK_TSC
+  uint64_t tscStart = __rdtsc();
+#endif
+  for (const CAN_Frame &sent : frames) {
+    bool received = false;
+    CAN_Frame got, own;
+    sender.startFrame(sent);
+    // Until the frame is read or dropped, and the bus is idle again
+    for (uint64_t poll = 0; poll < timeoutPolls; poll++) {
+      sender.readFrame(own);
+      bool spike = canloop_cycles >= spikeAt;
+      if (spike) digitalWrite(NOISE_PIN, LOW);
+      if (receiver.readFrame(got) == CAN_READ_MSG_OK) {
+        if (sameFrame(sent, got)) received = true;
+        else r.corrupted++;
+      }
+      if (spike) digitalWrite(NOISE_PIN, HIGH);
+      if (spike && canloop_cycles >= spikeAt + spikeCycles) spikeAt += intervalCycles / 2 + rng() % intervalCycles;
+      r.polls++;
+      CAN_Tx_State tx = sender.txState();
+      if (tx != CAN_TX_WAITING && tx != CAN_TX_SENDING && sender.busIdle() && receiver.busIdle()) break;
+    }
+    if (received) r.recovered++;
+  }
+#ifdef TRIPLECHECK_TSC
+  r.tsc = __rdtsc() - tscStart;
+#endif
+  r.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wallStart).count();
+  r.votesCorrected = receiver.votesCorrected;
+  return r;
+}
+
+static void keepFastest(RunResult &best, const RunResult &r) {
+  if (r.ns < best.ns) best.ns = r.ns;
+  if (r.tsc < best.tsc) best.tsc = r.tsc;
+}
+
+static void print(const char *name, const RunResult &r, long frames) {
+  printf("%-7s %5ld of %ld frames recovered, %ld corrupted reads, %u bits outvoted, %.2f ns", name, r.recovered,
+         frames, r.corrupted, r.votesCorrected, r.ns / r.polls);
+#ifdef TRIPLECHECK_TSC
+  printf(", %.1f TSC cycles", (double)r.tsc / r.polls);
+#endif
+  printf(" per poll pair\n");
+}
+
+int main(int argc, char **argv) {
+  long frames = 2000;
+  long bitrate = 125000;
+  uint32_t intervalUs = 300;
+  uint32_t spikeCycles = 100;
+  int spacingTq = 2;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) frames = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) bitrate = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) canloop_step = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-i") && i + 1 < argc) intervalUs = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-w") && i + 1 < argc) spikeCycles = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc) spacingTq = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: triplecheck [-n frames] [-r bitrate] [-s cycles] [-i spike_interval_us] "
+                      "[-w spike_cycles] [-t spacing_tq]\n");
+      return 2;
+    }
+  }
+
+  std::vector<CAN_Frame> sent(frames);
+  std::mt19937 rng(1);
+  for (CAN_Frame &f : sent) {
+    f.id = rng() & 0x7FF;
+    f.dlc = rng() % 9;
+    for (int i = 0; i < 8; i++) f.data[i] = rng();
+  }
+
+  printf("%ld frames, %ld bit/s, %u cycles per poll, ", frames, bitrate, canloop_step);
+  if (intervalUs) printf("%u-cycle spikes every %u us on average\n", spikeCycles, intervalUs);
+  else printf("no spikes\n");
+  // Every run sees the same bus, so only the times differ
+  RunResult single = run(sent, bitrate, false, spacingTq, intervalUs, spikeCycles);
+  RunResult triple = run(sent, bitrate, true, spacingTq, intervalUs, spikeCycles);
+  for (int rep = 1; rep < 3; rep++) {
+    keepFastest(single, run(sent, bitrate, false, spacingTq, intervalUs, spikeCycles));
+    keepFastest(triple, run(sent, bitrate, true, spacingTq, intervalUs, spikeCycles));
+  }
+  print("single", single, frames);
+  print("triple", triple, frames);
+  printf("triple sampling: %+ld frames, %+.2f ns per receiver poll", triple.recovered - single.recovered,
+         triple.ns / triple.polls - single.ns / single.polls);
+#ifdef TRIPLECHECK_TSC
+  printf(", %+.1f TSC cycles", (double)triple.tsc / triple.polls - (double)single.tsc / single.polls);
+#endif
+  printf("\n");
+
+  bool failed = triple.recovered < single.recovered || (!intervalUs && triple.recovered != frames) ||
+                (!intervalUs && single.recovered != frames);
+  printf(failed ? "FAILED\n" : "ok\n");
+  return failed ? 1 : 0;
+}
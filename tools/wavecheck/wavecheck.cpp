@@ -0,0 +1,114 @@
+/*
+ * wavecheck.cpp - Checks can_encode_waveform() at compile time and at run time.
+ *
+ * Build on the host (C++14, for the compile-time part):
+ *   g++ -std=c++14 -O2 -Ilib -o wavecheck tools/wavecheck/wavecheck.cpp lib/ESP_CAN_Decoder.cpp
+ * Usage:
+ *   wavecheck [-n frames]
+ *
+ * The build fails if the constexpr encoder differs from waveforms recorded
+ * from the bit-at-a-time encoder that sendFrame() used before it. At run
+ * time, random data and remote frames (and every DLC up to 15) are encoded
+ * and compared bit for bit with a plain reference encoder that builds the
+ * unstuffed bits, runs can_crc15() over them and then stuffs them. Exits 1
+ * on any difference.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "ESP_CAN_Waveform.h"
+
+constexpr bool waveformIs(const CAN_Waveform &w, uint32_t w0, uint32_t w1, uint32_t w2, uint32_t w3, int length,
+                          int arbitrationEnd) {
+  return w.words[0] == w0 && w.words[1] == w1 && w.words[2] == w2 && w.words[3] == w3 && w.length == length &&
+         w.arbitrationEnd == arbitrationEnd;
+}
+static_assert(waveformIs(can_encode_waveform(CAN_Frame{0x123, 4, {0xDE, 0xAD, 0xBE, 0xEF}}), 0xABD90C48,
+                         0x671F73ED, 0x0000000D, 0, 68, 13),
+              "constexpr encoder differs from the runtime encoder (0x123 DE AD BE EF)");
+static_assert(waveformIs(can_encode_waveform(CAN_Frame{0, 8, {0, 0, 0, 0, 0, 0, 0, 0}}), 0x41060820, 0x10410410,
+                         0x04104104, 0x000368A1, 114, 15),
+              "constexpr encoder differs from the runtime encoder (stuff-heavy frame)");
+
+// SOF to the end of the CRC, stuffed; arbitrationEnd as in CAN_Waveform
+static int reference(const CAN_Frame &f, bool out[], int &arbitrationEnd) {
+  bool bits[128];
+  int n = 0;
+  bool remote = can_is_remote(f);
+  int dlc = f.dlc > 8 ? 8 : f.dlc;
+  for (int i = 10; i >= 0; i--) bits[n++] = (f.id >> i) & 1;
+  bits[n++] = remote;
+  int rtrAt = n;  // Unstuffed bits up to and including RTR
+  bits[n++] = 0;  // IDE
+  bits[n++] = 0;  // r0
+  for (int i = 3; i >= 0; i--) bits[n++] = (dlc >> i) & 1;
+  for (int i = 0; !remote && i < dlc; i++) {
+    for (int j = 7; j >= 0; j--) bits[n++] = (f.data[i] >> j) & 1;
+  }
+  uint16_t crc = can_crc15(bits, n);
+  for (int i = 14; i >= 0; i--) bits[n++] = (crc >> i) & 1;
+
+  int length = 0;
+  out[length++] = 0;  // SOF
+  int run = 1;
+  bool last = 0;
+  for (int i = 0; i < n; i++) {
+    out[length++] = bits[i];
+    run = bits[i] == last ? run + 1 : 1;
+    last = bits[i];
+    if (run == 5) {
+      out[length++] = !last;
+      last = !last;
+      run = 1;
+    }
+    if (i + 1 == rtrAt) arbitrationEnd = length;
+  }
+  return length;
+}
+
+static bool check(const CAN_Frame &f, const CAN_Waveform &w) {
+  bool expected[160];
+  int arbitrationEnd = 0;
+  int length = reference(f, expected, arbitrationEnd);
+  bool same = w.length == length && w.arbitrationEnd == arbitrationEnd;
+  for (int i = 0; same && i < length; i++) same = w.bit(i) == expected[i];
+  // Nothing set past the end
+  for (int i = length; same && i < 128; i++) same = !w.bit(i);
+  if (!same) {
+    printf("mismatch: id %08X dlc %u: length %u/%d, arbitration end %u/%d\n", (unsigned)f.id, f.dlc, w.length,
+           length, w.arbitrationEnd, arbitrationEnd);
+  }
+  return same;
+}
+
+int main(int argc, char **argv) {
+  long frames = 1000000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) frames = atol(argv[++i]);
+    else {
+      fprintf(stderr, "usage: wavecheck [-n frames]\n");
+      return 2;
+    }
+  }
+
+  // Evaluated by the compiler: the waveform lands in .rodata
+  static constexpr CAN_PrecomputedFrame HEARTBEAT = can_precompute({0x123, 4, {0xDE, 0xAD, 0xBE, 0xEF}});
+  long failures = !check(HEARTBEAT.frame, HEARTBEAT.waveform);
+
+  std::mt19937 rng(1);
+  for (long n = 0; n < frames; n++) {
+    CAN_Frame f;
+    f.id = (rng() & 0x7FF) | (n % 4 == 0 ? CAN_RTR_FLAG : 0);
+    f.dlc = n % 16;
+    // Few set bits make long runs, and so many stuff bits
+    uint32_t mask = n % 3 == 0 ? 0x00 : 0xFF;
+    for (int i = 0; i < 8; i++) f.data[i] = (rng() & mask) | (n % 3 == 1 ? 0 : rng() % 2);
+    if (!check(f, can_encode_waveform(f))) failures++;
+  }
+  printf("%ld frames, %ld mismatches\n", frames, failures);
+  printf(failures ? "FAILED\n" : "ok\n");
+  return failures ? 1 : 0;
+}